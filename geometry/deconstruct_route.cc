@@ -0,0 +1,135 @@
+#include "deconstruct_route.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+vector<RouteSegment> split_route(const vector<Point> &route,
+                                 const double segment_length) {
+  if (!(segment_length > 0))
+    throw std::invalid_argument("segment length must be positive");
+  vector<RouteSegment> segments;
+  if (route.empty())
+    return segments;
+  double total = 0;
+  for (size_t i = 0; i < route.size(); i++)
+    total += dist(route[i], route[(i + 1) % route.size()]);
+  if (total == 0) {
+    segments.push_back({{route[0]}, 0});
+    return segments;
+  }
+
+  const size_t n =
+      std::max<size_t>(1, static_cast<size_t>(std::lround(total / segment_length)));
+  const double piece = total / n;
+  // Walk the closed route once, cutting every piece units of length.
+  RouteSegment current = {{route[0]}, 0};
+  for (size_t i = 0; i < route.size(); i++) {
+    Point a = route[i];
+    const Point &b = route[(i + 1) % route.size()];
+    double left = dist(a, b);
+    while (left > 0) {
+      const double need = piece - current.length;
+      if (left < need || segments.size() + 1 == n) {
+        current.path.push_back(b);
+        current.length += left;
+        break;
+      }
+      const Point cut = a + (need / left) * (b - a);
+      current.path.push_back(cut);
+      current.length = piece;
+      segments.push_back(current);
+      current = {{cut}, 0};
+      left -= need;
+      a = cut;
+    }
+  }
+  segments.push_back(current);
+  return segments;
+}
+
+vector<uint32_t> segment_targets(const RouteSegment &segment,
+                                 const vector<Segment> &edges,
+                                 const TargetIndex &targets,
+                                 const double step) {
+  // Every vertex of the path is a viewpoint, and so is every step between.
+  vector<Point> views = {segment.path[0]};
+  for (size_t i = 1; i < segment.path.size(); i++) {
+    const Point &a = segment.path[i - 1];
+    const Point &b = segment.path[i];
+    const double length = dist(a, b);
+    for (double t = step; t < length; t += step)
+      views.push_back(a + (t / length) * (b - a));
+    views.push_back(b);
+  }
+
+  vector<Ring> regions;
+  for (const auto &view : views)
+    regions.push_back(visibility_polygon(edges, view));
+  return targets.query(regions);
+}
+
+vector<vector<uint32_t>> segment_targets(const vector<RouteSegment> &segments,
+                                         const vector<Segment> &edges,
+                                         const TargetIndex &targets,
+                                         const double step,
+                                         const size_t threads) {
+  vector<vector<uint32_t>> seen(segments.size());
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (size_t n; (n = next++) < segments.size();)
+      seen[n] = segment_targets(segments[n], edges, targets, step);
+  };
+  size_t workers = threads != 0 ? threads : std::thread::hardware_concurrency();
+  workers = std::max<size_t>(1, std::min(workers, segments.size()));
+  vector<std::thread> pool;
+  for (size_t t = 1; t < workers; t++)
+    pool.emplace_back(work);
+  work();
+  for (auto &thread : pool)
+    thread.join();
+  return seen;
+}
+
+vector<RouteSegment> deconstruct_route(const WatchmanRoute &route,
+                                       const vector<Segment> &edges,
+                                       const vector<Point> &targets,
+                                       const int first_target,
+                                       const RouteSplitParams &params,
+                                       ProtectData &data) {
+  if (first_target < 1)
+    throw std::invalid_argument("targets start at 1");
+  if (!(params.speed > 0))
+    throw std::invalid_argument("walking speed must be positive");
+  const vector<RouteSegment> segments =
+      split_route(route.route, params.segment_length);
+  const double step =
+      params.view_step > 0 ? params.view_step : params.segment_length / 4;
+
+  const TargetIndex index(targets);
+  for (const auto &seen :
+       segment_targets(segments, edges, index, step, params.threads)) {
+    PatrolArea area;
+    for (const uint32_t n : seen)
+      area.push_back(first_target + static_cast<int>(n));
+    data.PatrolAreas.push_back(area);
+  }
+
+  const size_t slots = first_target + targets.size();
+  if (data.d_rewards.size() < slots) {
+    data.d_rewards.resize(slots, 0);
+    data.d_penalties.resize(slots, 0);
+    data.a_rewards.resize(slots, 0);
+    data.a_penalties.resize(slots, 0);
+  }
+  if (data.activities.empty() && !segments.empty()) {
+    const int time = std::max(
+        1, static_cast<int>(std::lround(segments[0].length / params.speed)));
+    data.activities.push_back({1, time, params.effectiveness});
+    if (params.linger_effectiveness > 0)
+      data.activities.push_back({2, 2 * time, params.linger_effectiveness});
+  }
+  return segments;
+}
@@ -0,0 +1,97 @@
+#ifndef DECONSTRUCT_ROUTE_H
+#define DECONSTRUCT_ROUTE_H
+
+#include <vector>
+
+#include "protect.h"
+#include "target_index.h"
+#include "watchman.h"
+
+struct RouteSplitParams {
+  double segment_length;  // Route length per patrol area.
+  double speed;           // Walking speed, in distance per time unit of
+                          // the protect schedules.
+  double view_step;       // Distance between the viewpoints of a segment, 0
+                          // for a quarter of segment_length.
+  double effectiveness;   // Effectiveness of walking a segment.
+  double linger_effectiveness; // Effectiveness of walking it at half speed,
+                               // 0 to offer no such activity.
+  size_t threads; // Segments classified at once, 0 for the hardware
+                  // concurrency.
+  RouteSplitParams()
+      : segment_length(50), speed(1), view_step(0), effectiveness(0.5),
+        linger_effectiveness(0.8), threads(0) {}
+};
+
+// A contiguous piece of a route.
+struct RouteSegment {
+  vector<Point> path;
+  double length;
+};
+
+/**
+ * Cut a closed route into pieces of equal length, as close to
+ * segment_length as a whole number of pieces allows. Every piece takes the
+ * same time to walk, so a single activity duration fits all of them.
+ *
+ * @param route closed route; the last point connects to the first
+ * @param segment_length length to aim for
+ */
+vector<RouteSegment> split_route(const vector<Point> &route,
+                                 const double segment_length);
+
+/**
+ * Targets seen from anywhere along a segment: the union of the visibility
+ * polygons of viewpoints spaced step apart along it, classified in one
+ * batched index query.
+ *
+ * @param segment route piece in the free space of the polygon with edges
+ * @param edges polygon edges
+ * @param targets target index
+ * @param step distance between viewpoints
+ *
+ * @return indices into the indexed targets, sorted
+ */
+vector<uint32_t> segment_targets(const RouteSegment &segment,
+                                 const vector<Segment> &edges,
+                                 const TargetIndex &targets,
+                                 const double step);
+
+/**
+ * segment_targets of every segment, on threads threads (0 for the hardware
+ * concurrency). The result is one sparse, sorted target list per segment,
+ * the rows of the segments' patrol areas.
+ */
+vector<vector<uint32_t>> segment_targets(const vector<RouteSegment> &segments,
+                                         const vector<Segment> &edges,
+                                         const TargetIndex &targets,
+                                         const double step,
+                                         const size_t threads);
+
+/**
+ * Turn a watchman route into patrol areas and activities. Each segment of
+ * split_route becomes a PatrolArea of the targets visible from it, so areas
+ * only overlap where segments really share a view. The activities walk a
+ * segment (number 1) and, if linger_effectiveness is set, walk it at half
+ * speed (number 2); their time is the segment length over the speed,
+ * rounded to whole time units.
+ *
+ * @param route solved route of the polygon with edges
+ * @param edges polygon edges
+ * @param targets target positions; targets[n] is target first_target + n
+ * @param first_target protect number of the first target (targets start at
+ * 1, slot 0 is unused)
+ * @param params splitting parameters
+ * @param data receives the areas, and the activities if it has none; its
+ * payoff vectors are extended with zero payoffs to cover every target
+ *
+ * @return the segments, in the order of the areas appended to data
+ */
+vector<RouteSegment> deconstruct_route(const WatchmanRoute &route,
+                                       const vector<Segment> &edges,
+                                       const vector<Point> &targets,
+                                       const int first_target,
+                                       const RouteSplitParams &params,
+                                       ProtectData &data);
+
+#endif /* DECONSTRUCT_ROUTE_H */
@@ -0,0 +1,36 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static void clean_ring(Ring &ring, const bool counter_clockwise) {
+  Ring cleaned;
+  for (const auto &p : ring)
+    if (cleaned.empty() || cleaned.back() != p)
+      cleaned.push_back(p);
+  while (cleaned.size() > 1 && cleaned.front() == cleaned.back())
+    cleaned.pop_back();
+  if (cleaned.size() < 3)
+    throw std::invalid_argument("polygon ring with fewer than 3 vertices");
+  if ((signed_area2(cleaned) > 0) != counter_clockwise)
+    std::reverse(cleaned.begin(), cleaned.end());
+  ring = std::move(cleaned);
+}
+
+void normalize_polygon(Polygon &polygon) {
+  clean_ring(polygon.outer, true);
+  for (auto &hole : polygon.holes)
+    clean_ring(hole, false);
+}
+
+vector<Segment> polygon_edges(const Polygon &polygon) {
+  vector<Segment> edges;
+  auto add_ring = [&edges](const Ring &ring) {
+    for (size_t i = 0; i < ring.size(); i++)
+      edges.emplace_back(ring[i], ring[(i + 1) % ring.size()]);
+  };
+  add_ring(polygon.outer);
+  for (const auto &hole : polygon.holes)
+    add_ring(hole);
+  return edges;
+}
@@ -0,0 +1,117 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <cmath>
+#include <vector>
+
+using std::vector;
+
+struct Point {
+  double x;
+  double y;
+  Point() : x(0), y(0) {}
+  Point(const double x, const double y) : x(x), y(y) {}
+};
+
+inline Point operator+(const Point &a, const Point &b) {
+  return Point(a.x + b.x, a.y + b.y);
+}
+inline Point operator-(const Point &a, const Point &b) {
+  return Point(a.x - b.x, a.y - b.y);
+}
+inline Point operator*(const double s, const Point &a) {
+  return Point(s * a.x, s * a.y);
+}
+inline bool operator==(const Point &a, const Point &b) {
+  return a.x == b.x && a.y == b.y;
+}
+inline bool operator!=(const Point &a, const Point &b) { return !(a == b); }
+
+inline double cross(const Point &a, const Point &b) {
+  return a.x * b.y - a.y * b.x;
+}
+inline double dot(const Point &a, const Point &b) {
+  return a.x * b.x + a.y * b.y;
+}
+inline double norm(const Point &a) { return std::sqrt(dot(a, a)); }
+inline double dist(const Point &a, const Point &b) { return norm(b - a); }
+
+// Positive if a, b, c turn left, negative if they turn right.
+inline double orient(const Point &a, const Point &b, const Point &c) {
+  return cross(b - a, c - a);
+}
+
+struct Segment {
+  Point a;
+  Point b;
+  Segment() {}
+  Segment(const Point &a, const Point &b) : a(a), b(b) {}
+};
+
+// True if the interiors of s and t cross at a single point.
+inline bool segments_cross(const Segment &s, const Segment &t) {
+  const double d1 = orient(s.a, s.b, t.a);
+  const double d2 = orient(s.a, s.b, t.b);
+  const double d3 = orient(t.a, t.b, s.a);
+  const double d4 = orient(t.a, t.b, s.b);
+  return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+         ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+}
+
+// Closed polygonal chain; the last vertex connects back to the first.
+typedef vector<Point> Ring;
+
+/*
+ * A polygon with holes, such as a floor plan or a street block. The free
+ * space is inside outer and outside every hole. After normalize_polygon the
+ * outer ring is counter clockwise and the holes clockwise, so the free space
+ * is to the left of every edge.
+ */
+struct Polygon {
+  Ring outer;
+  vector<Ring> holes;
+};
+
+// Twice the signed area, positive for a counter clockwise ring.
+inline double signed_area2(const Ring &ring) {
+  double area = 0;
+  for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+    area += cross(ring[j], ring[i]);
+  return area;
+}
+
+// Even-odd test; points on the boundary may go either way.
+inline bool point_in_ring(const Ring &ring, const Point &p) {
+  bool inside = false;
+  for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+    const Point &a = ring[j];
+    const Point &b = ring[i];
+    if ((a.y > p.y) != (b.y > p.y) &&
+        p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y))
+      inside = !inside;
+  }
+  return inside;
+}
+
+inline bool point_in_polygon(const Polygon &polygon, const Point &p) {
+  if (!point_in_ring(polygon.outer, p))
+    return false;
+  for (const auto &hole : polygon.holes)
+    if (point_in_ring(hole, p))
+      return false;
+  return true;
+}
+
+/**
+ * Orient the outer ring counter clockwise and the holes clockwise, and drop
+ * repeated vertices.
+ *
+ * @throws std::invalid_argument if a ring has fewer than 3 vertices
+ */
+void normalize_polygon(Polygon &polygon);
+
+// Every edge of the polygon, with the free space to the left of a -> b once
+// the polygon is normalized.
+vector<Segment> polygon_edges(const Polygon &polygon);
+
+#endif /* GEOMETRY_H */
@@ -0,0 +1,183 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "deconstruct_route.h"
+#include "watchman.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+ * Polygons as text: "polygon" starts a polygon and its outer ring, "hole"
+ * starts a hole of the current polygon, and every other non empty line is
+ * an "x y" vertex of the current ring. '#' starts a comment.
+ */
+vector<Polygon> read_polygons(std::istream &in) {
+  vector<Polygon> polygons;
+  Ring *ring = nullptr;
+  string line;
+  for (size_t number = 1; std::getline(in, line); number++) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    string first;
+    if (!(words >> first))
+      continue;
+    if (first == "polygon") {
+      polygons.emplace_back();
+      ring = &polygons.back().outer;
+    } else if (first == "hole") {
+      if (polygons.empty())
+        throw std::runtime_error("hole before any polygon on line " +
+                                 std::to_string(number));
+      polygons.back().holes.emplace_back();
+      ring = &polygons.back().holes.back();
+    } else {
+      Point p;
+      std::istringstream coords(line);
+      if (ring == nullptr || !(coords >> p.x >> p.y))
+        throw std::runtime_error("bad vertex on line " +
+                                 std::to_string(number));
+      ring->push_back(p);
+    }
+  }
+  return polygons;
+}
+
+// A target of the protect game: the polygon it is in, where, and payoffs.
+struct TargetRecord {
+  size_t polygon;
+  Point position;
+  int payoffs[4]; // R_d P_d R_a P_a
+};
+
+/*
+ * Targets as text, one per line: "polygon x y R_d P_d R_a P_a". '#' starts a
+ * comment.
+ */
+vector<TargetRecord> read_targets(std::istream &in) {
+  vector<TargetRecord> targets;
+  string line;
+  for (size_t number = 1; std::getline(in, line); number++) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == string::npos)
+      continue;
+    std::istringstream fields(line);
+    TargetRecord t;
+    if (!(fields >> t.polygon >> t.position.x >> t.position.y >>
+          t.payoffs[0] >> t.payoffs[1] >> t.payoffs[2] >> t.payoffs[3]))
+      throw std::runtime_error("bad target on line " + std::to_string(number));
+    targets.push_back(t);
+  }
+  return targets;
+}
+
+/*
+ * Split every route into patrol areas over the targets of its polygon and
+ * print the game in the protect text instance format.
+ */
+void print_instance(const vector<Polygon> &polygons,
+                    const vector<WatchmanRoute> &routes,
+                    const vector<TargetRecord> &records,
+                    const RouteSplitParams &split) {
+  ProtectData data;
+  int first = 1;
+  vector<size_t> order; // Protect target n is records[order[n - 1]].
+  for (size_t n = 0; n < polygons.size(); n++) {
+    vector<Point> targets;
+    for (size_t r = 0; r < records.size(); r++)
+      if (records[r].polygon == n) {
+        targets.push_back(records[r].position);
+        order.push_back(r);
+      }
+    Polygon polygon = polygons[n];
+    normalize_polygon(polygon);
+    deconstruct_route(routes[n], polygon_edges(polygon), targets, first,
+                      split, data);
+    first += targets.size();
+  }
+
+  cout << "targets " << order.size() + 1 << endl;
+  for (size_t n = 0; n < order.size(); n++) {
+    const int *p = records[order[n]].payoffs;
+    cout << "target " << n + 1 << " " << p[0] << " " << p[1] << " " << p[2]
+         << " " << p[3] << endl;
+  }
+  for (const auto &a : data.activities)
+    cout << "activity " << a.number << " " << a.time << " "
+         << a.effectiveness << endl;
+  for (const auto &area : data.PatrolAreas) {
+    cout << "area";
+    for (const int t : area)
+      cout << " " << t;
+    cout << endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  string path;
+  string targets_path;
+  WatchmanParams params;
+  RouteSplitParams split;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--spacing") && i + 1 < argc) {
+      params.spacing = std::atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      params.threads = std::atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--start") && i + 1 < argc) {
+      params.has_start =
+          sscanf(argv[++i], "%lf,%lf", &params.start.x, &params.start.y) == 2;
+    } else if (!strcmp(argv[i], "--targets") && i + 1 < argc) {
+      targets_path = argv[++i];
+    } else if (!strcmp(argv[i], "--segment") && i + 1 < argc) {
+      split.segment_length = std::atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+      split.speed = std::atof(argv[++i]);
+    } else if (argv[i][0] != '-' && path.empty()) {
+      path = argv[i];
+    } else {
+      cerr << "usage: " << argv[0]
+           << " polygons.txt [--spacing S] [--threads N] [--start X,Y]"
+              " [--targets targets.txt [--segment L] [--speed V]]"
+           << endl;
+      return 1;
+    }
+  }
+  if (path.empty()) {
+    cerr << "no polygon file given" << endl;
+    return 1;
+  }
+
+  try {
+    std::ifstream in(path);
+    if (!in)
+      throw std::runtime_error("cannot open " + path);
+    const vector<Polygon> polygons = read_polygons(in);
+    const vector<WatchmanRoute> routes =
+        solve_watchman_routes(polygons, params);
+    if (!targets_path.empty()) {
+      std::ifstream targets_in(targets_path);
+      if (!targets_in)
+        throw std::runtime_error("cannot open " + targets_path);
+      print_instance(polygons, routes, read_targets(targets_in), split);
+      return 0;
+    }
+    for (size_t n = 0; n < routes.size(); n++) {
+      cout << "polygon " << n << ": " << routes[n].guards.size()
+           << " stops, length " << routes[n].length << endl;
+      for (const auto &p : routes[n].route)
+        cout << p.x << " " << p.y << endl;
+    }
+  } catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
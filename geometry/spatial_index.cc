@@ -0,0 +1,208 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <limits>
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+EdgeGrid::EdgeGrid(const vector<Segment> &edges, const double edges_per_cell)
+    : edges(edges), cell(1), nx(1), ny(1) {
+  if (edges.empty()) {
+    start.assign(2, 0);
+    return;
+  }
+  Point lo = edges[0].a, hi = edges[0].a;
+  for (const auto &e : edges) {
+    lo.x = std::min({lo.x, e.a.x, e.b.x});
+    lo.y = std::min({lo.y, e.a.y, e.b.y});
+    hi.x = std::max({hi.x, e.a.x, e.b.x});
+    hi.y = std::max({hi.y, e.a.y, e.b.y});
+  }
+  // A margin keeps points on the boundary away from the last cell's edge.
+  const double margin = 1e-9 * std::max(1.0, std::max(hi.x - lo.x, hi.y - lo.y));
+  lo = lo - Point(margin, margin);
+  hi = hi + Point(margin, margin);
+  const double w = hi.x - lo.x, h = hi.y - lo.y;
+  const double cells =
+      std::max(1.0, edges.size() / std::max(1e-9, edges_per_cell));
+  cell = std::sqrt(w * h / cells);
+  if (!(cell > 0))
+    cell = std::max(w, h) / cells;
+  nx = std::max<size_t>(1, static_cast<size_t>(std::ceil(w / cell)));
+  ny = std::max<size_t>(1, static_cast<size_t>(std::ceil(h / cell)));
+  origin = lo;
+
+  // Count, then fill, the edges of every cell their bounding box overlaps.
+  start.assign(nx * ny + 1, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    vector<uint32_t> fill;
+    if (pass == 1) {
+      for (size_t c = 0; c < nx * ny; c++)
+        start[c + 1] += start[c];
+      items.resize(start.back());
+      fill.assign(start.begin(), start.end() - 1);
+    }
+    for (size_t n = 0; n < edges.size(); n++) {
+      const Segment &e = edges[n];
+      const size_t x0 = column(std::min(e.a.x, e.b.x));
+      const size_t x1 = column(std::max(e.a.x, e.b.x));
+      const size_t y0 = row(std::min(e.a.y, e.b.y));
+      const size_t y1 = row(std::max(e.a.y, e.b.y));
+      for (size_t y = y0; y <= y1; y++)
+        for (size_t x = x0; x <= x1; x++) {
+          if (pass == 0)
+            start[y * nx + x + 1]++;
+          else
+            items[fill[y * nx + x]++] = static_cast<uint32_t>(n);
+        }
+    }
+  }
+}
+
+size_t EdgeGrid::column(const double x) const {
+  const double c = std::floor((x - origin.x) / cell);
+  return c <= 0 ? 0 : std::min(nx - 1, static_cast<size_t>(c));
+}
+
+size_t EdgeGrid::row(const double y) const {
+  const double r = std::floor((y - origin.y) / cell);
+  return r <= 0 ? 0 : std::min(ny - 1, static_cast<size_t>(r));
+}
+
+/*
+ * Grid traversal (Amanatides and Woo): step into whichever neighbouring cell
+ * the segment enters first, tracking the parameter t in [0, 1] at which it
+ * enters each cell.
+ */
+template <class Visit>
+bool EdgeGrid::walk(const Point &a, const Point &b, Visit visit) const {
+  if (edges.empty())
+    return false;
+  long ix = column(a.x), iy = row(a.y);
+  const long jx = column(b.x), jy = row(b.y);
+  const Point d = b - a;
+  const long sx = d.x > 0 ? 1 : -1, sy = d.y > 0 ? 1 : -1;
+  double tx = d.x != 0
+                  ? (origin.x + (ix + (d.x > 0)) * cell - a.x) / d.x
+                  : INF;
+  double ty = d.y != 0
+                  ? (origin.y + (iy + (d.y > 0)) * cell - a.y) / d.y
+                  : INF;
+  const double dtx = d.x != 0 ? cell / std::fabs(d.x) : INF;
+  const double dty = d.y != 0 ? cell / std::fabs(d.y) : INF;
+  double entry = 0;
+  for (size_t steps = 0; steps <= nx + ny; steps++) {
+    const size_t c = iy * nx + ix;
+    for (uint32_t k = start[c]; k < start[c + 1]; k++)
+      if (visit(items[k], entry))
+        return true;
+    if ((ix == jx && iy == jy) || entry > 1)
+      break;
+    if (tx < ty) {
+      ix += sx;
+      entry = tx;
+      tx += dtx;
+      if (ix < 0 || ix >= static_cast<long>(nx))
+        break;
+    } else {
+      iy += sy;
+      entry = ty;
+      ty += dty;
+      if (iy < 0 || iy >= static_cast<long>(ny))
+        break;
+    }
+  }
+  return false;
+}
+
+bool EdgeGrid::blocked(const Point &a, const Point &b) const {
+  const Segment s(a, b);
+  return walk(a, b, [this, &s](uint32_t e, double) {
+    return segments_cross(s, edges[e]);
+  });
+}
+
+bool EdgeGrid::inside(const Point &p) const {
+  if (edges.empty() || p.y < origin.y || p.y > origin.y + ny * cell)
+    return false;
+  const size_t r = row(p.y);
+  bool odd = false;
+  for (size_t c = column(p.x); c < nx; c++) {
+    const size_t cell_index = r * nx + c;
+    for (uint32_t k = start[cell_index]; k < start[cell_index + 1]; k++) {
+      const Segment &e = edges[items[k]];
+      if ((e.a.y > p.y) == (e.b.y > p.y))
+        continue;
+      const double x = e.a.x + (p.y - e.a.y) * (e.b.x - e.a.x) / (e.b.y - e.a.y);
+      // Count each crossing in the one cell that holds it.
+      if (x > p.x && column(x) == c)
+        odd = !odd;
+    }
+  }
+  return odd;
+}
+
+bool EdgeGrid::visible(const Point &a, const Point &b) const {
+  // Where ab grazes a vertex it may switch between free space and a hole
+  // without crossing an edge, so check the middle of every piece between
+  // such vertices.
+  const Segment s(a, b);
+  const Point d = b - a;
+  const double length2 = dot(d, d);
+  vector<double> cuts = {0, 1};
+  const bool crossed = walk(a, b, [&](uint32_t e, double) {
+    if (segments_cross(s, edges[e]))
+      return true;
+    for (const Point *v : {&edges[e].a, &edges[e].b}) {
+      const Point w = *v - a;
+      const double t = dot(w, d) / length2;
+      if (t > 0 && t < 1 &&
+          std::fabs(cross(d, w)) <= 1e-12 * std::sqrt(length2) * norm(w))
+        cuts.push_back(t);
+    }
+    return false;
+  });
+  if (crossed)
+    return false;
+  std::sort(cuts.begin(), cuts.end());
+  for (size_t n = 1; n < cuts.size(); n++)
+    if (cuts[n] > cuts[n - 1] &&
+        !inside(a + (0.5 * (cuts[n - 1] + cuts[n])) * d))
+      return false;
+  return true;
+}
+
+double EdgeGrid::ray_cast(const Point &p, const Point &dir) const {
+  // Run the walk up to where the ray leaves the grid.
+  double t_exit = INF;
+  if (dir.x > 0)
+    t_exit = std::min(t_exit, (origin.x + nx * cell - p.x) / dir.x);
+  else if (dir.x < 0)
+    t_exit = std::min(t_exit, (origin.x - p.x) / dir.x);
+  if (dir.y > 0)
+    t_exit = std::min(t_exit, (origin.y + ny * cell - p.y) / dir.y);
+  else if (dir.y < 0)
+    t_exit = std::min(t_exit, (origin.y - p.y) / dir.y);
+  if (!(t_exit > 0) || t_exit == INF)
+    return INF;
+  const Point end = p + t_exit * dir;
+
+  double best = INF; // In units of dir.
+  walk(p, end, [&](uint32_t n, double entry) {
+    // Hits in this cell or later are no closer than the cell's entry point.
+    if (best <= entry * t_exit)
+      return true;
+    const Segment &e = edges[n];
+    const Point s = e.b - e.a;
+    const double denom = cross(dir, s);
+    if (denom == 0)
+      return false;
+    const Point w = e.a - p;
+    const double t = cross(w, s) / denom;
+    const double u = cross(w, dir) / denom;
+    if (t > 0 && u >= 0 && u <= 1)
+      best = std::min(best, t);
+    return false;
+  });
+  return best * norm(dir);
+}
@@ -0,0 +1,68 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+/*
+ * Uniform grid over the edges of a map. Each cell lists the edges whose
+ * bounding box overlaps it, in one flat array (cell c owns
+ * items[start[c]..start[c + 1])), so a query only tests the edges of the
+ * cells it passes through instead of every edge. Queries are const and may
+ * run concurrently.
+ */
+class EdgeGrid {
+private:
+  vector<Segment> edges;
+  Point origin;
+  double cell;
+  size_t nx, ny;
+  vector<uint32_t> start;
+  vector<uint32_t> items;
+
+  size_t column(const double x) const;
+  size_t row(const double y) const;
+
+  // Call visit(edge) for the edges of every cell segment ab passes through,
+  // until it returns true. An edge may be visited more than once.
+  template <class Visit> bool walk(const Point &a, const Point &b,
+                                   Visit visit) const;
+
+public:
+  /**
+   * Index edges.
+   *
+   * @param edges map edges
+   * @param edges_per_cell average number of edges per cell to aim for
+   */
+  explicit EdgeGrid(const vector<Segment> &edges,
+                    const double edges_per_cell = 4);
+
+  const vector<Segment> &get_edges() const { return edges; }
+
+  // True if segment ab crosses the interior of an edge.
+  bool blocked(const Point &a, const Point &b) const;
+
+  /**
+   * Parity test against all edges: with the edges of a polygon with holes,
+   * whether p is in its free space.
+   */
+  bool inside(const Point &p) const;
+
+  /**
+   * Whether a and b, both in the free space, see each other: ab crosses no
+   * edge and does not leave the free space where it passes through
+   * vertices.
+   */
+  bool visible(const Point &a, const Point &b) const;
+
+  /**
+   * Distance along the ray from p in direction dir to the first edge, or
+   * infinity if it hits none.
+   */
+  double ray_cast(const Point &p, const Point &dir) const;
+};
+
+#endif /* SPATIAL_INDEX_H */
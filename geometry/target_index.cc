@@ -0,0 +1,208 @@
+#include "target_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+TargetIndex::TargetIndex(const vector<Point> &targets,
+                         const double targets_per_cell)
+    : width(1) {
+  if (targets.empty())
+    return;
+  Point lo = targets[0], hi = targets[0];
+  for (const auto &p : targets) {
+    lo = Point(std::min(lo.x, p.x), std::min(lo.y, p.y));
+    hi = Point(std::max(hi.x, p.x), std::max(hi.y, p.y));
+  }
+  const double w = hi.x - lo.x, h = hi.y - lo.y;
+  const double per_cell = std::max(1e-9, targets_per_cell);
+  width = std::sqrt(w * h * per_cell / targets.size());
+  if (!(width > 0))
+    width = std::max(w, h) * per_cell / targets.size();
+  if (!(width > 0))
+    width = 1;
+
+  // Sort the targets by slab and then by y, so every slab is one run.
+  vector<uint32_t> order(targets.size());
+  vector<int64_t> slab(targets.size());
+  for (size_t n = 0; n < targets.size(); n++) {
+    order[n] = static_cast<uint32_t>(n);
+    slab[n] = slab_of(targets[n].x);
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return slab[a] != slab[b] ? slab[a] < slab[b]
+                              : targets[a].y < targets[b].y;
+  });
+  xs.resize(targets.size());
+  ys.resize(targets.size());
+  ids.resize(targets.size());
+  for (size_t n = 0; n < order.size(); n++) {
+    const Point &p = targets[order[n]];
+    xs[n] = p.x;
+    ys[n] = p.y;
+    ids[n] = order[n];
+    const int64_t key = slab[order[n]];
+    if (n == 0 || key != slab[order[n - 1]])
+      slabs[key] = {static_cast<uint32_t>(n), 0, p.x, p.x};
+    Slab &run = slabs[key];
+    run.count++;
+    run.min_x = std::min(run.min_x, p.x);
+    run.max_x = std::max(run.max_x, p.x);
+  }
+}
+
+int64_t TargetIndex::slab_of(const double x) const {
+  return static_cast<int64_t>(std::floor(x / width));
+}
+
+/*
+ * Flip the parity of the targets left of edge (a, b) among those with y in
+ * [begin, end), which are exactly the ones whose rightward ray can cross the
+ * edge. x = ax + (y - ay) * slope is where the edge is at height y.
+ */
+static void flip_left_of_edge(const double *xs, const double *ys,
+                              uint64_t *parity, const size_t begin,
+                              const size_t end, const double ax,
+                              const double ay, const double slope) {
+  size_t i = begin;
+  // GCC does not vectorize the double compare into a 64 bit mask for plain
+  // SSE2, so spell the lanes out; the compare mask is the parity flip.
+#if defined(__AVX__)
+  {
+    const __m256d vax = _mm256_set1_pd(ax), vay = _mm256_set1_pd(ay);
+    const __m256d vslope = _mm256_set1_pd(slope);
+    const __m256d one = _mm256_castsi256_pd(_mm256_set1_epi64x(1));
+    for (; i + 4 <= end; i += 4) {
+      const __m256d edge = _mm256_add_pd(
+          vax, _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(ys + i), vay),
+                             vslope));
+      const __m256d flip = _mm256_and_pd(
+          _mm256_cmp_pd(_mm256_loadu_pd(xs + i), edge, _CMP_LT_OQ), one);
+      double *p = reinterpret_cast<double *>(parity + i);
+      _mm256_storeu_pd(p, _mm256_xor_pd(_mm256_loadu_pd(p), flip));
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128d vax = _mm_set1_pd(ax), vay = _mm_set1_pd(ay);
+    const __m128d vslope = _mm_set1_pd(slope);
+    const __m128i one = _mm_set1_epi64x(1);
+    for (; i + 2 <= end; i += 2) {
+      const __m128d edge = _mm_add_pd(
+          vax, _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(ys + i), vay), vslope));
+      const __m128i flip = _mm_and_si128(
+          _mm_castpd_si128(_mm_cmplt_pd(_mm_loadu_pd(xs + i), edge)), one);
+      __m128i *p = reinterpret_cast<__m128i *>(parity + i);
+      _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), flip));
+    }
+  }
+#endif
+  for (; i < end; i++)
+    parity[i] ^= static_cast<uint64_t>(xs[i] < ax + (ys[i] - ay) * slope);
+}
+
+vector<uint32_t> TargetIndex::query(const vector<Ring> &regions) const {
+  vector<const Ring *> pointers;
+  for (const auto &ring : regions)
+    pointers.push_back(&ring);
+  return query(pointers);
+}
+
+void TargetIndex::query(const Ring &region, vector<uint32_t> &out) const {
+  const vector<uint32_t> inside = query(vector<const Ring *>{&region});
+  out.insert(out.end(), inside.begin(), inside.end());
+}
+
+vector<uint32_t>
+TargetIndex::query(const vector<const Ring *> &regions) const {
+  vector<const Ring *> rings;
+  Point lo, hi;
+  for (const Ring *ring : regions) {
+    if (ring->size() < 3)
+      continue;
+    if (rings.empty())
+      lo = hi = (*ring)[0];
+    rings.push_back(ring);
+    for (const auto &v : *ring) {
+      lo = Point(std::min(lo.x, v.x), std::min(lo.y, v.y));
+      hi = Point(std::max(hi.x, v.x), std::max(hi.y, v.y));
+    }
+  }
+  vector<uint32_t> result;
+  if (rings.empty() || xs.empty())
+    return result;
+
+  // The slabs under the bounding box; when it spans more slabs than are
+  // occupied, scan the occupied ones instead.
+  const int64_t s0 = slab_of(lo.x), s1 = slab_of(hi.x);
+  vector<const Slab *> under;
+  if (static_cast<double>(s1 - s0 + 1) < slabs.size()) {
+    for (int64_t k = s0; k <= s1; k++) {
+      const auto it = slabs.find(k);
+      if (it != slabs.end())
+        under.push_back(&it->second);
+    }
+  } else {
+    for (const auto &entry : slabs)
+      if (entry.first >= s0 && entry.first <= s1)
+        under.push_back(&entry.second);
+  }
+
+  vector<uint64_t> hit, parity, flip_all;
+  for (const Slab *slab : under) {
+    const double *const y_begin = ys.data() + slab->start;
+    const double *const y_end = y_begin + slab->count;
+    const size_t first = std::lower_bound(y_begin, y_end, lo.y) - ys.data();
+    const size_t last = std::upper_bound(y_begin, y_end, hi.y) - ys.data();
+    if (first >= last)
+      continue;
+    const size_t m = last - first;
+    hit.assign(m, 0);
+    parity.resize(m);
+    flip_all.resize(m + 1);
+    for (const Ring *region : rings) {
+      const Ring &ring = *region;
+      std::fill(parity.begin(), parity.end(), 0);
+      std::fill(flip_all.begin(), flip_all.end(), 0);
+      for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+        const Point &a = ring[j];
+        const Point &b = ring[i];
+        if (a.y == b.y || std::max(a.x, b.x) < slab->min_x)
+          continue;
+        // (a.y > y) != (b.y > y) holds exactly for y in [min, max).
+        const size_t begin =
+            std::lower_bound(ys.data() + first, ys.data() + last,
+                             std::min(a.y, b.y)) - ys.data();
+        const size_t end =
+            std::lower_bound(ys.data() + begin, ys.data() + last,
+                             std::max(a.y, b.y)) - ys.data();
+        if (begin == end)
+          continue;
+        if (std::min(a.x, b.x) > slab->max_x) {
+          flip_all[begin - first] ^= 1;
+          flip_all[end - first] ^= 1;
+        } else {
+          flip_left_of_edge(xs.data() + first, ys.data() + first,
+                            parity.data(), begin - first, end - first, a.x,
+                            a.y, (b.x - a.x) / (b.y - a.y));
+        }
+      }
+      uint64_t running = 0;
+      for (size_t k = 0; k < m; k++) {
+        running ^= flip_all[k];
+        hit[k] |= parity[k] ^ running;
+      }
+    }
+    for (size_t k = 0; k < m; k++)
+      if (hit[k])
+        result.push_back(ids[first + k]);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
@@ -0,0 +1,76 @@
+#ifndef TARGET_INDEX_H
+#define TARGET_INDEX_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "geometry.h"
+
+/*
+ * Batched point in polygon queries over a large, fixed set of target points.
+ *
+ * Targets are split into vertical slabs of equal width, kept as separate x
+ * and y arrays sorted by slab and then by y; a spatial hash maps each
+ * occupied slab to its run, so memory does not depend on how spread out the
+ * map is. A query runs the crossing number test (a ray to the right) per
+ * slab under the regions' bounding box: the targets an edge can flip are a
+ * y range of the slab found by binary search, an edge left of the slab
+ * flips none of them, one right of the slab flips all of them (marked in a
+ * difference array), and only edges across the slab compare coordinates,
+ * in a branch free loop two targets per SSE2 instruction (four with AVX).
+ */
+class TargetIndex {
+private:
+  vector<double> xs; // By slab, then by y.
+  vector<double> ys;
+  vector<uint32_t> ids; // Caller's index of each target.
+  double width;         // Of a slab.
+
+  struct Slab {
+    uint32_t start; // First target of the slab's run.
+    uint32_t count;
+    double min_x;   // Extent of the slab's targets.
+    double max_x;
+  };
+  std::unordered_map<int64_t, Slab> slabs;
+
+  int64_t slab_of(const double x) const;
+
+  vector<uint32_t> query(const vector<const Ring *> &regions) const;
+
+public:
+  /**
+   * Index targets.
+   *
+   * @param targets target positions; queries return indices into this
+   * @param targets_per_cell targets per slab width squared, on average, to
+   * aim for
+   */
+  explicit TargetIndex(const vector<Point> &targets,
+                       const double targets_per_cell = 16);
+
+  size_t size() const { return xs.size(); }
+
+  /**
+   * Append the indices of the targets inside region to out, in no
+   * particular order.
+   *
+   * @param region a simple polygon, such as a visibility polygon
+   * @param out receives target indices
+   */
+  void query(const Ring &region, vector<uint32_t> &out) const;
+
+  /**
+   * Indices of the targets inside any of the regions, such as the
+   * visibility polygons along a route segment, found in one pass over the
+   * slabs under all of them.
+   *
+   * @param regions simple polygons
+   *
+   * @return target indices, sorted
+   */
+  vector<uint32_t> query(const vector<Ring> &regions) const;
+};
+
+#endif /* TARGET_INDEX_H */
@@ -0,0 +1,477 @@
+#include "watchman.h"
+
+#include "target_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+static const double INF = std::numeric_limits<double>::infinity();
+static const double PI = std::acos(-1.0);
+
+namespace {
+
+// An edge oriented counter clockwise around the view point.
+struct SweepEdge {
+  Point a;
+  Point b;
+};
+
+// Parameter along the ray p + t * dir where it meets the line of e.
+double ray_distance(const Point &p, const Point &dir, const SweepEdge &e) {
+  const Point s = e.b - e.a;
+  const double denom = cross(dir, s);
+  if (denom == 0)
+    return std::min(dist(p, e.a), dist(p, e.b)) / norm(dir);
+  return cross(e.a - p, s) / denom;
+}
+
+/*
+ * Orders the edges crossing the current ray by distance from p. Edges do
+ * not cross, so the order of two active edges never changes while the ray
+ * turns; two edges meeting the ray at a shared vertex are ordered by which
+ * one lies on p's side of the other.
+ */
+struct Closer {
+  const vector<SweepEdge> *edges;
+  const Point *p;
+  const Point *dir;
+
+  bool operator()(const size_t i, const size_t j) const {
+    if (i == j)
+      return false;
+    const SweepEdge &e = (*edges)[i];
+    const SweepEdge &f = (*edges)[j];
+    const double di = ray_distance(*p, *dir, e);
+    const double dj = ray_distance(*p, *dir, f);
+    if (std::fabs(di - dj) > 1e-9 * std::max(1.0, std::max(di, dj)))
+      return di < dj;
+    Point v, oi, oj;
+    if (e.a == f.a || e.a == f.b) {
+      v = e.a;
+      oi = e.b;
+      oj = e.a == f.a ? f.b : f.a;
+    } else if (e.b == f.a || e.b == f.b) {
+      v = e.b;
+      oi = e.a;
+      oj = e.b == f.a ? f.b : f.a;
+    } else {
+      return i < j;
+    }
+    const double side_p = orient(v, oj, *p);
+    const double side_o = orient(v, oj, oi);
+    if (side_p == 0 || side_o == 0)
+      return i < j;
+    return (side_p > 0) == (side_o > 0);
+  }
+};
+
+struct SweepEvent {
+  double angle;
+  double distance;
+  size_t edge;
+  bool start;
+};
+
+double angle_of(const Point &d) {
+  const double a = std::atan2(d.y, d.x);
+  // atan2 gives -pi for y = -0; the sweep runs over (-pi, pi].
+  return a <= -PI ? PI : a;
+}
+
+} // namespace
+
+Ring visibility_polygon(const vector<Segment> &edges, const Point &p) {
+  vector<SweepEdge> oriented;
+  oriented.reserve(edges.size());
+  for (const auto &e : edges) {
+    const double c = orient(p, e.a, e.b);
+    if (c > 0)
+      oriented.push_back({e.a, e.b});
+    else if (c < 0)
+      oriented.push_back({e.b, e.a});
+    // Edges seen end on hide nothing their neighbours do not.
+  }
+
+  vector<SweepEvent> events;
+  events.reserve(2 * oriented.size());
+  for (size_t n = 0; n < oriented.size(); n++) {
+    const SweepEdge &e = oriented[n];
+    events.push_back({angle_of(e.a - p), dist(p, e.a), n, true});
+    events.push_back({angle_of(e.b - p), dist(p, e.b), n, false});
+  }
+  std::sort(events.begin(), events.end(),
+            [](const SweepEvent &x, const SweepEvent &y) {
+              return x.angle != y.angle ? x.angle < y.angle
+                                        : x.distance < y.distance;
+            });
+
+  Point dir(-1, 0);
+  std::set<size_t, Closer> active(Closer{&oriented, &p, &dir});
+  vector<std::set<size_t, Closer>::iterator> where(oriented.size());
+  vector<bool> in_set(oriented.size(), false);
+  // Edges that wrap past angle pi cross the initial ray.
+  for (size_t n = 0; n < oriented.size(); n++) {
+    if (angle_of(oriented[n].a - p) > angle_of(oriented[n].b - p)) {
+      where[n] = active.insert(n).first;
+      in_set[n] = true;
+    }
+  }
+
+  Ring visible;
+  auto emit = [&visible](const Point &q) {
+    if (visible.empty() ||
+        dist(visible.back(), q) > 1e-12 * std::max(1.0, norm(q)))
+      visible.push_back(q);
+  };
+  auto hit = [&](const size_t n) {
+    return p + ray_distance(p, dir, oriented[n]) * dir;
+  };
+  if (!active.empty())
+    emit(hit(*active.begin()));
+
+  const size_t none = oriented.size();
+  for (size_t g = 0; g < events.size();) {
+    // Events on one ray: same direction from p, nearest first.
+    const SweepEdge &fe = oriented[events[g].edge];
+    const Point first = events[g].start ? fe.a : fe.b;
+    size_t h = g + 1;
+    const Point u = first - p;
+    while (h < events.size()) {
+      const SweepEdge &e = oriented[events[h].edge];
+      const Point w = (events[h].start ? e.a : e.b) - p;
+      if (std::fabs(cross(u, w)) > 1e-12 * norm(u) * norm(w) || dot(u, w) <= 0)
+        break;
+      h++;
+    }
+    const size_t before = active.empty() ? none : *active.begin();
+    dir = u;
+    for (size_t k = g; k < h; k++) {
+      const size_t n = events[k].edge;
+      if (!events[k].start && in_set[n]) {
+        active.erase(where[n]);
+        in_set[n] = false;
+      }
+    }
+    for (size_t k = g; k < h; k++) {
+      const size_t n = events[k].edge;
+      if (events[k].start && !in_set[n]) {
+        where[n] = active.insert(n).first;
+        in_set[n] = true;
+      }
+    }
+    const size_t after = active.empty() ? none : *active.begin();
+    if (before != after) {
+      if (before != none)
+        emit(hit(before));
+      if (after != none)
+        emit(hit(after));
+    }
+    g = h;
+  }
+  while (visible.size() > 1 &&
+         dist(visible.front(), visible.back()) <=
+             1e-12 * std::max(1.0, norm(visible.front())))
+    visible.pop_back();
+  return visible;
+}
+
+static Polygon normalized(Polygon polygon) {
+  normalize_polygon(polygon);
+  return polygon;
+}
+
+// Left normal of d, of unit length.
+static Point left_normal(const Point &d) {
+  const double n = norm(d);
+  return Point(-d.y / n, d.x / n);
+}
+
+WatchmanSolver::WatchmanSolver(const Polygon &polygon,
+                               const WatchmanParams &params)
+    : polygon(normalized(polygon)), params(params),
+      edges(polygon_edges(this->polygon)), grid(edges) {
+  Point lo = this->polygon.outer[0], hi = lo;
+  for (const auto &v : this->polygon.outer) {
+    lo = Point(std::min(lo.x, v.x), std::min(lo.y, v.y));
+    hi = Point(std::max(hi.x, v.x), std::max(hi.y, v.y));
+  }
+  const double size = std::max(hi.x - lo.x, hi.y - lo.y);
+  if (this->params.spacing <= 0)
+    this->params.spacing = size / 40;
+  if (this->params.nudge <= 0)
+    this->params.nudge = 1e-6 * size;
+  if (this->params.has_start && !grid.inside(this->params.start))
+    throw std::invalid_argument("route start is outside the free space");
+
+  // With the free space to the left of every edge, reflex vertices are the
+  // right turns; step off them along the bisector of the edge normals.
+  auto add_ring = [this](const Ring &ring) {
+    for (size_t i = 0; i < ring.size(); i++) {
+      const Point &prev = ring[(i + ring.size() - 1) % ring.size()];
+      const Point &v = ring[i];
+      const Point &next = ring[(i + 1) % ring.size()];
+      if (orient(prev, v, next) >= 0)
+        continue;
+      const Point bisector = left_normal(v - prev) + left_normal(next - v);
+      if (norm(bisector) < 1e-12)
+        continue;
+      const Point q = v + (this->params.nudge / norm(bisector)) * bisector;
+      if (grid.inside(q))
+        reflex.push_back(q);
+    }
+  };
+  add_ring(this->polygon.outer);
+  for (const auto &hole : this->polygon.holes)
+    add_ring(hole);
+
+  reflex_graph.resize(reflex.size());
+  for (size_t i = 0; i < reflex.size(); i++)
+    for (size_t j = i + 1; j < reflex.size(); j++)
+      if (grid.visible(reflex[i], reflex[j])) {
+        reflex_graph[i].push_back(j);
+        reflex_graph[j].push_back(i);
+      }
+}
+
+vector<Point> WatchmanSolver::samples() const {
+  vector<Point> points;
+  const double s = params.spacing;
+  Point lo = polygon.outer[0], hi = lo;
+  for (const auto &v : polygon.outer) {
+    lo = Point(std::min(lo.x, v.x), std::min(lo.y, v.y));
+    hi = Point(std::max(hi.x, v.x), std::max(hi.y, v.y));
+  }
+  for (double y = lo.y + s / 2; y < hi.y; y += s)
+    for (double x = lo.x + s / 2; x < hi.x; x += s)
+      if (grid.inside(Point(x, y)))
+        points.emplace_back(x, y);
+  // A point just off the middle of every edge, so every wall gets seen.
+  for (const auto &e : edges) {
+    const Point d = e.b - e.a;
+    const double offset = 1e-3 * std::min(norm(d), s);
+    const Point q = 0.5 * (e.a + e.b) + offset * left_normal(d);
+    if (grid.inside(q))
+      points.push_back(q);
+  }
+  return points;
+}
+
+/*
+ * Greedy set cover of the samples by visibility polygons: take the stop that
+ * sees the most unseen samples (lazily re-counted) until all are seen. A
+ * sample no reflex vertex sees becomes a stop itself.
+ */
+vector<Point> WatchmanSolver::cover(const vector<Point> &samples) const {
+  const TargetIndex index(samples);
+  auto seen_from = [&](const Point &c) {
+    vector<uint32_t> seen;
+    index.query(visibility_polygon(edges, c), seen);
+    return seen;
+  };
+
+  vector<bool> covered(samples.size(), false);
+  size_t left = samples.size();
+  vector<Point> stops;
+  auto take = [&](const Point &stop, const vector<uint32_t> &seen) {
+    stops.push_back(stop);
+    for (const uint32_t n : seen)
+      if (!covered[n]) {
+        covered[n] = true;
+        left--;
+      }
+  };
+  if (params.has_start)
+    take(params.start, seen_from(params.start));
+
+  vector<vector<uint32_t>> seen(reflex.size());
+  std::priority_queue<std::pair<size_t, size_t>> queue; // (gain, candidate)
+  for (size_t c = 0; c < reflex.size(); c++) {
+    seen[c] = seen_from(reflex[c]);
+    queue.emplace(seen[c].size(), c);
+  }
+  while (left > 0 && !queue.empty()) {
+    const auto top = queue.top();
+    queue.pop();
+    size_t gain = 0;
+    for (const uint32_t n : seen[top.second])
+      gain += !covered[n];
+    if (gain == 0)
+      continue;
+    if (gain < top.first) {
+      queue.emplace(gain, top.second);
+      continue;
+    }
+    take(reflex[top.second], seen[top.second]);
+  }
+  for (size_t n = 0; n < samples.size() && left > 0; n++) {
+    if (covered[n])
+      continue;
+    vector<uint32_t> by_sample = seen_from(samples[n]);
+    by_sample.push_back(n);
+    take(samples[n], by_sample);
+  }
+  return stops;
+}
+
+vector<size_t> WatchmanSolver::visible_reflex(const Point &p) const {
+  vector<size_t> visible;
+  for (size_t r = 0; r < reflex.size(); r++)
+    if (grid.visible(p, reflex[r]))
+      visible.push_back(r);
+  return visible;
+}
+
+void WatchmanSolver::shortest_paths(
+    const vector<Point> &stops, vector<vector<double>> &length,
+    vector<vector<vector<Point>>> &paths) const {
+  const size_t G = stops.size();
+  const size_t R = reflex.size();
+  vector<vector<size_t>> sees(G);
+  for (size_t g = 0; g < G; g++)
+    sees[g] = visible_reflex(stops[g]);
+
+  length.assign(G, vector<double>(G, 0));
+  paths.assign(G, vector<vector<Point>>(G));
+  for (size_t s = 0; s < G; s++) {
+    // Dijkstra over the reflex vertices, from stop s.
+    vector<double> d(R, INF);
+    vector<size_t> prev(R, R);
+    typedef std::pair<double, size_t> Entry;
+    std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> queue;
+    for (const size_t r : sees[s]) {
+      d[r] = dist(stops[s], reflex[r]);
+      queue.emplace(d[r], r);
+    }
+    while (!queue.empty()) {
+      const Entry top = queue.top();
+      queue.pop();
+      if (top.first > d[top.second])
+        continue;
+      for (const size_t r : reflex_graph[top.second]) {
+        const double nd = top.first + dist(reflex[top.second], reflex[r]);
+        if (nd < d[r]) {
+          d[r] = nd;
+          prev[r] = top.second;
+          queue.emplace(nd, r);
+        }
+      }
+    }
+
+    for (size_t t = 0; t < G; t++) {
+      if (t == s) {
+        paths[s][t] = {stops[s]};
+        continue;
+      }
+      double best = grid.visible(stops[s], stops[t])
+                        ? dist(stops[s], stops[t])
+                        : INF;
+      size_t via = R;
+      for (const size_t r : sees[t]) {
+        const double nd = d[r] + dist(reflex[r], stops[t]);
+        if (nd < best) {
+          best = nd;
+          via = r;
+        }
+      }
+      length[s][t] = best;
+      vector<Point> path = {stops[t]};
+      for (size_t r = via; r != R; r = prev[r])
+        path.push_back(reflex[r]);
+      path.push_back(stops[s]);
+      std::reverse(path.begin(), path.end());
+      paths[s][t] = std::move(path);
+    }
+  }
+}
+
+WatchmanRoute WatchmanSolver::solve() const {
+  WatchmanRoute result;
+  result.length = 0;
+  result.guards = cover(samples());
+  const size_t G = result.guards.size();
+  if (G <= 1) {
+    result.route = result.guards;
+    return result;
+  }
+
+  vector<vector<double>> length;
+  vector<vector<vector<Point>>> paths;
+  shortest_paths(result.guards, length, paths);
+
+  // Nearest neighbour tour from the first stop (the start, if any).
+  vector<size_t> tour = {0};
+  vector<bool> used(G, false);
+  used[0] = true;
+  for (size_t step = 1; step < G; step++) {
+    size_t next = G;
+    for (size_t g = 0; g < G; g++)
+      if (!used[g] && (next == G || length[tour.back()][g] <
+                                        length[tour.back()][next]))
+        next = g;
+    used[next] = true;
+    tour.push_back(next);
+  }
+
+  // 2-opt, keeping the first stop in place.
+  auto cost = [&](size_t i, size_t j) { return length[tour[i]][tour[j % G]]; };
+  for (bool improved = true; improved;) {
+    improved = false;
+    for (size_t i = 0; i + 2 < G; i++)
+      for (size_t j = i + 2; j < G; j++) {
+        const double delta =
+            cost(i, i + 1) + cost(j, j + 1) - cost(i, j) - cost(i + 1, j + 1);
+        if (delta > 1e-9) {
+          std::reverse(tour.begin() + i + 1, tour.begin() + j + 1);
+          improved = true;
+        }
+      }
+  }
+
+  for (size_t k = 0; k < G; k++) {
+    const auto &path = paths[tour[k]][tour[(k + 1) % G]];
+    // Each path ends where the next one starts.
+    result.route.insert(result.route.end(), path.begin(), path.end() - 1);
+    result.length += length[tour[k]][tour[(k + 1) % G]];
+  }
+  vector<Point> guards;
+  for (const size_t g : tour)
+    guards.push_back(result.guards[g]);
+  result.guards = std::move(guards);
+  return result;
+}
+
+vector<WatchmanRoute> solve_watchman_routes(const vector<Polygon> &polygons,
+                                            const WatchmanParams &params) {
+  vector<WatchmanRoute> routes(polygons.size());
+  vector<std::exception_ptr> errors(polygons.size());
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (size_t n; (n = next++) < polygons.size();) {
+      try {
+        routes[n] = WatchmanSolver(polygons[n], params).solve();
+      } catch (...) {
+        errors[n] = std::current_exception();
+      }
+    }
+  };
+  size_t threads = params.threads != 0 ? params.threads
+                                       : std::thread::hardware_concurrency();
+  threads = std::max<size_t>(1, std::min(threads, polygons.size()));
+  vector<std::thread> workers;
+  for (size_t t = 1; t < threads; t++)
+    workers.emplace_back(work);
+  work();
+  for (auto &worker : workers)
+    worker.join();
+  for (const auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+  return routes;
+}
@@ -1 +1,93 @@
-#include <unordered_map>
+#ifndef WATCHMAN_H
+#define WATCHMAN_H
+
+#include <vector>
+
+#include "geometry.h"
+#include "spatial_index.h"
+
+/**
+ * Region visible from p, by a rotational sweep over the edges in
+ * O(n log n): edge endpoints are visited in angular order around p while a
+ * balanced tree keeps the edges crossing the current ray ordered by
+ * distance, and the visible boundary jumps whenever the nearest edge
+ * changes.
+ *
+ * @param edges edges of a polygon with holes that do not cross each other
+ * @param p point in the free space
+ *
+ * @return the visibility polygon, counter clockwise
+ */
+Ring visibility_polygon(const vector<Segment> &edges, const Point &p);
+
+struct WatchmanParams {
+  double spacing;    // Distance between sample points that must be seen, 0
+                     // for 1/40 of the larger side of the bounding box.
+  double nudge;      // Offset of route vertices from the walls, 0 for 1e-6
+                     // of the bounding box.
+  bool has_start;    // Start (and end) the route at start.
+  Point start;
+  size_t threads;    // Polygons solved at once, 0 for the hardware
+                     // concurrency.
+  WatchmanParams()
+      : spacing(0), nudge(0), has_start(false), threads(0) {}
+};
+
+struct WatchmanRoute {
+  vector<Point> guards; // Stops that together see every sample point.
+  vector<Point> route;  // Closed walk through the guards, along shortest
+                        // paths; the last point connects to the first.
+  double length;
+};
+
+/*
+ * Approximate shortest watchman route of one polygon with holes. The
+ * problem is NP-hard with holes, so the route is built in three steps:
+ * stops are picked greedily among points just off the reflex vertices until
+ * their visibility polygons see every sample point (a grid over the free
+ * space plus a point by every edge); the stops are ordered by nearest
+ * neighbour and 2-opt on their shortest path distances; and consecutive
+ * stops are joined by shortest paths through the visibility graph of the
+ * reflex vertices. The polygon is normalized in place.
+ */
+class WatchmanSolver {
+private:
+  Polygon polygon;
+  WatchmanParams params;
+  vector<Segment> edges;
+  EdgeGrid grid;
+  vector<Point> reflex; // Reflex vertices, nudged into the free space.
+  vector<vector<size_t>> reflex_graph; // Visible pairs among reflex.
+
+  vector<Point> samples() const;
+  vector<Point> cover(const vector<Point> &samples) const;
+
+  // Indices of the reflex vertices p sees.
+  vector<size_t> visible_reflex(const Point &p) const;
+
+  // Shortest paths between every pair of stops through the reflex vertices;
+  // paths[i][j] starts at stop i and ends at stop j.
+  void shortest_paths(const vector<Point> &stops,
+                      vector<vector<double>> &length,
+                      vector<vector<vector<Point>>> &paths) const;
+
+public:
+  WatchmanSolver(const Polygon &polygon, const WatchmanParams &params);
+
+  const Polygon &get_polygon() const { return polygon; }
+  const vector<Segment> &get_edges() const { return edges; }
+  const EdgeGrid &get_grid() const { return grid; }
+
+  WatchmanRoute solve() const;
+};
+
+/**
+ * Watchman routes of independent polygons (floors or districts), solved on
+ * params.threads threads.
+ *
+ * @throws the first exception any polygon threw, after all are done
+ */
+vector<WatchmanRoute> solve_watchman_routes(const vector<Polygon> &polygons,
+                                            const WatchmanParams &params);
+
+#endif /* WATCHMAN_H */
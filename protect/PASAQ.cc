@@ -1,12 +1,16 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <glpk.h>
 #include <iostream>
+#include <numeric>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 
 #include "PASAQ.h"
 #include "lin_prog.h"
+#include "stats.h"
 
 using std::cout;
 using std::endl;
@@ -84,18 +88,17 @@ double f2(int i, double x, const PayoffMatrix &Pm, const double lambda) {
 
 /* 
  * Estimate the upper and lower bound of utility the defender can achieve. The
- * lower bound is set to the expected utiltiy of a uniform strategy. The upper
- * bound is set to the sum of all rewards.
+ * defender's expected utility is a convex combination of U_d over the targets,
+ * so it can be no lower than the smallest penalty and no higher than the
+ * largest reward.
  */
 pair<double, double> EstimateBounds(int numRes, const PayoffMatrix &Pm,
                                     const double lambda) {
-  const int T = Pm.P_a.size();
   pair<double, double> result = {0, 0};
-  strategy uniform_strategy(
-      T, std::max(numRes * (1.0 / static_cast<double>(T)), 1.0));
-  result.first = UD(uniform_strategy, Pm, lambda);
-  for (const auto &reward : Pm.R_d) 
-    result.second += reward;
+  if (Pm.P_d.empty())
+    return result;
+  result.first = *std::min_element(Pm.P_d.begin(), Pm.P_d.end());
+  result.second = *std::max_element(Pm.R_d.begin(), Pm.R_d.end());
   return result;
 }
 
@@ -151,141 +154,1015 @@ void set_pasaq_constraint_18(lin_prog &LP, const size_t T, const size_t K,
 
 size_t set_pasaq_constraints(const size_t T, const size_t K);
 
+// z_{i,k+1} <= z_ik, implied by (13) and (14) for integer z but not for the
+// relaxation.
+void set_pasaq_fill_order(lin_prog &LP, const size_t T, const size_t K);
+
 /*
  * Set objective function for a PASAQ problem with constraints within a binary
- * search method
+ * search method. This is the piecewise linear CF-OPT objective, minimized; r is
+ * feasible when the minimum is at most 0.
  *
  * Arguments:
  * lp - problem object
- * r - 
+ * r - defender utility being checked
+ * tables - objective constants for the lambda and K of the problem
  */
 void set_pasaq_obj(lin_prog &lp, const double r, const PayoffMatrix &Pm,
-                   const double lambda, const int K);
+                   const PasaqTables &tables);
 
 
 void print_lp_result(int result);
 
+void build_pasaq_lp(lin_prog &LP, const double r, const int num_res,
+                    const PayoffMatrix &Pm, const vector<vector<double>> &A,
+                    const double lambda, const int K) {
+  ScopedTimer timer("model_build");
+  // Targets are 1..N, slot 0 of the payoff vectors is unused.
+  const size_t N = Pm.P_a.size() - 1;
+  const size_t S = A.empty() ? 0 : A[0].size();
+  LP.declare_variables("x", N * K);
+  LP.declare_variables("z", N * K);
+  LP.declare_variables("a", S);
+
+  set_pasaq_obj(LP, r, Pm, build_pasaq_tables(Pm, lambda, K));
+  set_pasaq_constraint_11(LP, N, K, num_res);
+  set_pasaq_constraint_12(LP, N, K);
+  set_pasaq_constraint_13(LP, N, K);
+  set_pasaq_constraint_14(LP, N, K);
+  set_pasaq_constraint_15(LP, N, K);
+  set_pasaq_fill_order(LP, N, K);
+  set_pasaq_constraint_16(LP, N, K, A);
+  set_pasaq_constraint_17(LP, N, K, A);
+  set_pasaq_constraint_18(LP, N, K, A);
+}
+
 /*
- * Generate CF-OPT and solve it using GPLK, to check that a strategy is feasible
- * and return such a strategy. We do this by creating a linear program defined
- * by PASAQ with assignment constraints.
- *
- * A = Probability matrix.
+ * build_pasaq_lp over stacked team blocks. Constraint (16) gathers the
+ * columns of every team; each team gets its own (17) and, when there is more
+ * than one, its own share of (11). The shares come before (16), so (16) and
+ * the (17) rows stay the last rows.
  */
-pair<bool, vector<double>> CheckFeasibility(const double r, const int num_res,
-                                            const PayoffMatrix &Pm,
-                                            const vector<vector<double>> &A,
-                                            const double K, double lambda) {
+static void build_team_lp(lin_prog &LP, const PayoffMatrix &Pm,
+                          const vector<TeamBlock> &teams, const int num_res,
+                          const double lambda, const int K) {
+  ScopedTimer timer("model_build");
+  const size_t N = Pm.P_a.size() - 1;
+  // Row i of (16), as (a column, A_ij) pairs. Slot 0 is unused, as in
+  // build_pasaq_lp.
+  vector<vector<pair<size_t, double>>> rows(N + 1);
+  size_t S = 0;
+  for (const auto &team : teams) {
+    for (const auto &column : team.columns) {
+      S++;
+      for (const auto &entry : column) {
+        if (entry.first > N)
+          throw std::invalid_argument("no target " +
+                                      std::to_string(entry.first));
+        if (entry.first != 0 && entry.second != 0)
+          rows[entry.first].emplace_back(S, entry.second);
+      }
+    }
+  }
+  LP.declare_variables("x", N * K);
+  LP.declare_variables("z", N * K);
+  LP.declare_variables("a", S);
+
+  set_pasaq_obj(LP, 0, Pm, build_pasaq_tables(Pm, lambda, K));
+  set_pasaq_constraint_11(LP, N, K, num_res);
+  set_pasaq_constraint_12(LP, N, K);
+  set_pasaq_constraint_13(LP, N, K);
+  set_pasaq_constraint_14(LP, N, K);
+  set_pasaq_constraint_15(LP, N, K);
+  set_pasaq_fill_order(LP, N, K);
+  size_t j = 0;
+  if (teams.size() > 1) {
+    for (size_t t = 0; t < teams.size(); t++) {
+      LP.add_row("11-" + std::to_string(t));
+      LP.set_row_bnd(GLP_UP, 0, teams[t].resources);
+      for (const auto &column : teams[t].columns) {
+        double sum = 0;
+        for (const auto &entry : column)
+          if (entry.first != 0)
+            sum += entry.second;
+        j++;
+        if (sum != 0)
+          LP.add_constraint("a", j, sum);
+      }
+    }
+  }
+  for (size_t i = 1; i <= N; i++) {
+    LP.add_row("16-" + std::to_string(i));
+    LP.set_row_bnd(GLP_FX, 0, 0);
+    for (int k = 1; k <= K; k++)
+      LP.add_constraint("x", (i - 1) * K + k, 1);
+    for (const auto &entry : rows[i])
+      LP.add_constraint("a", entry.first, -entry.second);
+  }
+  j = 0;
+  for (size_t t = 0; t < teams.size(); t++) {
+    LP.add_row("17-" + std::to_string(t));
+    LP.set_row_bnd(GLP_UP, 0, 1);
+    for (size_t n = 0; n < teams[t].columns.size(); n++)
+      LP.add_constraint("a", ++j, 1);
+  }
+  for (j = 1; j <= S; j++)
+    LP.set_var_bnd("a", j, GLP_DB, 0, 1);
+}
+
+PasaqModel::PasaqModel(const PayoffMatrix &Pm,
+                       const vector<vector<double>> &A,
+                       const SolverParams &params)
+    : LP("CF-OPT"), Pm(Pm), params(params),
+      tables(build_pasaq_tables(Pm, params.lambda, params.K)),
+      S(A.empty() ? 0 : A[0].size()), warm(false), control(nullptr),
+      team_first(1, 0), team_resources(1, params.num_res), budget_row(0) {
+  build_pasaq_lp(LP, 0, params.num_res, Pm, A, params.lambda, params.K);
+  LP.set_presolve(!uses_pasaq_callbacks(params));
+  // Constraint (17) is the last row, after one row (16) per target.
+  row16 = LP.num_rows() - (Pm.P_a.size() - 1);
+}
+
+PasaqModel::PasaqModel(const PayoffMatrix &Pm, const vector<TeamBlock> &teams,
+                       const SolverParams &params)
+    : LP("CF-OPT"), Pm(Pm), params(params),
+      tables(build_pasaq_tables(Pm, params.lambda, params.K)), S(0),
+      warm(false), control(nullptr), budget_row(0) {
+  if (teams.empty())
+    throw std::invalid_argument("no resource teams");
+  this->params.num_res = 0;
+  for (const auto &team : teams) {
+    team_first.push_back(S);
+    team_resources.push_back(team.resources);
+    S += team.columns.size();
+    this->params.num_res += team.resources;
+  }
+  build_team_lp(LP, Pm, teams, this->params.num_res, params.lambda,
+                params.K);
+  LP.set_presolve(!uses_pasaq_callbacks(params));
+  // One row (16) per target, then one row (17) per team.
+  row16 = LP.num_rows() - (Pm.P_a.size() - 1) - teams.size();
+  if (teams.size() > 1)
+    budget_row = row16 - teams.size();
+}
+
+PasaqModel::PasaqModel(const PayoffMatrix &Pm, const SparseColumns &A,
+                       const SolverParams &params)
+    : PasaqModel(Pm, vector<TeamBlock>(1, TeamBlock{params.num_res, A}),
+                 params) {}
+
+PasaqModel::PasaqModel(const PasaqModel &prototype, const PayoffMatrix &Pm,
+                       const SolverParams &params)
+    : LP(prototype.LP, "CF-OPT"), Pm(Pm), params(params), S(prototype.S),
+      warm(prototype.warm), control(nullptr), row16(prototype.row16),
+      team_first(prototype.team_first),
+      team_resources(prototype.team_resources),
+      budget_row(prototype.budget_row) {
+  if (Pm.P_a.size() != prototype.Pm.P_a.size() ||
+      params.K != prototype.params.K)
+    throw std::invalid_argument(
+        "model copy changes the number of targets or segments");
+  tables = build_pasaq_tables(Pm, params.lambda, params.K);
+  // The teams' resources come with their constraints.
+  if (team_first.size() > 1)
+    this->params.num_res = prototype.params.num_res;
+  set_resources(this->params.num_res);
+  LP.set_presolve(!uses_pasaq_callbacks(params));
+}
+
+void PasaqModel::set_payoffs(const PayoffMatrix &Pm) {
+  if (Pm.P_a.size() != this->Pm.P_a.size())
+    throw std::invalid_argument("payoff update changes the number of targets");
+  this->Pm = Pm;
+  tables = build_pasaq_tables(Pm, params.lambda, params.K);
+}
+
+void PasaqModel::set_target_payoffs(const size_t i, const int d_reward,
+                                    const int d_penalty, const int a_reward,
+                                    const int a_penalty) {
+  if (i < 1 || i >= Pm.P_a.size())
+    throw std::invalid_argument("no target " + std::to_string(i));
+  Pm.R_d[i] = d_reward;
+  Pm.P_d[i] = d_penalty;
+  Pm.R_a[i] = a_reward;
+  Pm.P_a[i] = a_penalty;
+  if (*std::max_element(Pm.R_a.begin(), Pm.R_a.end()) != tables.max_reward)
+    tables = build_pasaq_tables(Pm, params.lambda, params.K);
+  else
+    update_pasaq_tables(tables, Pm, i);
+}
+
+void PasaqModel::set_schedule(const size_t j,
+                              const vector<pair<size_t, double>> &column) {
+  if (j >= S)
+    throw std::invalid_argument("no schedule " + std::to_string(j));
+  const size_t N = Pm.P_a.size() - 1;
+  const size_t t =
+      std::upper_bound(team_first.begin(), team_first.end(), j) -
+      team_first.begin() - 1;
+  vector<pair<size_t, double>> entries;
+  double sum = 0;
+  for (const auto &target : column) {
+    if (target.first < 1 || target.first > N)
+      throw std::invalid_argument("no target " + std::to_string(target.first));
+    if (target.second != 0)
+      entries.emplace_back(row16 + target.first - 1, -target.second);
+    sum += target.second;
+  }
+  entries.emplace_back(row16 + N + t, 1);
+  if (budget_row != 0 && sum != 0)
+    entries.emplace_back(budget_row + t, sum);
+  LP.set_column("a", j + 1, entries);
+}
+
+size_t PasaqModel::add_schedule(const vector<pair<size_t, double>> &column) {
+  LP.add_variables("a", 1);
+  LP.set_var_bnd("a", ++S, GLP_DB, 0, 1);
+  set_schedule(S - 1, column);
+  return S - 1;
+}
+
+void PasaqModel::set_schedule_enabled(const size_t j, const bool enabled) {
+  if (j >= S)
+    throw std::invalid_argument("no schedule " + std::to_string(j));
+  if (enabled)
+    LP.set_var_bnd("a", j + 1, GLP_DB, 0, 1);
+  else
+    LP.set_var_bnd("a", j + 1, GLP_FX, 0, 0);
+}
+
+void PasaqModel::set_lambda(const double lambda) {
+  if (lambda == params.lambda)
+    return;
+  params.lambda = lambda;
+  tables = build_pasaq_tables(Pm, lambda, params.K);
+}
+
+void PasaqModel::set_warm_start(const bool on) {
+  warm = on;
+  if (!on)
+    LP.set_mip_start(vector<double>());
+}
+
+void PasaqModel::set_resources(const int num_res) {
+  params.num_res = num_res;
+  if (team_resources.size() == 1)
+    team_resources[0] = num_res;
+  // Constraint (11) is the first row.
+  LP.set_row_bnd(1, GLP_UP, 0, num_res);
+}
+
+void PasaqModel::set_team_resources(const size_t t, const int resources) {
+  if (t >= team_resources.size())
+    throw std::invalid_argument("no team " + std::to_string(t));
+  team_resources[t] = resources;
+  if (budget_row != 0)
+    LP.set_row_bnd(budget_row + t, GLP_UP, 0, resources);
+  set_resources(std::accumulate(team_resources.begin(),
+                                team_resources.end(), 0));
+}
+
+void branch_on_fill_level(glp_tree *tree, const lin_prog &LP, const size_t N,
+                          const int K) {
+  if (LP.is_presolved())
+    return;
+  glp_prob *prob = glp_ios_get_prob(tree);
+  const int x0 = LP.column("x", 1);
+  const int z0 = LP.column("z", 1);
+  int chosen = 0;
+  double best = 0;
+  double value = 0;
+  for (size_t i = 1; i <= N; i++) {
+    for (int k = 1; k <= K; k++) {
+      const int ik = (i - 1) * K + k - 1;
+      const double z = glp_get_col_prim(prob, z0 + ik);
+      if (!glp_ios_can_branch(tree, z0 + ik))
+        continue;
+      // The first fractional z of the chain is where the level is open.
+      const double fraction = std::min(z, 1 - z);
+      const double score =
+          fraction * (std::fabs(glp_get_obj_coef(prob, x0 + ik)) + 1e-12);
+      if (score > best) {
+        best = score;
+        chosen = z0 + ik;
+        value = z;
+      }
+      break;
+    }
+  }
+  if (chosen != 0)
+    glp_ios_branch_upon(tree, chosen,
+                        value >= 0.5 ? GLP_UP_BRNCH : GLP_DN_BRNCH);
+}
+
+bool round_fill_levels(glp_tree *tree, const lin_prog &LP, const size_t N,
+                       const int K) {
+  if (LP.is_presolved())
+    return false;
+  glp_prob *prob = glp_ios_get_prob(tree);
+  const int n = glp_get_num_cols(prob);
+  vector<double> x(n + 1, 0);
+  for (int j = 1; j <= n; j++)
+    x[j] = glp_get_col_prim(prob, j);
+  const int x0 = LP.column("x", 1);
+  const int z0 = LP.column("z", 1);
+  const double width = 1.0 / K;
+  for (size_t i = 1; i <= N; i++) {
+    const int first = (i - 1) * K;
+    double coverage = 0;
+    for (int k = 0; k < K; k++)
+      coverage += x[x0 + first + k];
+    coverage = std::max(0.0, std::min(1.0, coverage));
+    const int full =
+        std::min(K, static_cast<int>(std::floor(coverage * K + 1e-9)));
+    for (int k = 0; k < K; k++) {
+      if (k < full) {
+        x[x0 + first + k] = width;
+        x[z0 + first + k] = 1;
+      } else {
+        x[x0 + first + k] =
+            k == full ? std::max(0.0, std::min(width, coverage - full * width))
+                      : 0;
+        x[z0 + first + k] = 0;
+      }
+    }
+  }
+  if (glp_ios_heur_sol(tree, &x[0]) != 0)
+    return false;
+  current_stats().heuristic_solutions++;
+  return true;
+}
+
+// Row classes of the cuts, for glp_ios_row_attr.
+static const int FILL_CUT = 101;
+static const int KNAPSACK_CUT = 102;
+
+void add_pasaq_cuts(glp_tree *tree, const lin_prog &LP, const size_t N,
+                    const int K, const size_t row16, const int num_res,
+                    const bool fill, const bool knapsack,
+                    const vector<size_t> &team_first) {
+  if (LP.is_presolved() || (!fill && !knapsack))
+    return;
+  glp_prob *prob = glp_ios_get_prob(tree);
+  const int x0 = LP.column("x", 1);
+  const int z0 = LP.column("z", 1);
+  const double violated = 1e-6;
+  SolveStats &stats = current_stats();
+
+  if (fill) {
+    int ind[3];
+    double val[3];
+    val[1] = 1;
+    val[2] = -1.0 / K;
+    for (size_t i = 1; i <= N; i++) {
+      for (int k = 1; k < K; k++) {
+        const int ik = (i - 1) * K + k - 1;
+        const double z = glp_get_col_prim(prob, z0 + ik);
+        if (glp_get_col_prim(prob, x0 + ik + 1) - z / K <= violated)
+          continue;
+        ind[1] = x0 + ik + 1;
+        ind[2] = z0 + ik;
+        glp_ios_add_row(tree, nullptr, FILL_CUT, 0, 2, ind, val, GLP_UP, 0);
+        stats.fill_cuts++;
+      }
+    }
+  }
+
+  if (knapsack) {
+    const int a0 = LP.column("a", 1);
+    const int n = glp_get_num_cols(prob);
+    vector<int> ind(n + 1);
+    vector<double> val(n + 1);
+    vector<double> column_sum(n + 1, 0);
+    // Team of a column, by its first a column.
+    auto team_of = [&](int c) {
+      return std::upper_bound(team_first.begin(), team_first.end(),
+                              static_cast<size_t>(c - a0)) -
+             team_first.begin() - 1;
+    };
+    vector<int> filled;     // Targets with full segments in the relaxation.
+    vector<int> cut_ind(1); // z columns of the targets, for the cut rows.
+    double level_sum = 0;
+    auto add_cut = [&](const vector<int> &columns, const double level,
+                       const double capacity) {
+      const double rhs = std::floor(K * capacity + 1e-9);
+      if (level - rhs <= violated)
+        return;
+      const vector<double> ones(columns.size(), 1);
+      glp_ios_add_row(tree, nullptr, KNAPSACK_CUT, 0, columns.size() - 1,
+                      &columns[0], &ones[0], GLP_UP, rhs);
+      stats.knapsack_cuts++;
+    };
+    for (size_t i = 1; i <= N; i++) {
+      double level = 0;
+      for (int k = 0; k < K; k++)
+        level += glp_get_col_prim(prob, z0 + (i - 1) * K + k);
+      if (level <= violated)
+        continue;
+      // Row (16) holds -A_ij on the a columns.
+      const int len = glp_get_mat_row(prob, row16 + i - 1, &ind[0], &val[0]);
+      vector<double> best(team_first.size(), 0);
+      for (int e = 1; e <= len; e++) {
+        if (ind[e] < a0)
+          continue;
+        double &team_best = best[team_of(ind[e])];
+        team_best = std::max(team_best, -val[e]);
+        column_sum[ind[e]] -= val[e];
+      }
+      vector<int> own(1);
+      for (int k = 0; k < K; k++) {
+        own.push_back(z0 + (i - 1) * K + k);
+        cut_ind.push_back(own.back());
+      }
+      add_cut(own, level,
+              std::min<double>(num_res, std::accumulate(best.begin(),
+                                                        best.end(), 0.0)));
+      filled.push_back(i);
+      level_sum += level;
+    }
+    if (filled.size() > 1) {
+      vector<double> best(team_first.size(), 0);
+      for (int c = a0; c <= n; c++)
+        best[team_of(c)] = std::max(best[team_of(c)], column_sum[c]);
+      add_cut(cut_ind, level_sum,
+              std::min<double>(num_res, std::accumulate(best.begin(),
+                                                        best.end(), 0.0)));
+    }
+  }
+}
+
+vector<Subproblem> fill_level_subproblems(const lin_prog &LP,
+                                          const vector<double> &weight,
+                                          const int K, const size_t count) {
+  const size_t N = weight.size() - 1;
+  vector<size_t> order(N);
+  for (size_t n = 0; n < N; n++)
+    order[n] = n + 1;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return weight[a] > weight[b];
+  });
+  vector<Subproblem> parts(1);
+  for (size_t n = 0; n < N && parts.size() < count; n++) {
+    const size_t i = order[n];
+    vector<Subproblem> split;
+    for (const auto &part : parts) {
+      for (int level = K; level >= 0; level--) {
+        split.push_back(part);
+        for (int k = 1; k <= K; k++) {
+          const double z = k <= level ? 1 : 0;
+          split.back().push_back(
+              {LP.column("z", (i - 1) * K + k), GLP_FX, z, z});
+        }
+      }
+    }
+    parts.swap(split);
+  }
+  return parts;
+}
+
+bool uses_pasaq_callbacks(const SolverParams &params) {
+  return params.fill_branching || params.fill_cuts || params.knapsack_cuts;
+}
+
+namespace {
+struct CheckInfo {
+  SolveControl *control; // May be nullptr.
+  const lin_prog *LP;
+  size_t N;
+  int K;
+  size_t row16;
+  int num_res;
+  const vector<size_t> *team_first;
+  const SolverParams *params;
+  bool parallel;      // Called from several workers at once.
+  bool root_cuts;     // Cuts were separated at the root.
+  double root_before; // Root relaxation before and after them.
+  double root_after;
+};
+}
+
+/*
+ * Branch and bound callback. r is achievable iff the CF-OPT minimum is at most
+ * 0, so an incumbent at or below 0 or a bound above 0 settles the check and
+ * the rest of the tree need not be searched. info is the check's CheckInfo.
+ */
+static void decide_sign(glp_tree *tree, void *info) {
+  CheckInfo *check = static_cast<CheckInfo *>(info);
+  SolveControl *control = check->control;
+  if (control != nullptr) {
+    int active, nodes, total;
+    glp_ios_tree_size(tree, &active, &nodes, &total);
+    control->bnb_nodes = total;
+    if (control->cancelled) {
+      glp_ios_terminate(tree);
+      return;
+    }
+  }
+  const int reason = glp_ios_reason(tree);
+  const SolverParams &params = *check->params;
+  if (reason == GLP_ICUTGEN) {
+    // GLPK separates again after every round that added cuts, so the last
+    // root round sees the tightened relaxation.
+    if (!check->parallel &&
+        glp_ios_node_level(tree, glp_ios_curr_node(tree)) == 0) {
+      const double bound = glp_get_obj_val(glp_ios_get_prob(tree));
+      if (!check->root_cuts)
+        check->root_before = bound;
+      check->root_cuts = true;
+      check->root_after = bound;
+    }
+    add_pasaq_cuts(tree, *check->LP, check->N, check->K, check->row16,
+                   check->num_res, params.fill_cuts, params.knapsack_cuts,
+                   *check->team_first);
+  } else if (params.fill_branching && reason == GLP_IBRANCH) {
+    branch_on_fill_level(tree, *check->LP, check->N, check->K);
+  } else if (params.fill_branching && reason == GLP_IHEUR &&
+             round_fill_levels(tree, *check->LP, check->N, check->K) &&
+             glp_mip_obj_val(glp_ios_get_prob(tree)) <= 0) {
+    glp_ios_terminate(tree);
+    return;
+  }
+  if (reason == GLP_IBINGO &&
+      glp_get_obj_val(glp_ios_get_prob(tree)) <= 0) {
+    glp_ios_terminate(tree);
+    return;
+  }
+  const int best = glp_ios_best_node(tree);
+  if (best != 0 && glp_ios_node_bound(tree, best) > 0)
+    glp_ios_terminate(tree);
+}
+
+/*
+ * Solve CF-OPT using GPLK, to check that a strategy is feasible and return
+ * such a strategy. Only the objective depends on r, so the constraints built
+ * by the constructor are reused.
+ */
+FeasibilityResult PasaqModel::check(const double r, const double time_limit) {
+  ScopedTimer timer("check_feasibility");
   const size_t T = Pm.P_a.size();
-  cout << "CheckFeasibility(" << r << ");" << endl;
-  pair<bool, vector<double>> result;
-  std::string name = "Feasibility check r = " + to_string(r);
-  cout << "\tT = " << T << " K=" << K << " A=" << A.size() << "x" << A[1].size()
-       << endl;
-
-  lin_prog LP("Check Feasibility r = " + to_string(r));
-  LP.declare_variables("x", T*K);
-  LP.declare_variables("z", T*K);
-  LP.declare_variables("a", A[1].size());  
-
-  set_pasaq_obj(LP, r, Pm, lambda, K);
-  set_pasaq_constraint_11(LP, T, K, num_res);
-  set_pasaq_constraint_12(LP, T, K);
-  set_pasaq_constraint_13(LP, T, K);
-  set_pasaq_constraint_14(LP, T, K);
-  set_pasaq_constraint_15(LP, T, K);
-  set_pasaq_constraint_16(LP, T, K, A);
-  set_pasaq_constraint_17(LP, T, K, A);
-  set_pasaq_constraint_18(LP, T, K, A);
-  
+  const int K_ = params.K;
+  solver_log() << "CheckFeasibility(" << r << ");" << endl;
+  FeasibilityResult result;
+  result.feasible = false;
+  result.decided = true;
+  result.coverage = vector<double>(T);
+#ifdef DEBUG
+  cout << "\tT = " << T << " K=" << K_ << " S=" << S << endl;
+#endif
+
+  set_pasaq_obj(LP, r, Pm, tables);
+
   glp_iocp parm;
+  glp_init_iocp(&parm);
   parm.presolve = GLP_ON;
-  LP.run(&parm);
+  const bool parallel = params.threads > 1;
+  CheckInfo info = {control,     &LP,     T - 1,    K_,    row16,
+                    params.num_res, &team_first, &params, parallel,
+                    false,       0,       0};
+  parm.cb_func = &decide_sign;
+  parm.cb_info = &info;
+  if (control != nullptr)
+    control->bnb_nodes = 0;
+  if (params.mip_gap > 0)
+    parm.mip_gap = params.mip_gap;
+  if (time_limit > 0)
+    parm.tm_lim = std::max(1, static_cast<int>(time_limit * 1000));
+  int ret;
+  if (parallel) {
+    // Targets whose coverage moves the objective most are split first.
+    vector<double> weight(T, 0);
+    for (size_t i = 1; i < T; i++) {
+      for (int k = 0; k < K_; k++) {
+        const size_t ik = (i - 1) * K_ + k;
+        weight[i] += std::fabs(tables.theta[i] * (r - Pm.P_d[i]) *
+                                   tables.gamma[ik] -
+                               tables.theta[i] * tables.alpha[i] *
+                                   tables.mu[ik]);
+      }
+    }
+    // An incumbent at or below 0 settles the check for every worker.
+    ret = LP.run_parallel(
+        &parm, fill_level_subproblems(LP, weight, K_, 4 * params.threads),
+        params.threads, 0);
+  } else {
+    ret = LP.run(&parm);
+  }
+  const int status = LP.get_status();
+  const bool stopped =
+      ret == GLP_ESTOP || ret == GLP_ETMLIM || ret == GLP_EMIPGAP;
+  if (info.root_cuts)
+    current_stats().cut_bound_gain += info.root_after - info.root_before;
+
+  if ((ret != 0 && !stopped) || (status != GLP_OPT && status != GLP_FEAS)) {
+    print_lp_result(ret);
+    // Without an incumbent only the bound can settle r.
+    if (stopped && LP.get_best_bound() <= 0) {
+      result.decided = false;
+      current_stats().undecided_checks++;
+    }
+    return result;
+  }
 
   double obj_val = LP.get_obj_val();
-  cout << "obj value = " << obj_val << endl;
+  solver_log() << "obj value = " << obj_val << endl;
+  if (warm)
+    LP.set_mip_start(LP.get_solution());
 
-  result.first = obj_val == 0;
-  result.second = vector<double>(T);
-  
-  std::cout << "\nVariable x values:" << "\n";
-  for (size_t i = 1; i <= T; i++) {
+  result.feasible = obj_val <= 0;
+  // An incumbent above 0 is only conclusive for a finished search.
+  if (!result.feasible && ret != 0 && LP.get_best_bound() <= 0) {
+    result.decided = false;
+    current_stats().undecided_checks++;
+  }
+
+  for (size_t i = 1; i < T; i++) {
     double sum = 0;
-    for (int k = 1; k <= K; k++) {
-      auto x = LP.get_var_val("x",  (i - 1) * K + k);
-      // cout << "x_" << i << k << "=" << x << endl;
-      sum += x;
-    }
-    result.second[i] = sum;
-    cout << "x_" << i << "=" << result.second[i] << (i % 5 == 0 ? "\n" : " ");
+    for (int k = 1; k <= K_; k++)
+      sum += LP.get_var_val("x", (i - 1) * K_ + k);
+    result.coverage[i] = sum;
+  }
+  for (size_t j = 1; j <= S; j++) {
+    const double a = LP.get_var_val("a", j);
+    if (a > 1e-9)
+      result.mixture.emplace_back(j - 1, a);
   }
 
+#ifdef DEBUG
+  std::cout << "\nVariable x values:" << "\n";
+  for (size_t i = 1; i < T; i++)
+    cout << "x_" << i << "=" << result.coverage[i] << (i % 5 == 0 ? "\n" : " ");
+
   std::cout << "\nVariable z values:" << "\n";
-  for (size_t i = 1; i <= T; i++) {
-    for (size_t k = 1; k <= K; k++) {
-      auto z = LP.get_var_val("z",  (i - 1) * K + k);
+  for (size_t i = 1; i < T; i++) {
+    for (int k = 1; k <= K_; k++) {
+      auto z = LP.get_var_val("z", (i - 1) * K_ + k);
       cout << "z_{" << i << "," << k << "}=" << z << " ";
     }
     cout << endl;
   }
 
-  // cout << "PRINTING AS: " << A[1].size() << endl;
   std::cout << "\nVariable a values:" << "\n";
-  for (size_t j = 1; j <= A[1].size(); j++) {
-    auto a =  LP.get_var_val("a", j);
+  for (size_t j = 1; j <= S; j++) {
+    auto a = LP.get_var_val("a", j);
     cout << "a_" << j << "=" << a << (j % 5 == 0 ? "\n" : " ");
   }
   cout << endl;
+#endif
   return result;
 }
 
+/*
+ * Generate CF-OPT and solve it using GPLK, to check that a strategy is feasible
+ * and return such a strategy. We do this by creating a linear program defined
+ * by PASAQ with assignment constraints.
+ *
+ * A = Probability matrix.
+ */
+FeasibilityResult CheckFeasibility(const double r, const int num_res,
+                                   const PayoffMatrix &Pm,
+                                   const vector<vector<double>> &A,
+                                   const double K, double lambda) {
+  SolverParams params;
+  params.num_res = num_res;
+  params.lambda = lambda;
+  params.K = static_cast<int>(K);
+  PasaqModel model(Pm, A, params);
+  return model.check(r);
+}
+
 // Main algorithm for finding strategy.
 pair<double, vector<double>>
 BinarySearchMethod(const double e, const int numRes, const PayoffMatrix &Pm,
                    const vector<vector<double>> &A, const double lambda,
                    const double K) {
-  cout << "BinarySearchMethod(" << e << ", " << numRes << ")" << endl;
-  const auto pair = EstimateBounds(numRes, Pm, lambda);
-  auto L = pair.first;
-  auto U = pair.second;
-  vector<double> x;
-  cout << "U = " << U << " L=" << L << endl;
-  while (U - L > e) {
+  SolverParams params;
+  params.epsilon = e;
+  params.num_res = numRes;
+  params.lambda = lambda;
+  params.K = static_cast<int>(K);
+  const auto solution =
+      BinarySearchSolve(params, Pm, A, initial_solution(params, Pm));
+  return std::pair<double, vector<double>>(solution.lower, solution.coverage);
+}
+
+PasaqSolution initial_solution(const SolverParams &params,
+                               const PayoffMatrix &Pm) {
+  PasaqSolution start;
+  const auto bounds = EstimateBounds(params.num_res, Pm, params.lambda);
+  start.lower = bounds.first;
+  start.upper = bounds.second;
+  // Any strategy reaches the initial lower bound.
+  start.coverage = vector<double>(Pm.P_a.size(), 0);
+  return start;
+}
+
+// BinarySearchSolve and MultiResolutionSolve for a dense or sparse A.
+template <typename Matrix>
+static PasaqSolution multi_resolution_solve(const SolverParams &params,
+                                            const PayoffMatrix &Pm,
+                                            const Matrix &A,
+                                            const PasaqSolution &start);
+
+template <typename Matrix>
+static PasaqSolution binary_search_solve(const SolverParams &params,
+                                         const PayoffMatrix &Pm,
+                                         const Matrix &A,
+                                         const PasaqSolution &start) {
+  solver_log() << "BinarySearchMethod(" << params.epsilon << ", "
+               << params.num_res << ")" << endl;
+  if (params.coarse_K > 0 && params.coarse_K < params.K)
+    return multi_resolution_solve(params, Pm, A, start);
+  PasaqModel model(Pm, A, params);
+  return BinarySearchSolve(model, start);
+}
+
+PasaqSolution BinarySearchSolve(const SolverParams &params,
+                                const PayoffMatrix &Pm,
+                                const vector<vector<double>> &A,
+                                const PasaqSolution &start) {
+  return binary_search_solve(params, Pm, A, start);
+}
+
+PasaqSolution BinarySearchSolve(const SolverParams &params,
+                                const PayoffMatrix &Pm, const SparseColumns &A,
+                                const PasaqSolution &start) {
+  return binary_search_solve(params, Pm, A, start);
+}
+
+PasaqSolution MultiResolutionSolve(const SolverParams &params,
+                                   const PayoffMatrix &Pm,
+                                   const vector<vector<double>> &A,
+                                   const PasaqSolution &start) {
+  return multi_resolution_solve(params, Pm, A, start);
+}
+
+PasaqSolution MultiResolutionSolve(const SolverParams &params,
+                                   const PayoffMatrix &Pm,
+                                   const SparseColumns &A,
+                                   const PasaqSolution &start) {
+  return multi_resolution_solve(params, Pm, A, start);
+}
+
+template <typename Matrix>
+static PasaqSolution multi_resolution_solve(const SolverParams &params,
+                                            const PayoffMatrix &Pm,
+                                            const Matrix &A,
+                                            const PasaqSolution &start) {
+  typedef std::chrono::steady_clock clock;
+  const auto deadline =
+      clock::now() + std::chrono::duration_cast<clock::duration>(
+                         std::chrono::duration<double>(params.time_limit));
+  PasaqSolution solution = start;
+  int K = std::max(1, std::min(params.coarse_K, params.K));
+  PasaqTables tables = build_pasaq_tables(Pm, params.lambda, K);
+  for (;;) {
+    SolverParams stage = params;
+    stage.K = K;
+    stage.coarse_K = 0;
+    if (params.time_limit > 0)
+      stage.time_limit =
+          std::chrono::duration<double>(deadline - clock::now()).count();
+    const bool expired = params.time_limit > 0 && stage.time_limit <= 0;
+    if (K == params.K) {
+      if (!expired) {
+        PasaqModel model(Pm, A, stage);
+        solution = BinarySearchSolve(model, solution);
+      }
+      return solution;
+    }
+
+    // Out of time, go straight to K; otherwise to the next stage, whose
+    // padding sets how far this one is worth narrowing.
+    const int next = expired ? params.K : std::min(2 * K, params.K);
+    const PasaqTables finer = build_pasaq_tables(Pm, params.lambda, next);
+    if (!expired) {
+      const double padding =
+          std::max(linearization_padding(tables, finer, Pm, solution.lower),
+                   linearization_padding(tables, finer, Pm, solution.upper));
+      stage.epsilon = std::max(params.epsilon, 4 * padding);
+      PasaqModel model(Pm, A, stage);
+      solution = BinarySearchSolve(model, solution);
+    }
+    solver_log() << "K " << K << " -> " << next << ": [" << solution.lower
+                 << ", " << solution.upper << "]" << endl;
+    solution.lower = std::max(
+        start.lower,
+        solution.lower -
+            linearization_padding(tables, finer, Pm, solution.lower));
+    solution.upper = std::min(
+        start.upper,
+        solution.upper +
+            linearization_padding(tables, finer, Pm, solution.upper));
+    K = next;
+    tables = finer;
+  }
+}
+
+PasaqSolution BinarySearchSolve(PasaqModel &model, const PasaqSolution &start,
+                                const BisectionStep &on_step) {
+  auto check = [&model](double r, double budget) {
+    FeasibilityResult result = model.check(r, budget);
+    // A relative gap can stop GLPK with an incumbent above 0 and a bound
+    // below it. With a deadline the search retries or stops; without one
+    // that would end it at this step, so close the gap instead.
+    const SolverParams &params = model.get_params();
+    const double gap = params.mip_gap;
+    const SolveControl *control = model.get_control();
+    if (!result.decided && budget <= 0 && gap > 0 &&
+        (control == nullptr || !control->cancelled)) {
+      model.set_limits(params.time_limit, 0);
+      result = model.check(r, budget);
+      model.set_limits(params.time_limit, gap);
+    }
+    return result;
+  };
+  return BinarySearchSolve(model.get_params(), model.get_control(), check,
+                           start, on_step);
+}
+
+PasaqSolution BinarySearchSolve(const SolverParams &params,
+                                SolveControl *control,
+                                const FeasibilityCheck &check_r,
+                                const PasaqSolution &start,
+                                const BisectionStep &on_step) {
+  ScopedTimer timer("binary_search");
+  typedef std::chrono::steady_clock clock;
+  const bool has_deadline = params.time_limit > 0;
+  const auto deadline =
+      clock::now() + std::chrono::duration_cast<clock::duration>(
+                         std::chrono::duration<double>(params.time_limit));
+  PasaqSolution solution = start;
+  auto &L = solution.lower;
+  auto &U = solution.upper;
+  bool retry = false;
+  solver_log() << "U = " << U << " L=" << L << endl;
+  while (U - L > params.epsilon) {
+    if (control != nullptr) {
+      control->lower = L;
+      control->upper = U;
+      if (control->cancelled)
+        break;
+    }
     double r = (U + L) / 2;
-    cout << "U = " << U << " L=" << L << " r = " << r << endl;
-    const auto f_x_pair = CheckFeasibility(r, numRes, Pm, A, K, lambda);
-     x = f_x_pair.second;
-    if (f_x_pair.first) {
+    double budget = 0;
+    if (has_deadline) {
+      const double remaining =
+          std::chrono::duration<double>(deadline - clock::now()).count();
+      if (remaining <= 0)
+        break;
+      // Split what is left evenly over the steps still needed, but give an
+      // undecided r everything that is left before giving up on it.
+      const double steps =
+          std::max(1.0, std::ceil(std::log2((U - L) / params.epsilon)));
+      budget = retry ? remaining : remaining / steps;
+    }
+    current_stats().bisection_steps++;
+    if (control != nullptr)
+      control->bisection_steps++;
+    solver_log() << "U = " << U << " L=" << L << " r = " << r << endl;
+    auto check = check_r(r, budget);
+    if (!check.decided) {
+      if (retry || !has_deadline || (control && control->cancelled))
+        break;
+      retry = true;
+      continue;
+    }
+    retry = false;
+    if (check.feasible) {
+      solution.coverage = std::move(check.coverage);
+      solution.mixture = std::move(check.mixture);
       L = r;
     } else {
       U = r;
+      solution.upper_certified = check.certified;
     }
+    if (on_step)
+      on_step(solution);
   }
-  return std::pair<double, vector<double>>(L, x);
+  if (control != nullptr) {
+    control->lower = L;
+    control->upper = U;
+  }
+  return solution;
+}
+
+PasaqTables build_pasaq_tables(const PayoffMatrix &Pm, const double lambda,
+                               const int K) {
+  const int T = Pm.P_a.size();
+  PasaqTables tables;
+  tables.lambda = lambda;
+  tables.K = K;
+  tables.theta.resize(T);
+  tables.alpha.resize(T);
+  tables.gamma.resize((T - 1) * K);
+  tables.mu.resize((T - 1) * K);
+  tables.max_reward = *std::max_element(Pm.R_a.begin(), Pm.R_a.end());
+  for (int i = 0; i < T; i++)
+    update_pasaq_tables(tables, Pm, i);
+  return tables;
+}
+
+void update_pasaq_tables(PasaqTables &tables, const PayoffMatrix &Pm,
+                         const size_t i) {
+  const double lambda = tables.lambda;
+  const int K = tables.K;
+  tables.theta[i] = exp(-lambda * tables.max_reward) * theta(i, Pm, lambda);
+  tables.alpha[i] = alpha(i, Pm, lambda);
+  if (i == 0)
+    return;
+  for (int k = 1; k <= K; k++) {
+    const double k_ = static_cast<double>(k);
+    const double left = (k_ - 1.0) / (double)K;
+    const double right = k_ / (double)K;
+    tables.gamma[(i - 1) * K + k - 1] =
+        (f1(i, right, Pm, lambda) - f1(i, left, Pm, lambda)) / (right - left);
+    tables.mu[(i - 1) * K + k - 1] =
+        (f2(i, right, Pm, lambda) - f2(i, left, Pm, lambda)) / (right - left);
+  }
+}
+
+/*
+ * Largest interpolation errors of f1 = exp(-beta x) and f2 = x exp(-beta x)
+ * over K equal segments of [0, 1]: h^2 / 8 times the largest second
+ * derivative on a segment, or the function's range there if that is less.
+ */
+static void interpolation_errors(const double beta, const int K, double &e1,
+                                 double &e2) {
+  auto g1 = [beta](double x) { return exp(-beta * x); };
+  auto g2 = [beta](double x) { return x * exp(-beta * x); };
+  // |f2''| = |beta (beta x - 2)| exp(-beta x), extreme at the ends or 3/beta.
+  auto curve2 = [beta](double x) {
+    return std::fabs(beta * (beta * x - 2)) * exp(-beta * x);
+  };
+  const double h = 1.0 / K;
+  e1 = 0;
+  e2 = 0;
+  for (int k = 0; k < K; k++) {
+    const double a = k * h;
+    const double b = a + h;
+    const double curve1 = beta * beta * std::max(g1(a), g1(b));
+    e1 = std::max(e1, std::min(h * h / 8 * curve1, std::fabs(g1(a) - g1(b))));
+
+    double curve = std::max(curve2(a), curve2(b));
+    if (beta > 0 && 3 / beta > a && 3 / beta < b)
+      curve = std::max(curve, curve2(3 / beta));
+    // f2 peaks at 1/beta.
+    double high = std::max(g2(a), g2(b));
+    const double low = std::min(g2(a), g2(b));
+    if (beta > 0 && 1 / beta > a && 1 / beta < b)
+      high = std::max(high, g2(1 / beta));
+    e2 = std::max(e2, std::min(h * h / 8 * curve, high - low));
+  }
+}
+
+double linearization_error(const PasaqTables &tables, const PayoffMatrix &Pm,
+                           const double r) {
+  double error = 0;
+  for (size_t i = 1; i < Pm.P_a.size(); i++) {
+    double e1, e2;
+    interpolation_errors(beta(i, Pm, tables.lambda), tables.K, e1, e2);
+    error += tables.theta[i] * (std::fabs(r - Pm.P_d[i]) * e1 +
+                                std::fabs(tables.alpha[i]) * e2);
+  }
+  return error;
+}
+
+double linearization_padding(const PasaqTables &coarse,
+                             const PasaqTables &fine, const PayoffMatrix &Pm,
+                             const double r) {
+  // The slope in r is sum_i theta_i f1(x_i) (slot 0 has f1 = 1), and the
+  // interpolated f1 is at least the smallest value of f1 on [0, 1].
+  double slope = coarse.theta[0];
+  for (size_t i = 1; i < Pm.P_a.size(); i++)
+    slope += coarse.theta[i] * std::min(1.0, f1(i, 1, Pm, coarse.lambda));
+  return (linearization_error(coarse, Pm, r) +
+          linearization_error(fine, Pm, r)) /
+         slope;
 }
 
 void set_pasaq_obj(lin_prog  &LP, const double r, const PayoffMatrix &Pm,
-                   const double lambda, const int K) {
-  const double T = Pm.P_a.size();
+                   const PasaqTables &tables) {
+  const int T = Pm.P_a.size();
+  const int K = tables.K;
 #ifdef DEBUG
   cout << "OBJECTIVE:";
 #endif
-  LP.set_max();
-  for (int i = 1; i <= T; i++) {
-    const double theta_ = theta(i, Pm, lambda);
-    const double alpha_ = alpha(i, Pm, lambda);
+  LP.set_min();
+  // f1(0) = 1 and f2(0) = 0, so every target (including the unused slot 0)
+  // adds theta_i * (r - P_d_i) to the constant term.
+  double constant = 0;
+  for (int i = 0; i < T; i++)
+    constant += tables.theta[i] * (r - Pm.P_d[i]);
+  LP.set_objective_const(constant);
+
+  for (int i = 1; i < T; i++) {
+    const double theta_ = tables.theta[i];
+    const double alpha_ = tables.alpha[i];
     const double coef = theta_ * (r - Pm.P_d[i]);
     for (int k = 1; k <= K; k++) {
-      const double k_ = static_cast<double>(k);
-      const double left = (k_ - 1.0) / (double)K;
-      const double right = k_ / (double)K;
-      const double y_ik =
-          (f1(i, right, Pm, lambda) - f1(i, left, Pm, lambda)) / (right - left);
-      const double u_ik =
-          (f2(i, right, Pm, lambda) - f2(i, left, Pm, lambda)) / (right - left);
-      double coef_val = coef * y_ik;
-      coef_val = // coef_val
-        0 - (theta_ * alpha_ * u_ik);
+      const double y_ik = tables.gamma[(i - 1) * K + k - 1];
+      const double u_ik = tables.mu[(i - 1) * K + k - 1];
+      const double coef_val = coef * y_ik - (theta_ * alpha_ * u_ik);
       LP.set_objective_var("x", ((i - 1) * K) + k, coef_val);
 #ifdef DEBUG
       cout << (k > 1 ? " " : "\n");
@@ -392,16 +1269,28 @@ void set_pasaq_constraint_15(lin_prog &LP, const size_t T, const size_t K) {
   }
 }
 
+void set_pasaq_fill_order(lin_prog &LP, const size_t T, const size_t K) {
+  for (size_t i = 1; i <= T; i++) {
+    for (size_t k = 1; k <= K - 1; k++) {
+      LP.add_row("fill-" + std::to_string(i) + " " + std::to_string(k));
+      LP.set_row_bnd(GLP_UP, 0, 0);
+      LP.add_constraint("z", ((i - 1) * K) + k + 1, 1);
+      LP.add_constraint("z", ((i - 1) * K) + k, -1);
+    }
+  }
+}
+
 void set_pasaq_constraint_16(lin_prog &LP, const size_t T, const size_t K,
                              const vector<vector<double>> &A) {
-  for (size_t i = 1; i < T; i++) {
+  for (size_t i = 1; i <= T; i++) {
     LP.add_row("16-" + std::to_string(i));
     LP.set_row_bnd(GLP_FX, 0, 0);
     for (size_t k = 1; k <= K; k++) {
       LP.add_constraint("x", ((i - 1) * K + k), 1);
     }
-    for (size_t j = 1; j <= A[1].size(); j++) {
-      LP.add_constraint("a", j, -A[i][j]);
+    for (size_t j = 1; j <= A[i].size(); j++) {
+      if (A[i][j - 1] != 0)
+        LP.add_constraint("a", j, -A[i][j - 1]);
     }
   }
 }
@@ -411,50 +1300,50 @@ void set_pasaq_constraint_17(lin_prog &LP, const size_t T, const size_t K,
   // Set bounds for a_j
   LP.add_row("(17)");
   LP.set_row_bnd(GLP_UP,0,1);
-  for (size_t  j = 1; j <= A[1].size(); j++)
+  for (size_t  j = 1; j <= A[0].size(); j++)
     LP.add_constraint("a", j, 1);
 }
 
 void set_pasaq_constraint_18(lin_prog &LP, const size_t T, const size_t K,
                              const vector<vector<double>> &A) {
-  for (size_t j = 1; j < A[1].size(); j++) {
+  for (size_t j = 1; j <= A[0].size(); j++) {
     LP.set_var_bnd("a", j, GLP_DB, 0, 1);
  }
 }
 
 void print_lp_result(int result) {
   // glp_write_lp(lp, NULL, "logs/log.txt");
-  cout << "MIP GLPK RESULT " << result << endl;
+  solver_log() << "MIP GLPK RESULT " << result << endl;
   switch (result) {
   case 0:
-    cout << "MILP SUCCESS" << endl;
+    solver_log() << "MILP SUCCESS" << endl;
     break;
   case GLP_EBOUND:
-    cout << "MILP EBOUND" << endl;
+    solver_log() << "MILP EBOUND" << endl;
     break;
   case GLP_EROOT:
-    cout << "MILP EROOT" << endl;
+    solver_log() << "MILP EROOT" << endl;
     break;
   case GLP_ENOPFS:
-    cout << "MILP ENOPFS" << endl;
+    solver_log() << "MILP ENOPFS" << endl;
     break;
   case GLP_ENODFS:
-    cout << "MILP ENODFS" << endl;
+    solver_log() << "MILP ENODFS" << endl;
     break;
   case GLP_EFAIL:
-    cout << "MILP EFAIL" << endl;
+    solver_log() << "MILP EFAIL" << endl;
     break;
   case GLP_EMIPGAP:
-    cout << "MILP EMIPGAP" << endl;
+    solver_log() << "MILP EMIPGAP" << endl;
     break;
   case GLP_ETMLIM:
-    cout << "MILP ETMLIM" << endl;
+    solver_log() << "MILP ETMLIM" << endl;
     break;
   case GLP_ESTOP:
-    cout << "MILP ESTOP" << endl;
+    solver_log() << "MILP ESTOP" << endl;
     break;
   default:
-    cout << "MILP: UNKOWN" << endl;
+    solver_log() << "MILP: UNKOWN" << endl;
     break;
   }  
 }
@@ -1,9 +1,14 @@
 #ifndef PASAQ_H
 #define PASAQ_H
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <utility>
 #include <vector>
 
+#include "lin_prog.h"
+
 using std::vector;
 using std::pair;
 
@@ -23,11 +28,428 @@ struct PayoffMatrix {
         P_a(attacker_penalty) {}
 };
 
-double q_i(const int i, const strategy &s, const double lambda);
+// Parameters of a PASAQ solve.
+struct SolverParams {
+  double epsilon; // Stop once U - L <= epsilon.
+  int num_res;    // Defender resources.
+  double lambda;  // Attacker rationality.
+  int K;          // Segments of the piecewise linearization.
+  double time_limit; // Wall clock budget of a binary search in seconds, 0
+                     // for none. The search stops early with certified
+                     // bounds once it runs out.
+  double mip_gap;    // Relative gap at which GLPK may stop a check, 0 to
+                     // solve each check exactly.
+  bool fill_branching; // Branch on fill levels and round relaxations into
+                       // incumbents, instead of GLPK's generic rules.
+  bool fill_cuts;      // Separate the cuts of add_pasaq_cuts at every node.
+  bool knapsack_cuts;
+  int threads; // Workers of one check's branch and bound, 1 for GLPK's own
+               // serial search.
+  int coarse_K; // Segments of the first bisection stage of
+                // MultiResolutionSolve, doubled each stage up to K; 0 to
+                // bisect at K throughout.
+  SolverParams()
+      : epsilon(0.5), num_res(5), lambda(0.5), K(5), time_limit(0),
+        mip_gap(0), fill_branching(true), fill_cuts(true),
+        knapsack_cuts(true), threads(1), coarse_K(0) {}
+};
+
+// Weights of the schedules (columns of A) with a non zero weight.
+typedef vector<pair<size_t, double>> ScheduleMixture;
+
+struct FeasibilityResult {
+  bool feasible;
+  bool decided;            // False if a limit stopped GLPK before it could
+                           // tell whether r is achievable.
+  bool certified;          // False if r was ruled out by a heuristic rather
+                           // than a bound (several attacker types).
+  strategy coverage;       // x_i, indexed by payoff slot.
+  ScheduleMixture mixture; // a_j, by column of A.
+
+  FeasibilityResult() : feasible(false), decided(true), certified(true) {}
+};
+
+/*
+ * Outcome of a binary search: lower is achieved by coverage and mixture,
+ * upper is known to be unachievable (or is the initial estimate) unless
+ * upper_certified is false. Both hold when a deadline stops the search
+ * before U - L <= epsilon.
+ */
+struct PasaqSolution {
+  double lower;
+  double upper;
+  bool upper_certified; // False if the check that set upper was not.
+  strategy coverage;
+  ScheduleMixture mixture;
+
+  PasaqSolution() : lower(0), upper(0), upper_certified(true) {}
+};
+
+// Expected attacker utility for attacking target i under strategy x.
+double U_a(const size_t i, const strategy &x, const PayoffMatrix &Pm);
+
+// Expected defender utility if target i is attacked under strategy x.
+double U_d(const size_t i, const strategy &x, const PayoffMatrix &Pm);
+
+// Quantal response probability that the attacker picks target i.
+double q_i(const size_t i, const strategy &s, const PayoffMatrix Pm,
+           const double lambda);
+
+// Expected defender utility against a quantal response attacker.
+double UD(const strategy &x, const PayoffMatrix &Pm, const double lambda);
+
+// Expected attacker utility.
+double UA(const strategy &x, const PayoffMatrix &Pm, const double lambda);
+
+// Initial [L, U] interval for the binary search.
+pair<double, double> EstimateBounds(int numRes, const PayoffMatrix &Pm,
+                                    const double lambda);
+
+/*
+ * Per target constants of the CF-OPT objective for one lambda and K: the
+ * (commonly scaled) theta_i, alpha_i, and the slopes of f1 and f2 on each of
+ * the K segments, stored at (i - 1) * K + (k - 1).
+ */
+struct PasaqTables {
+  double lambda;
+  int K;
+  // Scaling every theta_i by exp(-lambda * max_reward) keeps the sign of the
+  // objective, and keeps exp(lambda * R_a) from overflowing the LP.
+  double max_reward;
+  vector<double> theta;
+  vector<double> alpha;
+  vector<double> gamma;
+  vector<double> mu;
+};
+
+PasaqTables build_pasaq_tables(const PayoffMatrix &Pm, const double lambda,
+                               const int K);
+
+// Recompute the entries of target i after its payoffs changed. The largest
+// attacker reward must be unchanged, otherwise rebuild the tables.
+void update_pasaq_tables(PasaqTables &tables, const PayoffMatrix &Pm,
+                         const size_t i);
+
+/*
+ * Bound on how far the piecewise linear CF-OPT objective of tables, at
+ * utility r, can be from the exact one for any coverage:
+ * sum_i theta_i (|r - P_d_i| E1_i + |alpha_i| E2_i), where E1_i and E2_i
+ * bound the interpolation error of f1 and f2 over the K segments (by the
+ * second derivative, or the range of the function on a segment if that is
+ * smaller).
+ */
+double linearization_error(const PasaqTables &tables, const PayoffMatrix &Pm,
+                           const double r);
+
+/*
+ * How far to widen a bisection interval at r when moving from the
+ * linearization of coarse to that of fine (same payoffs and lambda). The
+ * objective grows with r at a slope of at least sum_i theta_i exp(-beta_i),
+ * so an objective error e moves the utility at which it crosses 0 by at
+ * most e over that slope: a coverage achieving r under coarse achieves
+ * r - padding under fine, and an r coarse rules out is ruled out at
+ * r + padding under fine.
+ */
+double linearization_padding(const PasaqTables &coarse,
+                             const PasaqTables &fine, const PayoffMatrix &Pm,
+                             const double r);
+
+/*
+ * Build the CF-OPT MILP for utility r into LP: variables x, z and a, the
+ * objective and constraints (11)-(18). A holds one row per payoff slot and one
+ * column per schedule; row 0 is unused.
+ */
+void build_pasaq_lp(lin_prog &LP, const double r, const int num_res,
+                    const PayoffMatrix &Pm, const vector<vector<double>> &A,
+                    const double lambda, const int K);
+
+/*
+ * Branch and bound on the structure of the CF-OPT MILP, for glp_intopt
+ * callbacks of an LP built by build_pasaq_lp with presolve off (both do
+ * nothing on a presolved problem). Constraints (13)-(14) fill the segments of
+ * a target left to right, so z_i1 >= ... >= z_iK (also added as rows) and
+ * their sum is the target's fill level.
+ *
+ * branch_on_fill_level, on GLP_IBRANCH, splits the fill level of one target:
+ * it branches on the first fractional z of the chain, so one child caps the
+ * level and the other raises it, instead of GLPK fixing a z in the middle of
+ * a chain that the LP then works around. The target with the most
+ * fractional level, weighted by the objective of its segment, goes first.
+ *
+ * round_fill_levels, on GLP_IHEUR, refills every target left to right up to
+ * the coverage of the node's relaxation. a is untouched, so (16) and (11)
+ * still hold and the result is integer feasible; it is offered with
+ * glp_ios_heur_sol. Returns whether GLPK took it as the new incumbent.
+ *
+ * N is the number of targets.
+ */
+void branch_on_fill_level(glp_tree *tree, const lin_prog &LP, const size_t N,
+                          const int K);
+bool round_fill_levels(glp_tree *tree, const lin_prog &LP, const size_t N,
+                       const int K);
+
+/*
+ * Cut separation for the CF-OPT MILP, on GLP_ICUTGEN (nothing on a presolved
+ * problem). Cuts violated by the node relaxation are added to GLPK's pool
+ * with glp_ios_add_row; all are globally valid, and counted in the stats.
+ *
+ * Fill cuts, x_{i,k+1} <= z_ik / K: a segment holds coverage only if the one
+ * before it is full. (14) only gives x_{i,k+1} <= z_ik, so a fractional z
+ * lets the relaxation spread coverage over the chain; summed with (16) the
+ * cuts bound the coverage sum_j A_ij a_j by (1 + sum_k z_ik) / K.
+ *
+ * Knapsack cuts over constraint (11): the full segments of a set C of
+ * targets cover sum_C sum_k z_ik / K <= sum_C sum_j A_ij a_j, which is at
+ * most num_res and, by (17), at most the best column sum of A over C. As the
+ * z are binary, the right hand side rounds down to
+ * floor(K min(num_res, max_j sum_C A_ij)). C is every target the relaxation
+ * fills, and each of them alone. With several teams, each has its own (17),
+ * so the best column sums of the teams add up.
+ *
+ * row16 is the row of constraint (16) for target 1; team_first holds the
+ * first a column (0 based) of each team.
+ */
+void add_pasaq_cuts(glp_tree *tree, const lin_prog &LP, const size_t N,
+                    const int K, const size_t row16, const int num_res,
+                    const bool fill, const bool knapsack,
+                    const vector<size_t> &team_first = vector<size_t>(1, 0));
+
+// Whether params use any of the callbacks above, which need presolve off.
+bool uses_pasaq_callbacks(const SolverParams &params);
+
+/*
+ * Split the CF-OPT MILP for lin_prog::run_parallel by fixing the fill levels
+ * (0 to K full segments) of the targets with the largest weight, as many as
+ * it takes to make at least count subproblems. Every integer solution has
+ * one fill level per target, so the subproblems cover the MILP without
+ * overlap. Higher levels come first.
+ *
+ * @param LP model built by build_pasaq_lp
+ * @param weight importance of each target, by payoff slot (slot 0 unused)
+ * @param K segments per target
+ * @param count subproblems wanted
+ */
+vector<Subproblem> fill_level_subproblems(const lin_prog &LP,
+                                          const vector<double> &weight,
+                                          const int K, const size_t count);
+
+/*
+ * Shared between a running binary search and other threads. The search
+ * publishes its progress here and gives up, inside branch and bound too, once
+ * cancelled is set; it then returns the interval proven so far.
+ */
+struct SolveControl {
+  std::atomic<bool> cancelled;
+  std::atomic<double> lower;
+  std::atomic<double> upper;
+  std::atomic<size_t> bisection_steps;
+  std::atomic<size_t> bnb_nodes; // Nodes of the MILP being solved.
+  SolveControl()
+      : cancelled(false), lower(0), upper(0), bisection_steps(0),
+        bnb_nodes(0) {}
+};
+
+/*
+ * An effectiveness matrix by column: the non zero (payoff slot, A_ij) pairs
+ * of each column, slots ascending. Instance files and checkpoints store A this
+ * way, so it is solved without a dense T x S copy.
+ */
+typedef vector<vector<pair<size_t, double>>> SparseColumns;
+
+/*
+ * One resource team's block of the effectiveness matrix: the sparse columns
+ * (target, A_ij) of the team's own schedule pool, and its resources. Teams
+ * share the coverage x through constraint (16) only. Each team has its own
+ * (17), so its schedule weights sum to at most 1, and its own share of (11),
+ * sum_i sum_j A_ij a_j <= resources over its columns.
+ */
+struct TeamBlock {
+  int resources;
+  SparseColumns columns;
+};
+
+/*
+ * A CF-OPT model kept alive between feasibility checks. The constraints only
+ * depend on A, K and the resources, so each check just rewrites the objective
+ * for its r; payoff and lambda changes only recompute the objective tables.
+ */
+class PasaqModel {
+private:
+  lin_prog LP;
+  PayoffMatrix Pm;
+  SolverParams params;
+  PasaqTables tables;
+  size_t S;
+  bool warm; // Seed each check with the previous check's MILP solution.
+  SolveControl *control;
+  size_t row16; // Row of constraint (16) for target 1.
+  vector<size_t> team_first; // First a column of each team, 0 based.
+  vector<int> team_resources;
+  size_t budget_row; // Row of team 0's share of (11), 0 for one team.
+
+public:
+  PasaqModel(const PayoffMatrix &Pm, const vector<vector<double>> &A,
+             const SolverParams &params);
+
+  // The same model from the columns of A, as one team with params.num_res.
+  PasaqModel(const PayoffMatrix &Pm, const SparseColumns &A,
+             const SolverParams &params);
+
+  /*
+   * A model over several resource teams, whose blocks are stacked as the
+   * columns of A in team order; mixtures index them that way. The resources
+   * of params are replaced by the teams' total. A single team gives the same
+   * model as its dense A.
+   */
+  PasaqModel(const PayoffMatrix &Pm, const vector<TeamBlock> &teams,
+             const SolverParams &params);
+
+  /*
+   * Copy the constraints of prototype into an independent GLPK problem, for
+   * other payoffs and parameters. The number of targets and K must match the
+   * prototype's.
+   */
+  PasaqModel(const PasaqModel &prototype, const PayoffMatrix &Pm,
+             const SolverParams &params);
+
+  // Replace the payoffs; the number of targets must not change.
+  void set_payoffs(const PayoffMatrix &Pm);
+
+  // Change the payoffs of target i only, patching just its objective tables
+  // unless the largest attacker reward changes.
+  void set_target_payoffs(const size_t i, const int d_reward,
+                          const int d_penalty, const int a_reward,
+                          const int a_penalty);
+
+  /*
+   * Replace column j of A (0 based) with column, given as (target, value)
+   * pairs; constraints (16) and (17), and the team's share of (11), are
+   * patched in place.
+   */
+  void set_schedule(const size_t j,
+                    const vector<pair<size_t, double>> &column);
+
+  // Append a schedule column to A (to the last team), returning its index.
+  size_t add_schedule(const vector<pair<size_t, double>> &column);
+
+  // Allow or forbid schedule j; a forbidden schedule has a_j fixed at 0.
+  void set_schedule_enabled(const size_t j, const bool enabled);
+
+  size_t num_schedules() const { return S; }
+  void set_lambda(const double lambda);
+  void set_resources(const int num_res);
+
+  // Change the resources of team t, and the total with them.
+  void set_team_resources(const size_t t, const int resources);
+  size_t num_teams() const { return team_first.size(); }
+  void set_epsilon(const double epsilon) { params.epsilon = epsilon; }
+  void set_limits(const double time_limit, const double mip_gap) {
+    params.time_limit = time_limit;
+    params.mip_gap = mip_gap;
+  }
+
+  /*
+   * Search each check's tree on threads threads with lin_prog::run_parallel,
+   * split by fill_level_subproblems on the targets with the most objective
+   * weight at the checked r. 1 keeps GLPK's serial search.
+   */
+  void set_threads(const int threads) { params.threads = threads; }
+
+  /*
+   * Offer the last MILP solution to GLPK as the incumbent of the next check.
+   * The constraints do not depend on r, lambda or the payoffs, so the previous
+   * solution stays feasible unless the resources went down.
+   */
+  void set_warm_start(const bool on);
+
+  // Report progress to and take cancellation from control (not owned), or
+  // nullptr for none.
+  void set_control(SolveControl *control) { this->control = control; }
+  SolveControl *get_control() const { return control; }
+
+  const SolverParams &get_params() const { return params; }
+  const PayoffMatrix &get_payoffs() const { return Pm; }
+
+  /*
+   * Solve CF-OPT for r. GLPK stops as soon as the sign of the optimum is
+   * known, or after time_limit seconds (0 for no limit).
+   */
+  FeasibilityResult check(const double r, const double time_limit = 0);
+};
+
+// Solve CF-OPT for r, returning whether r is achievable and the strategy.
+FeasibilityResult CheckFeasibility(const double r, const int num_res,
+                                   const PayoffMatrix &Pm,
+                                   const vector<vector<double>> &A,
+                                   const double K, double lambda);
 
 pair<double, vector<double>>
 BinarySearchMethod(const double e, const int numRes, const PayoffMatrix &Pm,
                    const vector<vector<double>> &A, const double lambda,
                    const double K);
 
+// The EstimateBounds interval with an all zero strategy at its lower end.
+PasaqSolution initial_solution(const SolverParams &params,
+                               const PayoffMatrix &Pm);
+
+/*
+ * Binary search starting from the interval (and incumbent strategy) of start
+ * instead of EstimateBounds. start.lower must be achievable and start.upper
+ * must bound the optimum. With params.coarse_K set below K this is
+ * MultiResolutionSolve.
+ */
+PasaqSolution BinarySearchSolve(const SolverParams &params,
+                                const PayoffMatrix &Pm,
+                                const vector<vector<double>> &A,
+                                const PasaqSolution &start);
+PasaqSolution BinarySearchSolve(const SolverParams &params,
+                                const PayoffMatrix &Pm, const SparseColumns &A,
+                                const PasaqSolution &start);
+
+/*
+ * Coarse to fine binary search. Bisection starts with params.coarse_K
+ * segments, whose MILPs have few binaries, and stops a stage once [L, U] is
+ * within a few paddings; the interval is then widened by
+ * linearization_padding and the next stage bisects with twice the segments,
+ * up to params.K, which runs to params.epsilon. Every stage's interval is
+ * certified for its own K, so the result has the guarantee of a plain
+ * search at K, with most of the expensive fine checks near convergence. A
+ * deadline carries over the stages; if it stops an early one the interval
+ * is still padded to K.
+ */
+PasaqSolution MultiResolutionSolve(const SolverParams &params,
+                                   const PayoffMatrix &Pm,
+                                   const vector<vector<double>> &A,
+                                   const PasaqSolution &start);
+PasaqSolution MultiResolutionSolve(const SolverParams &params,
+                                   const PayoffMatrix &Pm,
+                                   const SparseColumns &A,
+                                   const PasaqSolution &start);
+
+// Called with the search's state after every decided bisection step, such
+// as to checkpoint it; the interval and incumbent are certified as returned.
+typedef std::function<void(const PasaqSolution &)> BisectionStep;
+
+// Binary search on an existing model, using its parameters.
+PasaqSolution BinarySearchSolve(PasaqModel &model, const PasaqSolution &start,
+                                const BisectionStep &on_step = nullptr);
+
+// Feasibility check of a binary search: whether r is achievable, given a
+// budget in seconds for this check (0 for none). Without a deadline the
+// search ends at the first undecided check, so a check without a budget
+// should only be undecided when cancelled.
+typedef std::function<FeasibilityResult(double r, double time_limit)>
+    FeasibilityCheck;
+
+/*
+ * Binary search over any CF-OPT style check, with the epsilon, deadline and
+ * control handling of BinarySearchSolve. params.epsilon and
+ * params.time_limit are used; control and on_step may be nullptr.
+ */
+PasaqSolution BinarySearchSolve(const SolverParams &params,
+                                SolveControl *control,
+                                const FeasibilityCheck &check,
+                                const PasaqSolution &start,
+                                const BisectionStep &on_step = nullptr);
+
 #endif /* PASAQ_H */
@@ -0,0 +1,85 @@
+#include "async.h"
+
+#include <stdexcept>
+
+#include <glpk.h>
+
+SolveProgress SolveHandle::progress() const {
+  SolveProgress p;
+  p.started = state->started;
+  p.done = state->done;
+  p.cancelled = state->control.cancelled;
+  p.lower = state->control.lower;
+  p.upper = state->control.upper;
+  p.bisection_steps = state->control.bisection_steps;
+  p.bnb_nodes = state->control.bnb_nodes;
+  return p;
+}
+
+const SolveStats &SolveHandle::stats() const {
+  future.wait();
+  return state->stats;
+}
+
+SolveHandle
+AsyncSolver::submit(std::shared_ptr<const vector<vector<double>>> A,
+                    std::shared_ptr<const vector<PatrolSchedule>> schedules,
+                    const ProtectData &data, const SolverParams &params) {
+  SolveHandle handle;
+  handle.state = std::make_shared<SolveHandle::State>();
+  const PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                        data.d_penalties);
+  const PasaqSolution start = initial_solution(params, Pm);
+  handle.state->control.lower = start.lower;
+  handle.state->control.upper = start.upper;
+
+  auto state = handle.state;
+  handle.future =
+      pool.submit([state, A, schedules, data, Pm, params, start]() {
+        state->started = true;
+        set_solver_log(nullptr);
+        glp_term_out(GLP_OFF);
+        reset_stats();
+        PasaqSolution solution = start;
+        try {
+          if (!state->control.cancelled) {
+            const vector<vector<double>> built =
+                A ? vector<vector<double>>()
+                  : build_effectiveness_matrix(*schedules, data);
+            const vector<vector<double>> &matrix = A ? *A : built;
+            current_stats().num_targets = Pm.P_a.size();
+            current_stats().num_schedules =
+                matrix.empty() ? 0 : matrix[0].size();
+            PasaqModel model(Pm, matrix, params);
+            model.set_control(&state->control);
+            solution = BinarySearchSolve(model, start);
+          }
+        } catch (...) {
+          state->stats = current_stats();
+          reset_stats();
+          state->done = true;
+          throw;
+        }
+        state->stats = current_stats();
+        emit_stats();
+        state->done = true;
+        return solution;
+      }).share();
+  return handle;
+}
+
+SolveHandle
+AsyncSolver::submit(std::shared_ptr<const vector<vector<double>>> A,
+                    const ProtectData &data, const SolverParams &params) {
+  if (!A)
+    throw std::invalid_argument("no effectiveness matrix");
+  return submit(A, nullptr, data, params);
+}
+
+SolveHandle AsyncSolver::submit(const vector<PatrolSchedule> &schedules,
+                                const ProtectData &data,
+                                const SolverParams &params) {
+  return submit(nullptr,
+                std::make_shared<const vector<PatrolSchedule>>(schedules),
+                data, params);
+}
@@ -0,0 +1,100 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "PASAQ.h"
+#include "protect.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+// Snapshot of a solve's progress.
+struct SolveProgress {
+  bool started;
+  bool done;
+  bool cancelled;
+  double lower;           // Current certified interval [lower, upper].
+  double upper;
+  size_t bisection_steps; // Feasibility checks started so far.
+  size_t bnb_nodes;       // Branch and bound nodes of the current check.
+};
+
+/*
+ * Handle to a solve submitted to an AsyncSolver. Copies refer to the same
+ * solve. Cancelling stops the solve at its next branch and bound callback;
+ * its result is then the interval and strategy proven so far.
+ */
+class SolveHandle {
+private:
+  friend class AsyncSolver;
+
+  struct State {
+    SolveControl control;
+    std::atomic<bool> started;
+    std::atomic<bool> done;
+    SolveStats stats;
+    State() : started(false), done(false) {}
+  };
+
+  std::shared_ptr<State> state;
+  std::shared_future<PasaqSolution> future;
+
+public:
+  SolveProgress progress() const;
+
+  // Ask the solve to stop; a queued solve returns without solving.
+  void cancel() { state->control.cancelled = true; }
+
+  bool ready() const {
+    return future.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+
+  // Wait for the solution; rethrows exceptions of the solve.
+  const PasaqSolution &get() const { return future.get(); }
+
+  std::shared_future<PasaqSolution> result() const { return future; }
+
+  // Stats of the finished solve.
+  const SolveStats &stats() const;
+};
+
+/*
+ * Runs solves on a thread pool without blocking the caller. Solver messages
+ * and GLPK terminal output are off on the pool threads. The destructor waits
+ * for queued solves; cancel them first to return quickly.
+ */
+class AsyncSolver {
+private:
+  ThreadPool pool;
+
+  SolveHandle submit(std::shared_ptr<const vector<vector<double>>> A,
+                     std::shared_ptr<const vector<PatrolSchedule>> schedules,
+                     const ProtectData &data, const SolverParams &params);
+
+public:
+  /**
+   * @param threads concurrent solves; 0 uses the hardware concurrency
+   */
+  explicit AsyncSolver(size_t threads = 0) : pool(threads) {}
+
+  /**
+   * Queue a solve of an effectiveness matrix.
+   *
+   * @param A effectiveness matrix, shared with the caller
+   * @param data payoffs of the game
+   * @param params solver parameters, including any deadline
+   */
+  SolveHandle submit(std::shared_ptr<const vector<vector<double>>> A,
+                     const ProtectData &data,
+                     const SolverParams &params = SolverParams());
+
+  // Queue a solve of a schedule pool; the matrix is built on the pool.
+  SolveHandle submit(const vector<PatrolSchedule> &schedules,
+                     const ProtectData &data,
+                     const SolverParams &params = SolverParams());
+};
+
+#endif /* ASYNC_H */
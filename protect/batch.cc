@@ -0,0 +1,91 @@
+#include "batch.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include <glpk.h>
+
+#include "thread_pool.h"
+
+namespace {
+// Releases the calling thread's GLPK environment, however the scope is left.
+struct GlpkEnvGuard {
+  ~GlpkEnvGuard() { glp_free_env(); }
+};
+}
+
+vector<BatchResult> solve_batch(const vector<vector<double>> &A,
+                                const vector<BatchScenario> &scenarios,
+                                size_t threads) {
+  vector<BatchResult> results(scenarios.size());
+  if (scenarios.empty())
+    return results;
+  const size_t T = scenarios[0].payoffs.P_a.size();
+  for (const auto &scenario : scenarios)
+    if (scenario.payoffs.P_a.size() != T)
+      throw std::invalid_argument("batch scenarios have different targets");
+
+  // Prototype models are built once per K on this thread; workers only read
+  // them while copying.
+  std::map<int, std::unique_ptr<PasaqModel>> prototypes;
+  for (const auto &scenario : scenarios) {
+    auto &prototype = prototypes[scenario.params.K];
+    if (!prototype)
+      prototype.reset(
+          new PasaqModel(scenario.payoffs, A, scenario.params));
+  }
+
+  ThreadPool pool(std::min(threads, scenarios.size()));
+  std::atomic<size_t> next(0);
+  vector<std::future<void>> workers;
+  for (size_t w = 0; w < pool.size(); w++) {
+    workers.push_back(pool.submit([&]() {
+      GlpkEnvGuard env;
+      // Concurrent solves would interleave their progress on stdout.
+      set_solver_log(nullptr);
+      glp_term_out(GLP_OFF);
+      {
+        std::map<int, std::unique_ptr<PasaqModel>> models;
+        for (size_t n = next++; n < scenarios.size(); n = next++) {
+          const BatchScenario &scenario = scenarios[n];
+          reset_stats();
+          current_stats().num_targets = T;
+          current_stats().num_schedules = A.empty() ? 0 : A[0].size();
+          auto &model = models[scenario.params.K];
+          if (!model) {
+            model.reset(new PasaqModel(*prototypes[scenario.params.K],
+                                       scenario.payoffs, scenario.params));
+          } else {
+            model->set_payoffs(scenario.payoffs);
+            model->set_lambda(scenario.params.lambda);
+            model->set_resources(scenario.params.num_res);
+            model->set_epsilon(scenario.params.epsilon);
+            model->set_limits(scenario.params.time_limit,
+                              scenario.params.mip_gap);
+            model->set_threads(scenario.params.threads);
+          }
+          results[n].solution = BinarySearchSolve(
+              *model, initial_solution(scenario.params, scenario.payoffs));
+          results[n].stats = current_stats();
+          emit_stats();
+        }
+      }
+    }));
+  }
+  for (auto &worker : workers)
+    worker.get();
+  return results;
+}
+
+vector<BatchResult> solve_batch(const vector<PatrolSchedule> &schedules,
+                                const ProtectData &data,
+                                const vector<PayoffMatrix> &payoffs,
+                                const SolverParams &params, size_t threads) {
+  vector<BatchScenario> scenarios;
+  for (const auto &Pm : payoffs)
+    scenarios.push_back({Pm, params});
+  return solve_batch(build_effectiveness_matrix(schedules, data), scenarios,
+                     threads);
+}
@@ -0,0 +1,53 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <vector>
+
+#include "PASAQ.h"
+#include "protect.h"
+#include "stats.h"
+
+// One payoff scenario of a batch, with its own solver parameters.
+struct BatchScenario {
+  PayoffMatrix payoffs;
+  SolverParams params;
+};
+
+struct BatchResult {
+  PasaqSolution solution;
+  SolveStats stats; // Stats of this scenario's solve alone.
+};
+
+/**
+ * Solve many payoff scenarios of one patrol layout. The CF-OPT constraints
+ * only depend on the effectiveness matrix, K and the resources, so one model
+ * is built per K and every worker thread solves its scenarios on its own copy
+ * of it, rewriting only the objective and the resource bound.
+ *
+ * @param A effectiveness matrix shared by all scenarios
+ * @param scenarios payoffs and parameters; all payoffs have the same targets
+ * @param threads worker threads; 0 uses the hardware concurrency
+ *
+ * @return one result per scenario, in order
+ */
+vector<BatchResult> solve_batch(const vector<vector<double>> &A,
+                                const vector<BatchScenario> &scenarios,
+                                size_t threads = 0);
+
+/**
+ * Batch solve for a layout given as schedules, with the same parameters for
+ * every payoff matrix. The payoffs in data are ignored.
+ *
+ * @param schedules schedule pool, see generate_compact_strategies
+ * @param data patrol areas and activities
+ * @param payoffs payoff scenarios
+ * @param params solver parameters of every scenario
+ * @param threads worker threads; 0 uses the hardware concurrency
+ */
+vector<BatchResult> solve_batch(const vector<PatrolSchedule> &schedules,
+                                const ProtectData &data,
+                                const vector<PayoffMatrix> &payoffs,
+                                const SolverParams &params = SolverParams(),
+                                size_t threads = 0);
+
+#endif /* BATCH_H */
@@ -0,0 +1,309 @@
+#include "bayesian.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glpk.h>
+#include <stdexcept>
+#include <string>
+
+#include "stats.h"
+
+using std::endl;
+
+double BayesianUD(const strategy &x, const vector<AttackerType> &types) {
+  double total = 0;
+  double utility = 0;
+  for (const auto &type : types) {
+    total += type.prior;
+    utility += type.prior * UD(x, type.Pm, type.lambda);
+  }
+  return total > 0 ? utility / total : 0;
+}
+
+BayesianPasaqModel::BayesianPasaqModel(const vector<AttackerType> &types,
+                                       const vector<vector<double>> &A,
+                                       const SolverParams &params)
+    : LP("Bayesian CF-OPT"), types(types), params(params),
+      S(A.empty() ? 0 : A[0].size()), control(nullptr), max_rounds(8) {
+  if (types.empty())
+    throw std::invalid_argument("a Bayesian game needs an attacker type");
+  double total = 0;
+  for (const auto &type : types) {
+    if (!(type.prior > 0))
+      throw std::invalid_argument("attacker type priors must be positive");
+    if (type.Pm.P_a.size() != types[0].Pm.P_a.size())
+      throw std::invalid_argument("attacker types have different targets");
+    total += type.prior;
+  }
+  for (auto &type : this->types)
+    type.prior /= total;
+
+  // The objective of the first type is replaced by every check.
+  build_pasaq_lp(LP, 0, params.num_res, types[0].Pm, A, types[0].lambda,
+                 params.K);
+  LP.set_presolve(!uses_pasaq_callbacks(params));
+  for (const auto &type : this->types) {
+    tables.push_back(build_pasaq_tables(type.Pm, type.lambda, params.K));
+    // Start from the weights of the empty coverage.
+    double denominator = 0;
+    for (const double theta : tables.back().theta)
+      denominator += theta;
+    weights.push_back(type.prior / denominator);
+  }
+}
+
+void BayesianPasaqModel::set_resources(const int num_res) {
+  params.num_res = num_res;
+  // Constraint (11) is the first row.
+  LP.set_row_bnd(1, GLP_UP, 0, num_res);
+}
+
+void BayesianPasaqModel::set_max_rounds(const size_t rounds) {
+  max_rounds = std::max<size_t>(1, rounds);
+}
+
+void BayesianPasaqModel::set_objective(const double r) {
+  const size_t T = types[0].Pm.P_a.size();
+  const int K = params.K;
+  vector<double> coef((T - 1) * K, 0);
+  double constant = 0;
+  for (size_t t = 0; t < types.size(); t++) {
+    const PayoffMatrix &Pm = types[t].Pm;
+    const PasaqTables &tab = tables[t];
+    const double w = weights[t];
+    // f1(0) = 1 and f2(0) = 0, as in the single type objective.
+    for (size_t i = 0; i < T; i++)
+      constant += w * tab.theta[i] * (r - Pm.P_d[i]);
+    for (size_t i = 1; i < T; i++) {
+      const double c = tab.theta[i] * (r - Pm.P_d[i]);
+      const double d = tab.theta[i] * tab.alpha[i];
+      for (int k = 0; k < K; k++) {
+        const size_t ik = (i - 1) * K + k;
+        coef[ik] += w * (c * tab.gamma[ik] - d * tab.mu[ik]);
+      }
+    }
+  }
+  LP.set_min();
+  LP.set_objective_const(constant);
+  for (size_t n = 0; n < coef.size(); n++)
+    LP.set_objective_var("x", n + 1, coef[n]);
+}
+
+double BayesianPasaqModel::type_utility(const size_t t,
+                                        const vector<double> &x_ik,
+                                        double &denominator) const {
+  const PayoffMatrix &Pm = types[t].Pm;
+  const PasaqTables &tab = tables[t];
+  const size_t T = Pm.P_a.size();
+  const int K = params.K;
+  double numerator = 0;
+  denominator = 0;
+  for (size_t i = 0; i < T; i++) {
+    double f1 = 1;
+    double f2 = 0;
+    if (i > 0) {
+      for (int k = 0; k < K; k++) {
+        const size_t ik = (i - 1) * K + k;
+        f1 += tab.gamma[ik] * x_ik[ik];
+        f2 += tab.mu[ik] * x_ik[ik];
+      }
+    }
+    denominator += tab.theta[i] * f1;
+    numerator += tab.theta[i] * (Pm.P_d[i] * f1 + tab.alpha[i] * f2);
+  }
+  return numerator / denominator;
+}
+
+namespace {
+struct CheckInfo {
+  SolveControl *control;
+  bool exact; // One type: a bound above 0 settles the check.
+  const lin_prog *LP;
+  size_t N;
+  int K;
+  size_t row16;
+  const SolverParams *params;
+  bool stop_at_incumbent; // Stop at the first incumbent at or below 0.
+  bool at_incumbent;      // The callback stopped the run at one.
+};
+}
+
+/*
+ * Branch and bound callback. An incumbent at or below 0 is worth checking
+ * against the true ratios at once; a bound above 0 only rules r out when
+ * there is a single type, otherwise the optimum is needed to re-weight.
+ */
+static void bayesian_callback(glp_tree *tree, void *info) {
+  CheckInfo *check = static_cast<CheckInfo *>(info);
+  if (check->control != nullptr) {
+    int active, nodes, total;
+    glp_ios_tree_size(tree, &active, &nodes, &total);
+    check->control->bnb_nodes = total;
+    if (check->control->cancelled) {
+      glp_ios_terminate(tree);
+      return;
+    }
+  }
+  const int reason = glp_ios_reason(tree);
+  const SolverParams &params = *check->params;
+  if (reason == GLP_ICUTGEN) {
+    add_pasaq_cuts(tree, *check->LP, check->N, check->K, check->row16,
+                   params.num_res, params.fill_cuts, params.knapsack_cuts);
+  } else if (params.fill_branching && reason == GLP_IBRANCH) {
+    branch_on_fill_level(tree, *check->LP, check->N, check->K);
+  } else if (params.fill_branching && reason == GLP_IHEUR &&
+             round_fill_levels(tree, *check->LP, check->N, check->K) &&
+             check->stop_at_incumbent &&
+             glp_mip_obj_val(glp_ios_get_prob(tree)) <= 0) {
+    check->at_incumbent = true;
+    glp_ios_terminate(tree);
+    return;
+  }
+  if (reason == GLP_IBINGO && check->stop_at_incumbent &&
+      glp_get_obj_val(glp_ios_get_prob(tree)) <= 0) {
+    check->at_incumbent = true;
+    glp_ios_terminate(tree);
+    return;
+  }
+  const int best = glp_ios_best_node(tree);
+  if (check->exact && best != 0 && glp_ios_node_bound(tree, best) > 0)
+    glp_ios_terminate(tree);
+}
+
+FeasibilityResult BayesianPasaqModel::check(const double r,
+                                            const double time_limit) {
+  ScopedTimer timer("check_feasibility");
+  typedef std::chrono::steady_clock clock;
+  const auto start = clock::now();
+  const size_t T = types[0].Pm.P_a.size();
+  const int K = params.K;
+  solver_log() << "BayesianCheck(" << r << ");" << endl;
+  FeasibilityResult result;
+  result.coverage = vector<double>(T);
+
+  // Constraint (17) is the last row, after one row (16) per target.
+  CheckInfo info = {control, types.size() == 1, &LP, T - 1, K,
+                    LP.num_rows() - (T - 1), &params, true, false};
+  const size_t rounds = time_limit > 0 ? max_rounds : 8 * max_rounds;
+  size_t round = 0;
+  for (; round < rounds; round++) {
+    set_objective(r);
+    info.at_incumbent = false;
+    glp_iocp parm;
+    glp_init_iocp(&parm);
+    parm.cb_func = &bayesian_callback;
+    parm.cb_info = &info;
+    if (control != nullptr)
+      control->bnb_nodes = 0;
+    if (params.mip_gap > 0)
+      parm.mip_gap = params.mip_gap;
+    if (time_limit > 0) {
+      const double left =
+          time_limit -
+          std::chrono::duration<double>(clock::now() - start).count();
+      if (left <= 0) {
+        result.decided = false;
+        break;
+      }
+      parm.tm_lim = std::max(1, static_cast<int>(left * 1000));
+    }
+    const int ret = LP.run(&parm);
+    const int status = LP.get_status();
+    const bool stopped =
+        ret == GLP_ESTOP || ret == GLP_ETMLIM || ret == GLP_EMIPGAP;
+    if ((ret != 0 && !stopped) || (status != GLP_OPT && status != GLP_FEAS)) {
+      // Without an incumbent only the bound can settle r, and only for one
+      // type.
+      if (stopped && (!info.exact || LP.get_best_bound() <= 0))
+        result.decided = false;
+      break;
+    }
+    // The constraints do not depend on r or the weights.
+    LP.set_mip_start(LP.get_solution());
+
+    vector<double> x_ik((T - 1) * K);
+    for (size_t n = 0; n < x_ik.size(); n++)
+      x_ik[n] = LP.get_var_val("x", n + 1);
+    double utility = 0;
+    vector<double> next(types.size());
+    for (size_t t = 0; t < types.size(); t++) {
+      double denominator;
+      utility += types[t].prior * type_utility(t, x_ik, denominator);
+      next[t] = types[t].prior / denominator;
+    }
+    solver_log() << "round " << round << ": obj value = " << LP.get_obj_val()
+                 << ", utility = " << utility << endl;
+
+    if (utility >= r - 1e-9 * std::max(1.0, std::fabs(r))) {
+      result.feasible = true;
+      for (size_t i = 1; i < T; i++)
+        for (int k = 0; k < K; k++)
+          result.coverage[i] += x_ik[(i - 1) * K + k];
+      for (size_t j = 1; j <= S; j++) {
+        const double a = LP.get_var_val("a", j);
+        if (a > 1e-9)
+          result.mixture.emplace_back(j - 1, a);
+      }
+      break;
+    }
+    // An incumbent the callback stopped at only re-weights the next round;
+    // a time or gap limit (or a cancel) leaves r open. With one type a bound
+    // above 0 still rules r out.
+    if (stopped && (info.exact || !info.at_incumbent)) {
+      if (!info.exact || LP.get_best_bound() <= 0)
+        result.decided = false;
+      break;
+    }
+    if (info.exact)
+      break;
+
+    // Stop once the weights settle: the optimum for them does not reach r.
+    // If this round stopped at an incumbent, solve the settled weights to
+    // optimality before ruling r out.
+    double change = 0;
+    for (size_t t = 0; t < types.size(); t++)
+      change = std::max(change, std::fabs(next[t] - weights[t]) / weights[t]);
+    weights = std::move(next);
+    if (change < 1e-6) {
+      if (!info.at_incumbent) {
+        result.certified = false;
+        break;
+      }
+      info.stop_at_incumbent = false;
+    }
+  }
+  // Out of rounds before the weights settled: r is neither shown nor ruled
+  // out. Without a deadline an undecided check would end the search, so
+  // rule r out, uncertified, and keep bisecting.
+  if (round == rounds) {
+    if (time_limit > 0)
+      result.decided = false;
+    else
+      result.certified = false;
+  }
+  if (control != nullptr && control->cancelled)
+    result.decided = false;
+  if (!result.decided)
+    current_stats().undecided_checks++;
+  return result;
+}
+
+PasaqSolution BayesianSolve(const vector<AttackerType> &types,
+                            const vector<vector<double>> &A,
+                            const SolverParams &params) {
+  BayesianPasaqModel model(types, A, params);
+  PasaqSolution start;
+  start.lower = types[0].Pm.P_d.empty() ? 0 : types[0].Pm.P_d[0];
+  start.upper = start.lower;
+  for (const auto &type : types) {
+    const auto bounds = EstimateBounds(params.num_res, type.Pm, type.lambda);
+    start.lower = std::min(start.lower, bounds.first);
+    start.upper = std::max(start.upper, bounds.second);
+  }
+  start.coverage = vector<double>(types[0].Pm.P_a.size(), 0);
+  return BinarySearchSolve(
+      params, model.get_control(),
+      [&model](double r, double budget) { return model.check(r, budget); },
+      start);
+}
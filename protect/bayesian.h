@@ -0,0 +1,109 @@
+#ifndef BAYESIAN_H
+#define BAYESIAN_H
+
+#include <vector>
+
+#include "PASAQ.h"
+#include "lin_prog.h"
+
+// One attacker type of a Bayesian game, met with probability prior.
+struct AttackerType {
+  double prior;
+  PayoffMatrix Pm; // Payoffs against this type, for both players.
+  double lambda;   // Rationality of this type.
+  AttackerType(const double prior, const PayoffMatrix &Pm, const double lambda)
+      : prior(prior), Pm(Pm), lambda(lambda) {}
+};
+
+/**
+ * Expected defender utility against a mix of quantal response attackers: the
+ * prior weighted UD of every type.
+ *
+ * @param x coverage, indexed by payoff slot
+ * @param types attacker types
+ */
+double BayesianUD(const strategy &x, const vector<AttackerType> &types);
+
+/*
+ * CF-OPT for several attacker types that share one coverage. The variables
+ * x, z and a and constraints (11)-(18) are declared once, for every type; a
+ * type only adds its piecewise linear terms to the objective coefficients of
+ * the shared x, so the MILP has the size of a single type game.
+ *
+ * With N_t and D_t the linearized numerator and denominator of type t's
+ * utility, r is achievable iff sum_t p_t N_t / D_t >= r. A sum of ratios has
+ * no single linear form, so a check minimizes sum_t w_t (r D_t - N_t) with
+ * w_t = p_t / D_t taken at the last strategy found, and re-weights until a
+ * strategy reaching r turns up or the weights settle (a Dinkelbach style
+ * iteration). Lower bounds stay certified by the strategy that reaches them;
+ * with more than one type a check that rules r out is only as good as that
+ * iteration and says so with certified = false. With one type a check is
+ * exactly PasaqModel::check.
+ */
+class BayesianPasaqModel {
+private:
+  lin_prog LP;
+  vector<AttackerType> types;
+  vector<PasaqTables> tables;
+  vector<double> weights; // w_t, refreshed after every MILP.
+  SolverParams params;    // lambda is unused, each type has its own.
+  size_t S;
+  SolveControl *control;
+  size_t max_rounds; // MILPs per check at most.
+
+  // Write sum_t w_t (r D_t - N_t) as the objective.
+  void set_objective(const double r);
+
+  // Linearized utility of type t under the MILP's x, also returning D_t.
+  double type_utility(const size_t t, const vector<double> &x_ik,
+                      double &denominator) const;
+
+public:
+  /**
+   * Build the shared model.
+   *
+   * @param types attacker types; every type must have the same targets and a
+   * positive prior, the priors are normalized to sum to 1
+   * @param A effectiveness matrix, one row per payoff slot
+   * @param params resources, K, epsilon and limits of the solve
+   */
+  BayesianPasaqModel(const vector<AttackerType> &types,
+                     const vector<vector<double>> &A,
+                     const SolverParams &params);
+
+  const vector<AttackerType> &get_types() const { return types; }
+  const SolverParams &get_params() const { return params; }
+  void set_resources(const int num_res);
+  void set_control(SolveControl *control) { this->control = control; }
+  SolveControl *get_control() const { return control; }
+
+  // Bound the MILPs one check may solve while re-weighting (at least 1).
+  // Without a time limit a check gets eight times as many; if it still runs
+  // out before the weights settle it rules r out, uncertified, so the search
+  // goes on. With a time limit it is undecided instead.
+  void set_max_rounds(const size_t rounds);
+
+  /**
+   * Whether the prior weighted, linearized utility r is achievable.
+   *
+   * @param r defender utility
+   * @param time_limit seconds for the whole check, 0 for none
+   */
+  FeasibilityResult check(const double r, const double time_limit = 0);
+};
+
+/**
+ * Binary search for the best coverage against all types at once. The
+ * initial interval spans every type's penalties and rewards. With more than
+ * one type the returned upper bound may rest on the re-weighting alone, in
+ * which case upper_certified is false.
+ *
+ * @param types attacker types
+ * @param A effectiveness matrix
+ * @param params resources, K, epsilon and limits; lambda is ignored
+ */
+PasaqSolution BayesianSolve(const vector<AttackerType> &types,
+                            const vector<vector<double>> &A,
+                            const SolverParams &params);
+
+#endif /* BAYESIAN_H */
@@ -0,0 +1,297 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glpk.h>
+
+#include "../PASAQ.h"
+#include "../batch.h"
+#include "../lin_prog.h"
+#include "../protect.h"
+#include "../protect_graph.h"
+#include "../stats.h"
+#include "instance_gen.h"
+
+/*
+ * Benchmark driver. `bench micro` times the individual kernels on one
+ * generated instance, `bench sweep` runs the whole pipeline over a grid of
+ * instance sizes and `bench batch` solves payoff scenarios of one layout with
+ * different numbers of threads. All write CSV to stdout; solver chatter is
+ * discarded.
+ */
+
+// Discards everything written to it.
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+};
+
+struct BenchOptions {
+  InstanceParams params;
+  vector<int> targets;  // Sweep: target counts.
+  vector<int> times;    // Sweep: time horizons.
+  int area_size;        // Sweep: targets per patrol area.
+  double min_seconds;   // Micro: minimum measured time per kernel.
+  int scenarios;        // Batch: payoff scenarios.
+  vector<int> threads;  // Batch: thread counts.
+  BenchOptions() : targets({10, 20, 40}), times({4, 6}), area_size(5),
+                   min_seconds(0.2), scenarios(16), threads({1, 2, 4}) {}
+};
+
+/*
+ * Run f until min_seconds have passed, doubling the batch size, and return the
+ * average seconds per call together with the number of calls.
+ */
+template <typename F>
+pair<double, size_t> time_kernel(F f, const double min_seconds) {
+  size_t batch = 1;
+  size_t calls = 0;
+  double elapsed = 0;
+  while (elapsed < min_seconds) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < batch; i++)
+      f();
+    const std::chrono::duration<double> d =
+        std::chrono::steady_clock::now() - start;
+    elapsed += d.count();
+    calls += batch;
+    batch *= 2;
+  }
+  return {elapsed / calls, calls};
+}
+
+void print_micro_row(std::ostream &csv, const string &name,
+                     const InstanceParams &params, size_t schedules,
+                     const pair<double, size_t> &timing) {
+  csv << name << "," << params.num_targets << "," << params.num_areas << ","
+      << params.num_activities << "," << params.time_horizon << ","
+      << schedules << "," << timing.second << "," << timing.first << std::endl;
+}
+
+void run_micro(std::ostream &csv, const BenchOptions &opts) {
+  const InstanceParams &params = opts.params;
+  const Instance instance = generate_instance(params);
+  const ProtectData &data = instance.data;
+  const double lambda = 0.5;
+  const int K = 5;
+  const int num_res = 5;
+
+  csv << "kernel,targets,areas,activities,time,schedules,calls,seconds_per_call"
+      << std::endl;
+
+  vector<PatrolSchedule> schedules;
+  auto timing = time_kernel(
+      [&]() { schedules = generate_compact_strategies(params.time_horizon,
+                                                      data); },
+      opts.min_seconds);
+  print_micro_row(csv, "enumerate", params, schedules.size(), timing);
+
+  vector<PatrolSchedule> reduced;
+  timing = time_kernel(
+      [&]() {
+        reduced = schedules;
+        reduce_schedules(reduced);
+      },
+      opts.min_seconds);
+  print_micro_row(csv, "reduce", params, reduced.size(), timing);
+
+  vector<vector<double>> A;
+  timing = time_kernel([&]() { A = build_effectiveness_matrix(reduced, data); },
+                       opts.min_seconds);
+  print_micro_row(csv, "matrix_build", params, reduced.size(), timing);
+
+  const PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                        data.d_penalties);
+  strategy x(data.a_penalties.size(), 0);
+  for (size_t i = 1; i < x.size(); i++)
+    x[i] = static_cast<double>(i % 7) / 7.0;
+
+  volatile double sink = 0;
+  timing = time_kernel([&]() { sink = q_i(1, x, Pm, lambda); },
+                       opts.min_seconds);
+  print_micro_row(csv, "q_i", params, reduced.size(), timing);
+
+  timing = time_kernel([&]() { sink = UD(x, Pm, lambda); }, opts.min_seconds);
+  print_micro_row(csv, "UD", params, reduced.size(), timing);
+
+  timing = time_kernel(
+      [&]() {
+        lin_prog LP("bench");
+        build_pasaq_lp(LP, 0, num_res, Pm, A, lambda, K);
+      },
+      opts.min_seconds);
+  print_micro_row(csv, "lp_build", params, reduced.size(), timing);
+
+  timing = time_kernel(
+      [&]() {
+        sink = paths_length(0, 3, instance.adjacency).size();
+      },
+      opts.min_seconds);
+  print_micro_row(csv, "paths_length", params, reduced.size(), timing);
+  (void)sink;
+}
+
+void run_sweep(std::ostream &csv, const BenchOptions &opts) {
+  csv << "targets,areas,activities,time,schedules,bisection_steps,mip_solves,"
+         "bnb_nodes,simplex_iterations,enumerate_s,reduce_s,matrix_build_s,"
+         "model_build_s,lin_prog_run_s,total_s"
+      << std::endl;
+  for (const int targets : opts.targets) {
+    for (const int time : opts.times) {
+      InstanceParams params = opts.params;
+      params.num_targets = targets;
+      params.num_areas = std::max(1, targets / opts.area_size);
+      params.time_horizon = time;
+      const Instance instance = generate_instance(params);
+
+      const auto start = std::chrono::steady_clock::now();
+      reset_stats();
+      auto schedules = generate_compact_strategies(time, instance.data);
+      reduce_schedules(schedules);
+      create_strategy(schedules, instance.data);
+      const std::chrono::duration<double> total =
+          std::chrono::steady_clock::now() - start;
+
+      const SolveStats &stats = last_stats();
+      csv << targets << "," << params.num_areas << "," << params.num_activities
+          << "," << time << "," << stats.num_schedules << ","
+          << stats.bisection_steps << "," << stats.mip_solves << ","
+          << stats.bnb_nodes << "," << stats.simplex_iterations << ","
+          << stats.time_of("enumerate") << "," << stats.time_of("reduce")
+          << "," << stats.time_of("matrix_build") << ","
+          << stats.time_of("model_build") << ","
+          << stats.time_of("lin_prog_run") << "," << total.count()
+          << std::endl;
+    }
+  }
+}
+
+void run_batch(std::ostream &csv, const BenchOptions &opts) {
+  csv << "targets,schedules,scenarios,threads,mip_solves,total_s" << std::endl;
+  const Instance instance = generate_instance(opts.params);
+  auto schedules =
+      generate_compact_strategies(opts.params.time_horizon, instance.data);
+  reduce_schedules(schedules);
+  // Same layout, payoffs redrawn with a different seed per scenario.
+  vector<PayoffMatrix> payoffs;
+  for (int n = 0; n < opts.scenarios; n++) {
+    InstanceParams params = opts.params;
+    params.seed = opts.params.seed + n;
+    const ProtectData data = generate_instance(params).data;
+    payoffs.emplace_back(data.a_rewards, data.a_penalties, data.d_rewards,
+                         data.d_penalties);
+  }
+  for (const int threads : opts.threads) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto results =
+        solve_batch(schedules, instance.data, payoffs, SolverParams(),
+                    std::max(1, threads));
+    const std::chrono::duration<double> total =
+        std::chrono::steady_clock::now() - start;
+    size_t mip_solves = 0;
+    for (const auto &result : results)
+      mip_solves += result.stats.mip_solves;
+    csv << opts.params.num_targets << "," << schedules.size() << ","
+        << opts.scenarios << "," << threads << "," << mip_solves << ","
+        << total.count() << std::endl;
+  }
+}
+
+vector<int> parse_list(const char *arg) {
+  vector<int> result;
+  std::stringstream ss(arg);
+  string item;
+  while (std::getline(ss, item, ','))
+    result.push_back(std::atoi(item.c_str()));
+  return result;
+}
+
+void usage() {
+  std::cerr
+      << "usage: bench micro|sweep|batch [options]\n"
+         "  --targets N[,N...]   targets (micro uses the first)\n"
+         "  --areas N            patrol areas (micro)\n"
+         "  --area-size N        targets per area (sweep)\n"
+         "  --activities N       defender activities\n"
+         "  --time N[,N...]      time horizons (micro uses the first)\n"
+         "  --overlap N          targets shared by neighbouring areas\n"
+         "  --density D          area adjacency probability\n"
+         "  --payoffs uniform|correlated|zero_sum\n"
+         "  --seed N             random seed\n"
+         "  --min-time S         seconds per micro benchmark\n"
+         "  --scenarios N        payoff scenarios (batch)\n"
+         "  --threads N[,N...]   thread counts (batch)\n";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+  const string mode = argv[1];
+  BenchOptions opts;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    const string flag = argv[i];
+    const char *value = argv[i + 1];
+    if (flag == "--targets") {
+      opts.targets = parse_list(value);
+    } else if (flag == "--areas") {
+      opts.params.num_areas = std::atoi(value);
+    } else if (flag == "--area-size") {
+      opts.area_size = std::max(1, std::atoi(value));
+    } else if (flag == "--activities") {
+      opts.params.num_activities = std::atoi(value);
+    } else if (flag == "--time") {
+      opts.times = parse_list(value);
+    } else if (flag == "--overlap") {
+      opts.params.area_overlap = std::atoi(value);
+    } else if (flag == "--density") {
+      opts.params.graph_density = std::atof(value);
+    } else if (flag == "--payoffs") {
+      const string p = value;
+      opts.params.payoffs = p == "zero_sum"     ? PayoffDistribution::ZERO_SUM
+                            : p == "correlated" ? PayoffDistribution::CORRELATED
+                                                : PayoffDistribution::UNIFORM;
+    } else if (flag == "--seed") {
+      opts.params.seed = std::atoi(value);
+    } else if (flag == "--min-time") {
+      opts.min_seconds = std::atof(value);
+    } else if (flag == "--scenarios") {
+      opts.scenarios = std::atoi(value);
+    } else if (flag == "--threads") {
+      opts.threads = parse_list(value);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (opts.targets.empty() || opts.times.empty()) {
+    usage();
+    return 1;
+  }
+  opts.params.num_targets = opts.targets[0];
+  opts.params.time_horizon = opts.times[0];
+
+  // Keep the CSV on stdout and silence the solver's progress output.
+  std::ostream csv(std::cout.rdbuf());
+  NullBuffer null_buffer;
+  std::streambuf *stdout_buffer = std::cout.rdbuf(&null_buffer);
+  glp_term_out(GLP_OFF);
+
+  int ret = 0;
+  if (mode == "micro") {
+    run_micro(csv, opts);
+  } else if (mode == "sweep") {
+    run_sweep(csv, opts);
+  } else if (mode == "batch") {
+    run_batch(csv, opts);
+  } else {
+    usage();
+    ret = 1;
+  }
+  std::cout.rdbuf(stdout_buffer);
+  return ret;
+}
@@ -0,0 +1,73 @@
+#include "instance_gen.h"
+
+#include <algorithm>
+#include <random>
+
+InstanceParams::InstanceParams()
+    : num_targets(20), num_areas(5), num_activities(2), time_horizon(10),
+      area_overlap(1), graph_density(0.3), payoffs(PayoffDistribution::UNIFORM),
+      min_payoff(5), max_payoff(30), seed(1) {}
+
+Instance generate_instance(const InstanceParams &params) {
+  Instance instance;
+  ProtectData &data = instance.data;
+  std::mt19937 gen(params.seed);
+  std::uniform_int_distribution<int> payoff(params.min_payoff,
+                                            params.max_payoff);
+
+  // Split targets 1..num_targets into num_areas contiguous ranges, stretching
+  // each by area_overlap into the next one.
+  const int T = params.num_targets;
+  const int areas = std::max(1, params.num_areas);
+  for (int a = 0; a < areas; a++) {
+    const int first = 1 + (a * T) / areas;
+    const int last = std::min(T, ((a + 1) * T) / areas + params.area_overlap);
+    PatrolArea area;
+    area.insert(first, last);
+    data.PatrolAreas.push_back(area);
+  }
+
+  std::bernoulli_distribution edge(params.graph_density);
+  instance.adjacency.resize(areas);
+  for (int a = 0; a < areas; a++) {
+    for (int b = a + 1; b < areas; b++) {
+      if (edge(gen)) {
+        instance.adjacency[a].push_back(b);
+        instance.adjacency[b].push_back(a);
+      }
+    }
+  }
+
+  // Activity k takes k + 1 time units and is more effective the longer it
+  // takes.
+  const int K = std::max(1, params.num_activities);
+  for (int k = 0; k < K; k++) {
+    const double effectiveness = 0.25 + 0.75 * (k + 1) / static_cast<double>(K);
+    data.activities.push_back({k + 1, k + 1, effectiveness});
+  }
+
+  // Slot 0 is unused by the solver and gets zero payoffs.
+  data.d_rewards.assign(T + 1, 0);
+  data.d_penalties.assign(T + 1, 0);
+  data.a_rewards.assign(T + 1, 0);
+  data.a_penalties.assign(T + 1, 0);
+  for (int t = 1; t <= T; t++) {
+    data.d_rewards[t] = payoff(gen);
+    data.d_penalties[t] = -payoff(gen);
+    switch (params.payoffs) {
+    case PayoffDistribution::UNIFORM:
+      data.a_rewards[t] = payoff(gen);
+      data.a_penalties[t] = -payoff(gen);
+      break;
+    case PayoffDistribution::CORRELATED:
+      data.a_rewards[t] = data.d_rewards[t];
+      data.a_penalties[t] = -payoff(gen);
+      break;
+    case PayoffDistribution::ZERO_SUM:
+      data.a_rewards[t] = -data.d_penalties[t];
+      data.a_penalties[t] = -data.d_rewards[t];
+      break;
+    }
+  }
+  return instance;
+}
@@ -0,0 +1,47 @@
+#ifndef INSTANCE_GEN_H
+#define INSTANCE_GEN_H
+
+#include <vector>
+
+#include "../protect.h"
+
+// How target payoffs are drawn.
+enum class PayoffDistribution {
+  UNIFORM,    // Rewards and penalties drawn independently.
+  CORRELATED, // Attacker reward tracks the defender's reward.
+  ZERO_SUM    // Attacker payoffs are the negated defender payoffs.
+};
+
+/*
+ * Parameters of a synthetic PROTECT instance. Patrol areas are contiguous
+ * target ranges, as in the SBU map, that overlap their neighbours by
+ * area_overlap targets.
+ */
+struct InstanceParams {
+  int num_targets;      // Targets, not counting the unused slot 0.
+  int num_areas;        // Patrol areas.
+  int num_activities;   // Defender activities.
+  int time_horizon;     // Time units available to a schedule.
+  int area_overlap;     // Targets shared by consecutive areas.
+  double graph_density; // Probability that two areas are adjacent.
+  PayoffDistribution payoffs;
+  int min_payoff;       // Payoff magnitudes are drawn from
+  int max_payoff;       // [min_payoff, max_payoff].
+  unsigned seed;
+
+  InstanceParams();
+};
+
+struct Instance {
+  ProtectData data;
+  vector<vector<int>> adjacency; // Area adjacency list, for protect_graph.
+};
+
+/**
+ * Generate an instance. The same parameters always give the same instance.
+ *
+ * @param params instance parameters
+ */
+Instance generate_instance(const InstanceParams &params);
+
+#endif /* INSTANCE_GEN_H */
@@ -0,0 +1,417 @@
+#include "checkpoint.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "schedule_pool.h"
+#include "solve_cache.h"
+#include "stats.h"
+
+static const char CHECKPOINT_MAGIC[8] = {'P', 'R', 'O', 'T', 'C', 'K', 'P', 'T'};
+static const uint32_t CHECKPOINT_VERSION = 1;
+
+enum SnapshotKind { SNAP_POOL, SNAP_MATRIX, SNAP_BISECTION, NUM_SNAPSHOTS };
+static const char *const SNAPSHOT_NAMES[NUM_SNAPSHOTS] = {"pool", "matrix",
+                                                          "bisection"};
+
+static std::string snapshot_path(const std::string &dir, SnapshotKind kind) {
+  return dir + "/" + SNAPSHOT_NAMES[kind];
+}
+
+/*
+ * A snapshot being written: magic, version, byte order, kind, a tag of the
+ * kind's choosing and the fingerprint, then the payload, then the FNV-1a
+ * checksum of everything before it.
+ */
+class SnapshotWriter {
+private:
+  std::string buf;
+
+public:
+  SnapshotWriter(SnapshotKind kind, uint64_t fingerprint, uint32_t tag) {
+    buf.append(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    fixed(CHECKPOINT_VERSION);
+    fixed(uint32_t(0x01020304));
+    fixed(static_cast<uint32_t>(kind));
+    fixed(tag);
+    fixed(fingerprint);
+  }
+  template <typename T> void fixed(const T v) {
+    buf.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+  void varint(uint64_t v) { put_varint(buf, v); }
+
+  // Write the snapshot to path, replacing the previous one only once the new
+  // one is on disk.
+  void commit(const std::string &path) {
+    ScopedTimer timer("checkpoint");
+    Fnv1a h;
+    h.bytes(buf.data(), buf.size());
+    fixed(h.value());
+    const std::string tmp = path + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (f == nullptr)
+      throw std::runtime_error("cannot write checkpoint " + tmp);
+    const bool written =
+        std::fwrite(buf.data(), 1, buf.size(), f) == buf.size() &&
+        std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (std::fclose(f) != 0 || !written) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("failed writing checkpoint " + tmp);
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("cannot replace checkpoint " + path);
+    }
+  }
+};
+
+class SnapshotReader {
+private:
+  std::string path;
+  std::string buf;
+  size_t pos;
+  size_t end; // Where the checksum starts.
+
+public:
+  explicit SnapshotReader(const std::string &path)
+      : path(path), pos(0), end(0) {}
+
+  /*
+   * Read and verify the snapshot. False if there is none, or it is of other
+   * inputs; tag receives the header's tag.
+   */
+  bool open(SnapshotKind kind, uint64_t fingerprint, uint32_t &tag) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      return false;
+    buf.assign(std::istreambuf_iterator<char>(in),
+               std::istreambuf_iterator<char>());
+    const size_t header = sizeof(CHECKPOINT_MAGIC) + 4 * 4 + 8;
+    if (buf.size() < header + 8)
+      corrupt();
+    Fnv1a h;
+    h.bytes(buf.data(), buf.size() - 8);
+    end = buf.size();
+    pos = end - 8;
+    if (fixed<uint64_t>() != h.value() ||
+        buf.compare(0, sizeof(CHECKPOINT_MAGIC), CHECKPOINT_MAGIC,
+                    sizeof(CHECKPOINT_MAGIC)) != 0)
+      corrupt();
+    pos = sizeof(CHECKPOINT_MAGIC);
+    if (fixed<uint32_t>() != CHECKPOINT_VERSION ||
+        fixed<uint32_t>() != 0x01020304 ||
+        fixed<uint32_t>() != static_cast<uint32_t>(kind))
+      throw std::runtime_error("checkpoint " + path +
+                               " is of another version or machine");
+    tag = fixed<uint32_t>();
+    const uint64_t of = fixed<uint64_t>();
+    end = buf.size() - 8;
+    return of == fingerprint;
+  }
+  template <typename T> T fixed() {
+    T v;
+    if (end - pos < sizeof(v))
+      corrupt();
+    std::copy(buf.data() + pos, buf.data() + pos + sizeof(v),
+              reinterpret_cast<char *>(&v));
+    pos += sizeof(v);
+    return v;
+  }
+  uint64_t varint() {
+    if (pos >= end)
+      corrupt();
+    return get_varint(buf, pos);
+  }
+  // Whether the whole payload was read.
+  bool done() const { return pos == end; }
+  [[noreturn]] void corrupt() const {
+    throw std::runtime_error("corrupt checkpoint " + path);
+  }
+};
+
+// Fingerprint of the lambda, K and resources a bisection state is valid for.
+static uint64_t hash_bisection(const SolverParams &params) {
+  Fnv1a h;
+  h.add(params.lambda);
+  h.add(static_cast<uint64_t>(params.K));
+  h.add(static_cast<uint64_t>(params.num_res));
+  return h.value();
+}
+
+uint64_t hash_pipeline(const ProtectData &data, const int time,
+                       const vector<PatrolSchedule> &schedules,
+                       const SparseColumns *A) {
+  Fnv1a h;
+  h.add(static_cast<uint64_t>(time));
+  for (const vector<int> *payoff : {&data.d_rewards, &data.d_penalties,
+                                    &data.a_rewards, &data.a_penalties}) {
+    h.add(static_cast<uint64_t>(payoff->size()));
+    for (const int v : *payoff)
+      h.add(static_cast<uint64_t>(static_cast<int64_t>(v)));
+  }
+  h.add(static_cast<uint64_t>(data.PatrolAreas.size()));
+  for (const auto &area : data.PatrolAreas) {
+    h.add(static_cast<uint64_t>(area.ranges().size()));
+    for (const auto &range : area.ranges()) {
+      h.add(static_cast<uint64_t>(range.first));
+      h.add(static_cast<uint64_t>(range.last));
+    }
+  }
+  h.add(static_cast<uint64_t>(data.activities.size()));
+  for (const auto &activity : data.activities) {
+    h.add(static_cast<uint64_t>(activity.number));
+    h.add(static_cast<uint64_t>(activity.time));
+    h.add(activity.effectiveness);
+  }
+  h.add(static_cast<uint64_t>(schedules.size()));
+  for (const auto &schedule : schedules) {
+    h.add(static_cast<uint64_t>(schedule.size()));
+    for (const auto &patrol : schedule) {
+      h.add(static_cast<uint64_t>(patrol.area_num));
+      h.add(static_cast<uint64_t>(patrol.activity.number));
+    }
+  }
+  h.add(static_cast<uint64_t>(A != nullptr));
+  if (A != nullptr)
+    hash_columns(h, data.a_penalties.size(), *A);
+  return h.value();
+}
+
+// Patrols are stored as (area, index of the activity) varints.
+static void write_pool(const std::string &dir, const uint64_t fingerprint,
+                       const CheckpointPhase phase, const ProtectData &data,
+                       const vector<PatrolSchedule> &schedules) {
+  std::unordered_map<int, size_t> activity_index;
+  for (size_t k = 0; k < data.activities.size(); k++)
+    activity_index.emplace(data.activities[k].number, k);
+  SnapshotWriter out(SNAP_POOL, fingerprint, phase);
+  out.varint(schedules.size());
+  for (const auto &schedule : schedules) {
+    out.varint(schedule.size());
+    for (const auto &patrol : schedule) {
+      const auto act = activity_index.find(patrol.activity.number);
+      if (act == activity_index.end())
+        throw std::runtime_error("schedule uses an unknown activity");
+      out.varint(patrol.area_num);
+      out.varint(act->second);
+    }
+  }
+  out.commit(snapshot_path(dir, SNAP_POOL));
+}
+
+// Columns of A, each as its non zero count, then row deltas and values.
+static void write_matrix(const std::string &dir, const uint64_t fingerprint,
+                         const size_t rows, const SparseColumns &A) {
+  SnapshotWriter out(SNAP_MATRIX, fingerprint, 0);
+  out.varint(rows);
+  out.varint(A.size());
+  for (const auto &column : A) {
+    out.varint(column.size());
+    size_t last = 0;
+    for (const auto &entry : column) {
+      out.varint(entry.first - last);
+      out.fixed(entry.second);
+      last = entry.first;
+    }
+  }
+  out.commit(snapshot_path(dir, SNAP_MATRIX));
+}
+
+static void write_bisection(const std::string &dir, const uint64_t fingerprint,
+                            const SolverParams &params,
+                            const PasaqSolution &solution) {
+  SnapshotWriter out(SNAP_BISECTION, fingerprint, 0);
+  out.fixed(hash_bisection(params));
+  out.fixed(solution.lower);
+  out.fixed(solution.upper);
+  out.varint(solution.coverage.size());
+  for (const double x : solution.coverage)
+    out.fixed(x);
+  out.varint(solution.mixture.size());
+  for (const auto &a : solution.mixture) {
+    out.varint(a.first);
+    out.fixed(a.second);
+  }
+  out.commit(snapshot_path(dir, SNAP_BISECTION));
+}
+
+static bool read_pool(const std::string &dir, const uint64_t fingerprint,
+                      const ProtectData &data, Checkpoint &checkpoint) {
+  SnapshotReader in(snapshot_path(dir, SNAP_POOL));
+  uint32_t phase;
+  if (!in.open(SNAP_POOL, fingerprint, phase))
+    return false;
+  if (phase != PHASE_ENUMERATED && phase != PHASE_REDUCED)
+    in.corrupt();
+  vector<PatrolSchedule> schedules(in.varint());
+  for (auto &schedule : schedules) {
+    for (uint64_t n = in.varint(); n > 0; n--) {
+      const uint64_t area = in.varint(), act = in.varint();
+      if (area >= data.PatrolAreas.size() || act >= data.activities.size())
+        in.corrupt();
+      schedule.emplace_back(area, data.activities[act]);
+    }
+  }
+  if (!in.done())
+    in.corrupt();
+  checkpoint.phase = static_cast<CheckpointPhase>(phase);
+  checkpoint.schedules = std::move(schedules);
+  return true;
+}
+
+static bool read_matrix(const std::string &dir, const uint64_t fingerprint,
+                        Checkpoint &checkpoint) {
+  SnapshotReader in(snapshot_path(dir, SNAP_MATRIX));
+  uint32_t tag;
+  if (!in.open(SNAP_MATRIX, fingerprint, tag))
+    return false;
+  const uint64_t rows = in.varint();
+  SparseColumns A(in.varint());
+  for (auto &column : A) {
+    size_t i = 0;
+    for (uint64_t n = in.varint(); n > 0; n--) {
+      const uint64_t delta = in.varint();
+      i += delta;
+      if (i >= rows || (delta == 0 && !column.empty()))
+        in.corrupt();
+      column.emplace_back(i, in.fixed<double>());
+    }
+  }
+  if (!in.done())
+    in.corrupt();
+  checkpoint.phase = PHASE_MATRIX;
+  checkpoint.A = std::move(A);
+  return true;
+}
+
+static bool read_bisection(const std::string &dir, const uint64_t fingerprint,
+                           const SolverParams &params,
+                           Checkpoint &checkpoint) {
+  SnapshotReader in(snapshot_path(dir, SNAP_BISECTION));
+  uint32_t tag;
+  if (!in.open(SNAP_BISECTION, fingerprint, tag) ||
+      in.fixed<uint64_t>() != hash_bisection(params))
+    return false;
+  PasaqSolution &s = checkpoint.solution;
+  s.lower = in.fixed<double>();
+  s.upper = in.fixed<double>();
+  s.coverage.resize(in.varint());
+  for (auto &x : s.coverage)
+    x = in.fixed<double>();
+  s.mixture.resize(in.varint());
+  for (auto &a : s.mixture) {
+    a.first = in.varint();
+    a.second = in.fixed<double>();
+  }
+  if (!in.done())
+    in.corrupt();
+  checkpoint.has_bisection = true;
+  return true;
+}
+
+Checkpoint read_checkpoint(const std::string &dir, const ProtectData &data,
+                           const uint64_t fingerprint,
+                           const SolverParams &params) {
+  Checkpoint checkpoint;
+  // Without a pool snapshot the caller gave the pool, and without a matrix
+  // snapshot as well, the matrix.
+  const bool pool = read_pool(dir, fingerprint, data, checkpoint);
+  if (pool && checkpoint.phase != PHASE_REDUCED)
+    return checkpoint;
+  if (read_matrix(dir, fingerprint, checkpoint) || !pool)
+    read_bisection(dir, fingerprint, params, checkpoint);
+  return checkpoint;
+}
+
+PasaqSolution checkpointed_solve(const ProtectData &data,
+                                 const SolverParams &solver,
+                                 const CheckpointParams &params,
+                                 vector<PatrolSchedule> &schedules,
+                                 const SparseColumns *A) {
+  if (!data.teams.empty())
+    throw std::invalid_argument(
+        "checkpointed solves do not support resource teams");
+  if (mkdir(params.dir.c_str(), 0755) != 0 && errno != EEXIST)
+    throw std::runtime_error("cannot create checkpoint directory " +
+                             params.dir);
+  const uint64_t fingerprint =
+      hash_pipeline(data, params.time, schedules, A);
+  Checkpoint checkpoint;
+  if (params.resume) {
+    checkpoint = read_checkpoint(params.dir, data, fingerprint, solver);
+    solver_log() << "Checkpoint holds phase " << checkpoint.phase
+                 << (checkpoint.has_bisection ? " and a bisection" : "")
+                 << endl;
+  } else {
+    for (int kind = 0; kind < NUM_SNAPSHOTS; kind++)
+      std::remove(
+          snapshot_path(params.dir, static_cast<SnapshotKind>(kind)).c_str());
+  }
+
+  // A given pool or matrix stands in for the phases that would make it.
+  const bool given = A != nullptr || !schedules.empty();
+  if (!given && checkpoint.schedules.empty()) {
+    checkpoint.phase = PHASE_START;
+    checkpoint.has_bisection = false;
+  }
+  if (A != nullptr)
+    checkpoint.phase = PHASE_MATRIX;
+  else if (given && checkpoint.phase < PHASE_REDUCED)
+    checkpoint.phase = PHASE_REDUCED;
+  if (!given)
+    schedules = std::move(checkpoint.schedules);
+
+  if (checkpoint.phase < PHASE_ENUMERATED) {
+    schedules = generate_compact_strategies(params.time, data);
+    write_pool(params.dir, fingerprint, PHASE_ENUMERATED, data, schedules);
+  }
+  if (checkpoint.phase < PHASE_REDUCED) {
+    reduce_schedules(schedules);
+    write_pool(params.dir, fingerprint, PHASE_REDUCED, data, schedules);
+  }
+  if (A == nullptr) {
+    if (checkpoint.phase < PHASE_MATRIX) {
+      checkpoint.A = build_effectiveness_columns(schedules, data);
+      write_matrix(params.dir, fingerprint, data.a_penalties.size(),
+                   checkpoint.A);
+    }
+    A = &checkpoint.A;
+  }
+
+  PasaqSolution solution;
+  {
+    ScopedTimer timer("create_strategy");
+    current_stats().num_targets = data.a_penalties.size();
+    current_stats().num_schedules = A->size();
+    PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                    data.d_penalties);
+    const MergedColumns merged = merge_identical_columns(*A);
+    current_stats().num_columns = merged.members.size();
+    solution = checkpoint.has_bisection ? checkpoint.solution
+                                        : initial_solution(solver, Pm);
+    solver_log() << "Bisecting [" << solution.lower << ", " << solution.upper
+                 << "]" << endl;
+    if (solution.upper - solution.lower > solver.epsilon) {
+      // Snapshots, like the caller, index the columns of A.
+      solution.mixture = merged.merge(solution.mixture);
+      PasaqModel model(Pm, merged.A, solver);
+      solution = BinarySearchSolve(
+          model, solution, [&](const PasaqSolution &step) {
+            PasaqSolution state = step;
+            state.mixture = merged.expand(step.mixture);
+            write_bisection(params.dir, fingerprint, solver, state);
+          });
+      solution.mixture = merged.expand(solution.mixture);
+    }
+  }
+  emit_stats();
+  return solution;
+}
@@ -0,0 +1,99 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "PASAQ.h"
+#include "protect.h"
+
+/*
+ * Checkpoints of the solve pipeline: enumeration, reduction, matrix build and
+ * bisection. A checkpoint is a directory with one compact binary snapshot per
+ * finished phase:
+ *
+ *   pool       the schedule pool, enumerated or also reduced
+ *   matrix     the sparse effectiveness matrix, by column
+ *   bisection  [L, U] and the incumbent coverage and mixture, rewritten after
+ *              every decided bisection step
+ *
+ * Every snapshot starts with the fingerprint of the pipeline's inputs and
+ * ends with a checksum of its contents. Snapshots are written to a temporary
+ * file and renamed into place, so a crash leaves the previous one intact.
+ */
+
+enum CheckpointPhase {
+  PHASE_START,      // Nothing done.
+  PHASE_ENUMERATED, // Schedule pool generated.
+  PHASE_REDUCED,    // Schedule pool reduced.
+  PHASE_MATRIX      // Effectiveness matrix built.
+};
+
+// Parameters of a checkpointed solve.
+struct CheckpointParams {
+  std::string dir; // Checkpoint directory, created if missing.
+  bool resume;     // Skip the phases the directory already holds.
+  int time;        // Time horizon of enumerated schedules.
+  CheckpointParams() : resume(false), time(10) {}
+};
+
+// What a checkpoint directory holds, as read back by read_checkpoint.
+struct Checkpoint {
+  CheckpointPhase phase;
+  vector<PatrolSchedule> schedules; // From PHASE_ENUMERATED on.
+  SparseColumns A;                  // From PHASE_MATRIX on.
+  bool has_bisection;
+  PasaqSolution solution; // Bisection state, if has_bisection.
+  Checkpoint() : phase(PHASE_START), has_bisection(false) {}
+};
+
+/**
+ * Fingerprint of a pipeline's inputs: the instance, the time horizon, and
+ * the schedule pool or matrix it was given, if any.
+ */
+uint64_t hash_pipeline(const ProtectData &data, const int time,
+                       const vector<PatrolSchedule> &schedules,
+                       const SparseColumns *A);
+
+/**
+ * Read a checkpoint directory. A snapshot that is missing, of other inputs,
+ * or (for the bisection) of other lambda, K or resources is left out. The
+ * matrix is only used on top of a reduced pool, and the bisection state on
+ * top of the matrix; without those snapshots the caller gave the pool or
+ * matrix.
+ *
+ * @param dir checkpoint directory
+ * @param data instance the pool's activities are resolved against
+ * @param fingerprint hash_pipeline of the inputs
+ * @param params the bisection's parameters
+ *
+ * @throws std::runtime_error if a snapshot of these inputs is corrupt
+ */
+Checkpoint read_checkpoint(const std::string &dir, const ProtectData &data,
+                           const uint64_t fingerprint,
+                           const SolverParams &params);
+
+/**
+ * Run the solve pipeline, writing a snapshot after every phase and every
+ * decided bisection step; with params.resume, pick up from what the
+ * directory holds instead. Bisection runs at solver.K throughout
+ * (solver.coarse_K is not used), and the solve cache is not consulted.
+ *
+ * @param data instance, without resource teams
+ * @param solver solver parameters
+ * @param params checkpoint directory and time horizon
+ * @param schedules pool to solve, or empty to enumerate and reduce one;
+ * receives the pool the mixture indexes
+ * @param A effectiveness matrix of schedules, or nullptr to build it
+ *
+ * @throws std::runtime_error if the directory cannot be written, or holds a
+ * corrupt snapshot of these inputs
+ */
+PasaqSolution checkpointed_solve(const ProtectData &data,
+                                 const SolverParams &solver,
+                                 const CheckpointParams &params,
+                                 vector<PatrolSchedule> &schedules,
+                                 const SparseColumns *A = nullptr);
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,83 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "instance_io.h"
+#include "protect.h"
+
+/*
+ * Convert a readable instance description into the binary instance format.
+ *
+ * usage: convert input.txt output.bin [--schedules TIME] [--matrix]
+ *                [--scratch DIR] [--memory MB]
+ *
+ * --schedules enumerates and reduces the schedule pool for time horizon TIME
+ * and stores it; schedules listed in the input are stored otherwise.
+ * --matrix also stores the pool's sparse effectiveness matrix.
+ * --scratch enumerates out of core: schedules are spilled to sorted runs in
+ * DIR whenever they reach --memory MB (default 256) and merged from there,
+ * so pools bigger than memory can be converted.
+ */
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0]
+              << " input.txt output.bin [--schedules TIME] [--matrix]"
+                 " [--scratch DIR] [--memory MB]"
+              << std::endl;
+    return 1;
+  }
+  int time = -1;
+  bool with_matrix = false;
+  PoolParams pool_params;
+  bool external = false;
+  for (int i = 3; i < argc; i++) {
+    const string flag = argv[i];
+    if (flag == "--schedules" && i + 1 < argc) {
+      time = std::atoi(argv[++i]);
+    } else if (flag == "--matrix") {
+      with_matrix = true;
+    } else if (flag == "--scratch" && i + 1 < argc) {
+      pool_params.scratch_dir = argv[++i];
+      external = true;
+    } else if (flag == "--memory" && i + 1 < argc) {
+      pool_params.memory_budget =
+          static_cast<size_t>(std::atof(argv[++i]) * (1 << 20));
+    } else {
+      std::cerr << "unknown option " << flag << std::endl;
+      return 1;
+    }
+  }
+
+  ProtectData data;
+  vector<PatrolSchedule> schedules;
+  try {
+    std::ifstream in(argv[1]);
+    if (!in) {
+      std::cerr << "cannot open " << argv[1] << std::endl;
+      return 1;
+    }
+    read_instance_text(in, data, schedules);
+    if (time >= 0 && external) {
+      SchedulePool pool(data, pool_params);
+      generate_compact_strategies(time, data, pool);
+      write_instance(argv[2], data, pool, with_matrix);
+      std::cerr << "wrote " << data.PatrolAreas.size() << " areas, "
+                << pool.size() << " schedules to " << argv[2] << " ("
+                << pool.spilled_runs() << " runs spilled)" << std::endl;
+      return 0;
+    }
+    if (time >= 0) {
+      schedules = generate_compact_strategies(time, data);
+      reduce_schedules(schedules);
+    }
+    write_instance(argv[2], data, schedules.empty() ? nullptr : &schedules,
+                   with_matrix);
+  } catch (const std::exception &e) {
+    std::cerr << argv[1] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  std::cerr << "wrote " << data.PatrolAreas.size() << " areas, "
+            << schedules.size() << " schedules to " << argv[2] << std::endl;
+  return 0;
+}
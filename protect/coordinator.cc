@@ -0,0 +1,445 @@
+#include "coordinator.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "json.h"
+
+// Name the workers load the shipped instance under.
+static const char GAME_NAME[] = "fanout";
+
+// Connect to "unix:PATH" or "HOST:PORT"; -1 on failure.
+static int connect_to(const std::string &address, const double timeout) {
+  int fd = -1;
+  if (address.compare(0, 5, "unix:") == 0) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    const std::string path = address.substr(5);
+    if (path.size() >= sizeof(addr.sun_path))
+      return -1;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 &&
+        connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  } else {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+      return -1;
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found = nullptr;
+    if (getaddrinfo(address.substr(0, colon).c_str(),
+                    address.substr(colon + 1).c_str(), &hints, &found) != 0)
+      return -1;
+    for (const addrinfo *a = found; a != nullptr && fd < 0; a = a->ai_next) {
+      fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(found);
+    if (fd >= 0) {
+      // Requests are single small lines; do not hold them back.
+      const int yes = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    }
+  }
+  if (fd >= 0 && timeout > 0) {
+    timeval tv;
+    tv.tv_sec = static_cast<time_t>(timeout);
+    tv.tv_usec = static_cast<suseconds_t>((timeout - tv.tv_sec) * 1e6);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+  return fd;
+}
+
+static bool loaded_ok(const std::string &line) {
+  try {
+    const JsonValue response = parse_json(line);
+    const JsonValue *ok = response.get("ok");
+    return ok != nullptr && ok->type == JsonValue::BOOL && ok->boolean;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+/*
+ * One worker's connection, with the instance loaded. Any failure closes it;
+ * the next request reconnects and loads again.
+ */
+class Coordinator::Connection {
+private:
+  std::string address;
+  double timeout;
+  int fd;
+  std::string pending; // Received past the last response.
+  int failures;        // Failed connects or requests in a row.
+
+  bool exchange(const std::string &line, std::string &response) {
+    const std::string out = line + "\n";
+    for (size_t sent = 0; sent < out.size();) {
+      const ssize_t n = send(fd, out.data() + sent, out.size() - sent,
+                             MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      sent += n;
+    }
+    size_t newline;
+    char buf[4096];
+    while ((newline = pending.find('\n')) == std::string::npos) {
+      const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      pending.append(buf, n);
+    }
+    response = pending.substr(0, newline);
+    pending.erase(0, newline + 1);
+    return true;
+  }
+
+public:
+  Connection(const std::string &address, const double timeout)
+      : address(address), timeout(timeout), fd(-1), failures(0) {}
+  ~Connection() { disconnect(); }
+
+  void disconnect() {
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+    pending.clear();
+  }
+
+  int failures_in_a_row() const { return failures; }
+
+  /*
+   * Send one request and read its response, connecting and loading the
+   * instance first if needed. False if the worker failed.
+   */
+  bool request(const std::string &load, const std::string &line,
+               std::string &response) {
+    if (fd < 0) {
+      fd = connect_to(address, timeout);
+      std::string loaded;
+      if (fd < 0 || !exchange(load, loaded) ||
+          !loaded_ok(loaded)) {
+        disconnect();
+        failures++;
+        return false;
+      }
+    }
+    if (!exchange(line, response)) {
+      disconnect();
+      failures++;
+      return false;
+    }
+    failures = 0;
+    return true;
+  }
+};
+
+// A solve or check request. Numbers go out exactly, so workers see the
+// coordinator's r; payoffs are only sent if scenario has any.
+static std::string solve_request(const size_t id,
+                                 const BatchScenario &scenario,
+                                 const char *op, const double r = 0) {
+  const SolverParams &p = scenario.params;
+  const PayoffMatrix &Pm = scenario.payoffs;
+  std::ostringstream out;
+  out << std::setprecision(17);
+  out << "{\"op\":\"" << op << "\",\"id\":" << id << ",\"name\":\""
+      << GAME_NAME << "\",\"lambda\":" << p.lambda
+      << ",\"resources\":" << p.num_res << ",\"epsilon\":" << p.epsilon
+      << ",\"segments\":" << p.K << ",\"time_limit\":" << p.time_limit
+      << ",\"mip_gap\":" << p.mip_gap << ",\"check_threads\":" << p.threads;
+  if (std::string(op) == "check")
+    out << ",\"r\":" << r;
+  if (!Pm.P_a.empty()) {
+    out << ",\"targets\":[";
+    for (size_t i = 1; i < Pm.P_a.size(); i++)
+      out << (i > 1 ? "," : "") << "{\"target\":" << i
+          << ",\"d_reward\":" << Pm.R_d[i] << ",\"d_penalty\":" << Pm.P_d[i]
+          << ",\"a_reward\":" << Pm.R_a[i] << ",\"a_penalty\":" << Pm.P_a[i]
+          << "}";
+    out << "]";
+  }
+  out << "}";
+  return out.str();
+}
+
+static void parse_strategy(const JsonValue &response, strategy &coverage,
+                           ScheduleMixture &mixture) {
+  const JsonValue *x = response.get("coverage");
+  const JsonValue *a = response.get("mixture");
+  if (x == nullptr || a == nullptr)
+    throw std::runtime_error("response has no strategy");
+  coverage.clear();
+  for (const auto &v : x->array)
+    coverage.push_back(v.number);
+  mixture.clear();
+  for (const auto &pair : a->array) {
+    if (pair.array.size() != 2)
+      throw std::runtime_error("malformed mixture");
+    mixture.emplace_back(static_cast<size_t>(pair.array[0].number),
+                         pair.array[1].number);
+  }
+}
+
+// The counters and phase times of a stats_to_json record.
+static SolveStats parse_stats(const JsonValue *json) {
+  SolveStats stats;
+  if (json == nullptr)
+    return stats;
+  auto count = [json](const char *key) {
+    return static_cast<size_t>(json->get_number(key, 0));
+  };
+  stats.num_targets = count("num_targets");
+  stats.num_schedules = count("num_schedules");
+  stats.num_columns = count("num_columns");
+  stats.bisection_steps = count("bisection_steps");
+  stats.mip_solves = count("mip_solves");
+  stats.simplex_iterations = count("simplex_iterations");
+  stats.bnb_nodes = count("bnb_nodes");
+  stats.last_mip_gap = json->get_number("last_mip_gap", 0);
+  stats.max_mip_gap = json->get_number("max_mip_gap", 0);
+  stats.undecided_checks = count("undecided_checks");
+  stats.heuristic_solutions = count("heuristic_solutions");
+  stats.fill_cuts = count("fill_cuts");
+  stats.knapsack_cuts = count("knapsack_cuts");
+  stats.cut_bound_gain = json->get_number("cut_bound_gain", 0);
+  stats.cache = json->get_string("cache", "");
+  const JsonValue *phases = json->get("phases");
+  if (phases != nullptr)
+    for (const auto &phase : phases->object)
+      stats.phases.push_back({phase.first,
+                              phase.second.get_number("seconds", 0),
+                              static_cast<size_t>(
+                                  phase.second.get_number("calls", 0))});
+  return stats;
+}
+
+/*
+ * A worker's answer. Throws if the response is not one, which counts as a
+ * failure of the worker.
+ */
+static JsonValue parse_response(const std::string &line, const size_t id) {
+  JsonValue response = parse_json(line);
+  const JsonValue *ok = response.get("ok");
+  if (ok == nullptr || ok->type != JsonValue::BOOL ||
+      response.get_number("id", -1) != static_cast<double>(id))
+    throw std::runtime_error("response does not answer the request");
+  return response;
+}
+
+Coordinator::Coordinator(const std::string &instance_path,
+                         const FanOutParams &params)
+    : params(params) {
+  if (params.workers.empty())
+    throw std::runtime_error("no workers to fan out to");
+  std::ifstream in(instance_path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("cannot open " + instance_path);
+  const std::string bytes((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+  load_request = std::string("{\"op\":\"load\",\"name\":\"") + GAME_NAME +
+                 "\",\"instance_data\":\"" + base64_encode(bytes) + "\"}";
+  for (const auto &address : params.workers)
+    connections.emplace_back(new Connection(address, params.timeout));
+  if (this->params.attempts < 1)
+    this->params.attempts = 1;
+}
+
+Coordinator::~Coordinator() {}
+
+vector<FanOutResult>
+Coordinator::solve(const vector<BatchScenario> &scenarios) {
+  vector<FanOutResult> results(scenarios.size());
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<size_t> queue;
+  for (size_t n = 0; n < scenarios.size(); n++)
+    queue.push_back(n);
+  vector<int> tries(scenarios.size(), 0);
+  size_t unfinished = scenarios.size();
+  size_t alive = connections.size();
+
+  // Callers hold the lock.
+  auto fail = [&](const size_t n, const std::string &why) {
+    results[n].ok = false;
+    results[n].error = why;
+    unfinished--;
+  };
+
+  auto work = [&](const size_t w) {
+    Connection &connection = *connections[w];
+    for (;;) {
+      size_t n;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !queue.empty() || unfinished == 0; });
+        if (unfinished == 0)
+          return;
+        n = queue.front();
+        queue.pop_front();
+      }
+      std::string line;
+      FanOutResult result;
+      bool answered =
+          connection.request(load_request,
+                             solve_request(n, scenarios[n], "solve"), line);
+      if (answered) {
+        try {
+          const JsonValue response = parse_response(line, n);
+          result.worker = w;
+          result.ok = response.get("ok")->boolean;
+          if (result.ok) {
+            result.solution.lower = response.get_number("lower", 0);
+            result.solution.upper = response.get_number("upper", 0);
+            parse_strategy(response, result.solution.coverage,
+                           result.solution.mixture);
+            result.stats = parse_stats(response.get("stats"));
+          } else {
+            result.error = response.get_string("error", "solve failed");
+          }
+        } catch (const std::exception &) {
+          connection.disconnect();
+          answered = false;
+        }
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      if (answered) {
+        results[n] = std::move(result);
+        unfinished--;
+        changed.notify_all();
+        continue;
+      }
+      if (++tries[n] >= params.attempts)
+        fail(n, "no answer after " + std::to_string(tries[n]) + " tries");
+      else
+        queue.push_front(n);
+      if (connection.failures_in_a_row() >= params.attempts) {
+        if (--alive == 0)
+          while (!queue.empty()) {
+            fail(queue.front(), "no workers left");
+            queue.pop_front();
+          }
+        changed.notify_all();
+        return;
+      }
+      changed.notify_all();
+      lock.unlock();
+      // Give a restarting worker a moment before reconnecting.
+      std::this_thread::sleep_for(std::chrono::milliseconds(
+          100 * connection.failures_in_a_row()));
+    }
+  };
+
+  vector<std::thread> threads;
+  for (size_t w = 0; w < connections.size(); w++)
+    threads.emplace_back(work, w);
+  for (auto &thread : threads)
+    thread.join();
+  return results;
+}
+
+PasaqSolution Coordinator::bisect(const SolverParams &solver,
+                                  const PasaqSolution &start) {
+  ScopedTimer timer("binary_search");
+  // Checks carry no payoffs: the workers keep the instance's own.
+  BatchScenario scenario = {PayoffMatrix({}, {}, {}, {}), solver};
+  PasaqSolution solution = start;
+  size_t id = 0;
+  for (int idle = 0;
+       solution.upper - solution.lower > solver.epsilon &&
+       idle < params.attempts;) {
+    vector<Connection *> live;
+    for (auto &connection : connections)
+      if (connection->failures_in_a_row() < params.attempts)
+        live.push_back(connection.get());
+    if (live.empty())
+      break;
+
+    const double L = solution.lower, U = solution.upper;
+    vector<double> r(live.size());
+    vector<FeasibilityResult> checks(live.size());
+    vector<char> decided(live.size(), 0);
+    vector<std::thread> threads;
+    for (size_t w = 0; w < live.size(); w++) {
+      r[w] = L + (U - L) * (w + 1) / (live.size() + 1);
+      const std::string line = solve_request(id + w, scenario, "check", r[w]);
+      threads.emplace_back([&, w, line] {
+        std::string response;
+        if (!live[w]->request(load_request, line, response))
+          return;
+        try {
+          const JsonValue answer = parse_response(response, id + w);
+          const JsonValue *feasible = answer.get("feasible");
+          const JsonValue *settled = answer.get("decided");
+          if (!answer.get("ok")->boolean || feasible == nullptr ||
+              settled == nullptr)
+            return;
+          checks[w].feasible = feasible->boolean;
+          decided[w] = settled->boolean;
+          parse_strategy(answer, checks[w].coverage, checks[w].mixture);
+        } catch (const std::exception &) {
+          live[w]->disconnect();
+          decided[w] = 0;
+        }
+      });
+    }
+    for (auto &thread : threads)
+      thread.join();
+    id += live.size();
+    current_stats().bisection_steps++;
+
+    // Achievability is monotone in r: the highest feasible r is the new L,
+    // the lowest infeasible one the new U.
+    bool any = false;
+    for (size_t w = 0; w < live.size(); w++) {
+      if (!decided[w])
+        continue;
+      any = true;
+      if (checks[w].feasible && r[w] > solution.lower) {
+        solution.lower = r[w];
+        solution.coverage = std::move(checks[w].coverage);
+        solution.mixture = std::move(checks[w].mixture);
+      } else if (!checks[w].feasible && r[w] < solution.upper) {
+        solution.upper = r[w];
+      }
+    }
+    idle = any ? 0 : idle + 1;
+    solver_log() << "U = " << solution.upper << " L=" << solution.lower
+                 << " after " << live.size() << " checks" << endl;
+  }
+  return solution;
+}
@@ -0,0 +1,87 @@
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PASAQ.h"
+#include "batch.h"
+#include "stats.h"
+
+// Parameters of fanning solves out to worker processes.
+struct FanOutParams {
+  vector<std::string> workers; // "unix:PATH" or "HOST:PORT" of each worker.
+  int attempts;   // Tries of a request, and failed reconnects of a worker in a
+                  // row, before giving up on it.
+  double timeout; // Seconds to wait for one response, 0 for none.
+  FanOutParams() : attempts(3), timeout(0) {}
+};
+
+struct FanOutResult {
+  bool ok;
+  std::string error;      // Why the scenario failed, if not ok.
+  PasaqSolution solution;
+  SolveStats stats;       // Counters and phase times reported by the worker.
+  size_t worker;          // Index of the worker that answered.
+  FanOutResult() : ok(false), worker(0) {}
+};
+
+/*
+ * Spreads solves of one instance over worker processes running the solver
+ * service (--serve-socket PATH or --serve-tcp PORT), on this host or others.
+ * The binary instance file is shipped once per connection, base64 encoded
+ * in a load request; after that a scenario is a single solve request with
+ * its payoffs and parameters. Every worker has a thread that takes the next
+ * scenario from a shared queue, so faster workers take more of them. A
+ * scenario whose worker fails (the connection drops or times out) goes back
+ * to the queue for another try, and the worker reconnects, shipping the
+ * instance again; a worker that cannot be reached params.attempts times in a
+ * row is given up on. Errors the solver reports are not retried.
+ */
+class Coordinator {
+private:
+  class Connection;
+
+  FanOutParams params;
+  std::string load_request;
+  vector<std::unique_ptr<Connection>> connections;
+
+public:
+  /**
+   * @param instance_path binary instance file to ship to the workers
+   * @param params workers, retries and timeout
+   *
+   * @throws std::runtime_error if the instance cannot be read, or there are
+   * no workers
+   */
+  Coordinator(const std::string &instance_path, const FanOutParams &params);
+  ~Coordinator();
+  Coordinator(const Coordinator &) = delete;
+  Coordinator &operator=(const Coordinator &) = delete;
+
+  /**
+   * Solve scenarios of the instance on the workers. The payoffs of every
+   * scenario replace the instance's.
+   *
+   * @param scenarios payoffs and parameters; all have the instance's targets
+   *
+   * @return one result per scenario, in order
+   */
+  vector<FanOutResult> solve(const vector<BatchScenario> &scenarios);
+
+  /**
+   * Binary search on the instance's own payoffs, with one check per worker
+   * in every round: the workers check evenly spaced utilities of [L, U] at
+   * once, splitting the interval into one more part than there are workers
+   * that answer. Checks lost to failed workers or left undecided only cost
+   * resolution; the search stops early, with certified bounds, once a
+   * round decides nothing params.attempts times in a row.
+   *
+   * @param solver lambda, resources, K, epsilon and per check time limit
+   * @param start starting interval, as for BinarySearchSolve
+   */
+  PasaqSolution bisect(const SolverParams &solver, const PasaqSolution &start);
+};
+
+#endif /* COORDINATOR_H */
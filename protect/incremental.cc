@@ -0,0 +1,195 @@
+#include "incremental.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+IncrementalSolver::IncrementalSolver(const ProtectData &data, const int time,
+                                     const SolverParams &params)
+    : data(data), time(time), params(params),
+      schedules(generate_compact_strategies(time, data)),
+      area_open(data.PatrolAreas.size(), true), solved(false),
+      upper_valid(false), upper_slack(0) {
+  const size_t T = data.a_penalties.size();
+  vector<vector<double>> A(T, vector<double>(schedules.size(), 0));
+  for (size_t j = 0; j < schedules.size(); j++) {
+    columns.push_back(column_of(schedules[j]));
+    for (const auto &entry : columns.back())
+      A[entry.first][j] = entry.second;
+  }
+  model.reset(new PasaqModel(payoffs(), A, params));
+  model->set_warm_start(true);
+}
+
+IncrementalSolver::Column
+IncrementalSolver::column_of(const PatrolSchedule &schedule) const {
+  Column column;
+  for (const auto &run : schedule_coverage(schedule, data.PatrolAreas))
+    for (int target = run.first; target <= run.last; target++)
+      column.emplace_back(target, run.effectiveness);
+  return column;
+}
+
+bool IncrementalSolver::schedule_open(const PatrolSchedule &schedule) const {
+  for (const auto &patrol : schedule)
+    if (!area_open[patrol.area_num])
+      return false;
+  return true;
+}
+
+bool IncrementalSolver::visits(const PatrolSchedule &schedule,
+                               size_t area) const {
+  for (const auto &patrol : schedule)
+    if (patrol.area_num == area)
+      return true;
+  return false;
+}
+
+PayoffMatrix IncrementalSolver::payoffs() const {
+  return PayoffMatrix(data.a_rewards, data.a_penalties, data.d_rewards,
+                      data.d_penalties);
+}
+
+/*
+ * The previous mixture, without schedules that were closed since, is still a
+ * strategy (constraint (17) allows weights summing below 1). If its coverage
+ * still fits the resources, its exact utility is achievable.
+ */
+PasaqSolution IncrementalSolver::start() const {
+  const PayoffMatrix Pm = payoffs();
+  PasaqSolution start = initial_solution(params, Pm);
+  if (!solved)
+    return start;
+
+  ScheduleMixture mixture;
+  strategy coverage(Pm.P_a.size(), 0);
+  for (const auto &entry : last.mixture) {
+    if (!schedule_open(schedules[entry.first]))
+      continue;
+    mixture.push_back(entry);
+    for (const auto &target : columns[entry.first])
+      coverage[target.first] += entry.second * target.second;
+  }
+  const double used = std::accumulate(coverage.begin(), coverage.end(), 0.0);
+  if (used <= params.num_res &&
+      *std::max_element(coverage.begin(), coverage.end()) <= 1) {
+    const double utility = UD(coverage, Pm, params.lambda);
+    if (utility > start.lower) {
+      start.lower = std::min(utility, start.upper);
+      start.coverage = coverage;
+      start.mixture = mixture;
+    }
+  }
+  if (upper_valid)
+    start.upper =
+        std::max(start.lower, std::min(start.upper, last.upper + upper_slack));
+  return start;
+}
+
+const PasaqSolution &IncrementalSolver::solve() {
+  last = BinarySearchSolve(*model, start());
+  solved = true;
+  upper_valid = true;
+  upper_slack = 0;
+  return last;
+}
+
+void IncrementalSolver::set_target_payoffs(size_t target, int d_reward,
+                                           int d_penalty, int a_reward,
+                                           int a_penalty) {
+  if (target < 1 || target >= data.a_penalties.size())
+    throw std::invalid_argument("no target " + std::to_string(target));
+  // Changing the defender's payoffs of one target by at most delta moves the
+  // utility of every strategy, hence the optimum, by at most delta. The
+  // attacker's payoffs change who is attacked, which has no such bound.
+  if (a_reward != data.a_rewards[target] ||
+      a_penalty != data.a_penalties[target])
+    upper_valid = false;
+  upper_slack += std::max(std::abs(d_reward - data.d_rewards[target]),
+                          std::abs(d_penalty - data.d_penalties[target]));
+  data.d_rewards[target] = d_reward;
+  data.d_penalties[target] = d_penalty;
+  data.a_rewards[target] = a_reward;
+  data.a_penalties[target] = a_penalty;
+  model->set_target_payoffs(target, d_reward, d_penalty, a_reward, a_penalty);
+}
+
+void IncrementalSolver::close_area(size_t area) {
+  if (area >= area_open.size())
+    throw std::invalid_argument("no area " + std::to_string(area));
+  if (!area_open[area])
+    return;
+  // Fewer schedules can only lower the optimum.
+  area_open[area] = false;
+  for (size_t j = 0; j < schedules.size(); j++)
+    if (visits(schedules[j], area))
+      model->set_schedule_enabled(j, false);
+}
+
+void IncrementalSolver::open_area(size_t area) {
+  if (area >= area_open.size())
+    throw std::invalid_argument("no area " + std::to_string(area));
+  if (area_open[area])
+    return;
+  area_open[area] = true;
+  upper_valid = false;
+  for (size_t j = 0; j < schedules.size(); j++)
+    if (visits(schedules[j], area) && schedule_open(schedules[j]))
+      model->set_schedule_enabled(j, true);
+}
+
+void IncrementalSolver::set_area_targets(size_t area,
+                                         const PatrolArea &targets) {
+  if (area >= area_open.size())
+    throw std::invalid_argument("no area " + std::to_string(area));
+  for (const auto target : targets)
+    if (target < 1 || static_cast<size_t>(target) >= data.a_penalties.size())
+      throw std::invalid_argument("no target " + std::to_string(target));
+  data.PatrolAreas[area] = targets;
+  upper_valid = false;
+  for (size_t j = 0; j < schedules.size(); j++) {
+    if (!visits(schedules[j], area))
+      continue;
+    columns[j] = column_of(schedules[j]);
+    model->set_schedule(j, columns[j]);
+  }
+}
+
+size_t IncrementalSolver::add_area(const PatrolArea &targets) {
+  for (const auto target : targets)
+    if (target < 1 || static_cast<size_t>(target) >= data.a_penalties.size())
+      throw std::invalid_argument("no target " + std::to_string(target));
+  const size_t area = data.PatrolAreas.size();
+  data.PatrolAreas.push_back(targets);
+  area_open.push_back(true);
+  upper_valid = false;
+
+  // Compact schedules list areas in increasing order, so the new area goes
+  // last; extend the empty schedule and every schedule with room left.
+  const auto &min_activity = *std::min_element(
+      data.activities.begin(), data.activities.end(),
+      [](const Activity &a, const Activity &b) { return a.time < b.time; });
+  const size_t max_stops = time / min_activity.time;
+  const size_t existing = schedules.size();
+  for (size_t j = 0; j <= existing; j++) {
+    const PatrolSchedule base = j < existing ? schedules[j] : PatrolSchedule();
+    if (base.size() >= max_stops)
+      continue;
+    int used = 0;
+    for (const auto &patrol : base)
+      used += patrol.activity.time;
+    for (const auto &activity : data.activities) {
+      if (used + activity.time > time)
+        continue;
+      PatrolSchedule schedule = base;
+      schedule.emplace_back(area, activity);
+      columns.push_back(column_of(schedule));
+      const size_t column = model->add_schedule(columns.back());
+      schedules.push_back(std::move(schedule));
+      if (!schedule_open(schedules.back()))
+        model->set_schedule_enabled(column, false);
+    }
+  }
+  return area;
+}
@@ -0,0 +1,81 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <memory>
+#include <vector>
+
+#include "PASAQ.h"
+#include "protect.h"
+
+/*
+ * A game that is solved repeatedly while it changes a little at a time. The
+ * schedule pool, the effectiveness matrix and the CF-OPT model are kept
+ * between solves: payoff changes only patch the objective tables of the
+ * changed targets, area changes only touch the schedules visiting the area,
+ * and each solve starts its bisection from bounds implied by the previous
+ * solution, with that solution offered to GLPK as the incumbent.
+ */
+class IncrementalSolver {
+private:
+  typedef vector<pair<size_t, double>> Column; // (target, effectiveness)
+
+  ProtectData data;
+  int time;
+  SolverParams params;
+  vector<PatrolSchedule> schedules; // Columns of the model, in order.
+  vector<Column> columns;
+  vector<bool> area_open;
+  std::unique_ptr<PasaqModel> model;
+  PasaqSolution last;
+  bool solved;
+  bool upper_valid;      // last.upper + upper_slack still bounds the optimum.
+  double upper_slack;
+
+  Column column_of(const PatrolSchedule &schedule) const;
+  bool schedule_open(const PatrolSchedule &schedule) const;
+  bool visits(const PatrolSchedule &schedule, size_t area) const;
+  PayoffMatrix payoffs() const;
+  PasaqSolution start() const;
+
+public:
+  /**
+   * Enumerate the schedules and build the model; nothing is solved yet.
+   *
+   * @param data the game
+   * @param time time available to a schedule
+   * @param params solver parameters
+   */
+  IncrementalSolver(const ProtectData &data, const int time,
+                    const SolverParams &params = SolverParams());
+
+  // Solve the game as it is now.
+  const PasaqSolution &solve();
+
+  // Change the payoffs of one target.
+  void set_target_payoffs(size_t target, int d_reward, int d_penalty,
+                          int a_reward, int a_penalty);
+
+  // Stop patrolling an area: schedules visiting it get weight 0.
+  void close_area(size_t area);
+
+  // Patrol a closed area again.
+  void open_area(size_t area);
+
+  // Change the targets of an area, recomputing the schedules visiting it.
+  void set_area_targets(size_t area, const PatrolArea &targets);
+
+  /**
+   * Add a patrol area. Only the schedules that visit it are enumerated: each
+   * existing schedule with room left is extended by the new area.
+   *
+   * @return number of the new area
+   */
+  size_t add_area(const PatrolArea &targets);
+
+  const ProtectData &get_data() const { return data; }
+
+  // Schedule pool; solution mixtures index it.
+  const vector<PatrolSchedule> &get_schedules() const { return schedules; }
+};
+
+#endif /* INCREMENTAL_H */
@@ -0,0 +1,601 @@
+#include "instance_io.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+static const char INSTANCE_MAGIC[8] = {'P', 'R', 'O', 'T', 'E', 'C', 'T', 0};
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+static uint64_t align8(uint64_t n) { return (n + 7) & ~static_cast<uint64_t>(7); }
+
+InstanceFile::InstanceFile(const std::string &path)
+    : base(nullptr), length(0), header(nullptr) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("cannot open instance " + path);
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(InstanceHeader)) {
+    close(fd);
+    throw std::runtime_error(path + " is too small to be an instance");
+  }
+  length = st.st_size;
+  void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("cannot map instance " + path);
+  base = static_cast<const char *>(mapping);
+  header = reinterpret_cast<const InstanceHeader *>(base);
+  try {
+    validate();
+  } catch (...) {
+    munmap(const_cast<char *>(base), length);
+    throw;
+  }
+}
+
+InstanceFile::~InstanceFile() {
+  if (base != nullptr)
+    munmap(const_cast<char *>(base), length);
+}
+
+template <typename T>
+array_view<T> InstanceFile::section(InstanceSection sec, uint64_t count) const {
+  return array_view<T>(
+      reinterpret_cast<const T *>(base + header->offsets[sec]), count);
+}
+
+/*
+ * Check that the header describes sections that lie inside the file and that
+ * the offset arrays agree with the counts. Entries themselves are checked when
+ * they are copied out.
+ */
+void InstanceFile::validate() const {
+  if (std::memcmp(header->magic, INSTANCE_MAGIC, sizeof(INSTANCE_MAGIC)) != 0)
+    throw std::runtime_error("not an instance file");
+  if (header->byte_order != BYTE_ORDER_MARK)
+    throw std::runtime_error("instance was written with another byte order");
+  if (header->version != INSTANCE_VERSION)
+    throw std::runtime_error("unsupported instance version " +
+                             std::to_string(header->version));
+
+  // Every section holds at least one byte per entry, so these counts are
+  // below length and adding the trailing offset cannot wrap.
+  if (header->num_areas >= length || header->num_schedules >= length)
+    throw std::runtime_error("instance counts exceed the file size");
+  const uint64_t S = has_schedules() ? header->num_schedules + 1 : 0;
+  const uint64_t C = has_matrix() ? header->num_schedules + 1 : 0;
+  const uint64_t counts[NUM_SECTIONS] = {
+      header->num_targets,
+      header->num_targets,
+      header->num_targets,
+      header->num_targets,
+      header->num_areas + 1,
+      header->num_area_targets,
+      header->num_activities,
+      S,
+      has_schedules() ? header->num_patrols : 0,
+      C,
+      has_matrix() ? header->matrix_nnz : 0,
+      has_matrix() ? header->matrix_nnz : 0};
+  const uint64_t elem_sizes[NUM_SECTIONS] = {
+      sizeof(int32_t),        sizeof(int32_t),  sizeof(int32_t),
+      sizeof(int32_t),        sizeof(uint64_t), sizeof(int32_t),
+      sizeof(ActivityRecord), sizeof(uint64_t), sizeof(PatrolRecord),
+      sizeof(uint64_t),       sizeof(int32_t),  sizeof(double)};
+  for (int sec = 0; sec < NUM_SECTIONS; sec++) {
+    const uint64_t offset = header->offsets[sec];
+    // Compare counts, not byte sizes, so a huge count cannot wrap around.
+    if (offset % 8 != 0 || offset > length ||
+        counts[sec] > (length - offset) / elem_sizes[sec])
+      throw std::runtime_error("instance section " + std::to_string(sec) +
+                               " is out of bounds");
+  }
+
+  const auto areas =
+      section<uint64_t>(SEC_AREA_OFFSETS, header->num_areas + 1);
+  if (areas[header->num_areas] != header->num_area_targets)
+    throw std::runtime_error("instance area offsets do not match");
+  if (has_schedules()) {
+    const auto offsets = section<uint64_t>(SEC_SCHEDULE_OFFSETS, S);
+    if (offsets[S - 1] != header->num_patrols)
+      throw std::runtime_error("instance schedule offsets do not match");
+  }
+  if (has_matrix()) {
+    const auto offsets = section<uint64_t>(SEC_COLUMN_OFFSETS, C);
+    if (offsets[C - 1] != header->matrix_nnz)
+      throw std::runtime_error("instance column offsets do not match");
+  }
+}
+
+bool InstanceFile::has_schedules() const {
+  return (header->flags & INSTANCE_HAS_SCHEDULES) != 0;
+}
+
+bool InstanceFile::has_matrix() const {
+  return (header->flags & INSTANCE_HAS_MATRIX) != 0;
+}
+
+array_view<int32_t> InstanceFile::d_rewards() const {
+  return section<int32_t>(SEC_D_REWARDS, header->num_targets);
+}
+
+array_view<int32_t> InstanceFile::d_penalties() const {
+  return section<int32_t>(SEC_D_PENALTIES, header->num_targets);
+}
+
+array_view<int32_t> InstanceFile::a_rewards() const {
+  return section<int32_t>(SEC_A_REWARDS, header->num_targets);
+}
+
+array_view<int32_t> InstanceFile::a_penalties() const {
+  return section<int32_t>(SEC_A_PENALTIES, header->num_targets);
+}
+
+array_view<ActivityRecord> InstanceFile::activities() const {
+  return section<ActivityRecord>(SEC_ACTIVITIES, header->num_activities);
+}
+
+// Slice [offsets[i], offsets[i + 1]) out of the section values.
+template <typename T>
+static array_view<T> slice(array_view<uint64_t> offsets, array_view<T> values,
+                           size_t i) {
+  if (i + 1 >= offsets.size() || offsets[i] > offsets[i + 1] ||
+      offsets[i + 1] > values.size())
+    throw std::out_of_range("instance index " + std::to_string(i) +
+                            " is out of range");
+  return array_view<T>(values.data() + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+array_view<int32_t> InstanceFile::area(size_t i) const {
+  return slice(section<uint64_t>(SEC_AREA_OFFSETS, header->num_areas + 1),
+               section<int32_t>(SEC_AREA_TARGETS, header->num_area_targets),
+               i);
+}
+
+array_view<PatrolRecord> InstanceFile::schedule(size_t j) const {
+  if (!has_schedules())
+    throw std::logic_error("instance has no schedule pool");
+  return slice(
+      section<uint64_t>(SEC_SCHEDULE_OFFSETS, header->num_schedules + 1),
+      section<PatrolRecord>(SEC_PATROLS, header->num_patrols), j);
+}
+
+array_view<int32_t> InstanceFile::column_rows(size_t j) const {
+  if (!has_matrix())
+    throw std::logic_error("instance has no effectiveness matrix");
+  return slice(
+      section<uint64_t>(SEC_COLUMN_OFFSETS, header->num_schedules + 1),
+      section<int32_t>(SEC_ROW_INDEX, header->matrix_nnz), j);
+}
+
+array_view<double> InstanceFile::column_values(size_t j) const {
+  if (!has_matrix())
+    throw std::logic_error("instance has no effectiveness matrix");
+  return slice(
+      section<uint64_t>(SEC_COLUMN_OFFSETS, header->num_schedules + 1),
+      section<double>(SEC_VALUES, header->matrix_nnz), j);
+}
+
+ProtectData InstanceFile::to_protect_data() const {
+  ProtectData data;
+  data.d_rewards.assign(d_rewards().begin(), d_rewards().end());
+  data.d_penalties.assign(d_penalties().begin(), d_penalties().end());
+  data.a_rewards.assign(a_rewards().begin(), a_rewards().end());
+  data.a_penalties.assign(a_penalties().begin(), a_penalties().end());
+  for (const auto &a : activities())
+    data.activities.push_back({a.number, a.time, a.effectiveness});
+  data.PatrolAreas.reserve(num_areas());
+  for (size_t i = 0; i < num_areas(); i++) {
+    const auto targets = area(i);
+    for (const auto t : targets)
+      if (t < 0 || static_cast<size_t>(t) >= num_targets())
+        throw std::runtime_error("area " + std::to_string(i) +
+                                 " has an unknown target");
+    data.PatrolAreas.emplace_back(targets.begin(), targets.end());
+  }
+  return data;
+}
+
+vector<PatrolSchedule> InstanceFile::schedules() const {
+  vector<PatrolSchedule> result;
+  if (!has_schedules())
+    return result;
+  const auto acts = activities();
+  result.reserve(num_schedules());
+  for (size_t j = 0; j < num_schedules(); j++) {
+    PatrolSchedule schedule;
+    for (const auto &p : this->schedule(j)) {
+      if (p.area >= num_areas() || p.activity >= acts.size())
+        throw std::runtime_error("schedule " + std::to_string(j) +
+                                 " references an unknown area or activity");
+      const auto &a = acts[p.activity];
+      schedule.emplace_back(p.area,
+                            Activity{a.number, a.time, a.effectiveness});
+    }
+    result.push_back(std::move(schedule));
+  }
+  return result;
+}
+
+SparseColumns InstanceFile::effectiveness_columns() const {
+  SparseColumns A(num_schedules());
+  if (!has_matrix())
+    return A;
+  for (size_t j = 0; j < num_schedules(); j++) {
+    const auto rows = column_rows(j);
+    const auto values = column_values(j);
+    A[j].reserve(rows.size());
+    for (size_t n = 0; n < rows.size(); n++) {
+      if (rows[n] < 0 || static_cast<size_t>(rows[n]) >= num_targets() ||
+          (n > 0 && rows[n] <= rows[n - 1]))
+        throw std::runtime_error("matrix column " + std::to_string(j) +
+                                 " has an unknown or repeated target");
+      if (values[n] != 0)
+        A[j].emplace_back(rows[n], values[n]);
+    }
+  }
+  return A;
+}
+
+// Write count elements of T, then pad to the next 8 byte boundary.
+template <typename T>
+static void write_section(std::ofstream &out, const T *values, size_t count) {
+  out.write(reinterpret_cast<const char *>(values), count * sizeof(T));
+  static const char zeros[8] = {0};
+  const size_t bytes = count * sizeof(T);
+  out.write(zeros, align8(bytes) - bytes);
+}
+
+// Sections that do not depend on the schedule pool.
+struct FixedSections {
+  size_t T;
+  vector<int32_t> d_rewards, d_penalties, a_rewards, a_penalties;
+  vector<uint64_t> area_offsets;
+  vector<int32_t> area_targets;
+  vector<ActivityRecord> activities;
+
+  explicit FixedSections(const ProtectData &data)
+      : T(data.a_penalties.size()),
+        d_rewards(data.d_rewards.begin(), data.d_rewards.end()),
+        d_penalties(data.d_penalties.begin(), data.d_penalties.end()),
+        a_rewards(data.a_rewards.begin(), data.a_rewards.end()),
+        a_penalties(data.a_penalties.begin(), data.a_penalties.end()),
+        area_offsets(1, 0) {
+    if (d_rewards.size() != T || d_penalties.size() != T ||
+        a_rewards.size() != T)
+      throw std::runtime_error("payoff vectors differ in size");
+    for (const auto &area : data.PatrolAreas) {
+      area_targets.insert(area_targets.end(), area.begin(), area.end());
+      area_offsets.push_back(area_targets.size());
+    }
+    for (const auto &a : data.activities)
+      activities.push_back({a.number, a.time, a.effectiveness});
+  }
+};
+
+/*
+ * Open path and write the header and the fixed sections; the schedule
+ * sections, of the given sizes, are for the caller to write next.
+ */
+static void write_instance_head(std::ofstream &out, const std::string &path,
+                                const FixedSections &fixed,
+                                bool has_schedules, bool has_matrix,
+                                uint64_t num_schedules, uint64_t num_patrols,
+                                uint64_t nnz) {
+  const size_t T = fixed.T;
+  InstanceHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, INSTANCE_MAGIC, sizeof(INSTANCE_MAGIC));
+  header.version = INSTANCE_VERSION;
+  header.byte_order = BYTE_ORDER_MARK;
+  header.flags = (has_schedules ? INSTANCE_HAS_SCHEDULES : 0) |
+                 (has_matrix ? INSTANCE_HAS_MATRIX : 0);
+  header.num_targets = T;
+  header.num_areas = fixed.area_offsets.size() - 1;
+  header.num_area_targets = fixed.area_targets.size();
+  header.num_activities = fixed.activities.size();
+  header.num_schedules = num_schedules;
+  header.num_patrols = num_patrols;
+  header.matrix_nnz = nnz;
+
+  const uint64_t S = has_schedules ? num_schedules + 1 : 0;
+  const uint64_t C = has_matrix ? num_schedules + 1 : 0;
+  const uint64_t sizes[NUM_SECTIONS] = {
+      T * sizeof(int32_t),
+      T * sizeof(int32_t),
+      T * sizeof(int32_t),
+      T * sizeof(int32_t),
+      fixed.area_offsets.size() * sizeof(uint64_t),
+      fixed.area_targets.size() * sizeof(int32_t),
+      fixed.activities.size() * sizeof(ActivityRecord),
+      S * sizeof(uint64_t),
+      num_patrols * sizeof(PatrolRecord),
+      C * sizeof(uint64_t),
+      nnz * sizeof(int32_t),
+      nnz * sizeof(double)};
+  uint64_t offset = align8(sizeof(InstanceHeader));
+  for (int sec = 0; sec < NUM_SECTIONS; sec++) {
+    header.offsets[sec] = offset;
+    offset += align8(sizes[sec]);
+  }
+
+  out.open(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+    throw std::runtime_error("cannot write instance " + path);
+  write_section(out, &header, 1);
+  write_section(out, fixed.d_rewards.data(), T);
+  write_section(out, fixed.d_penalties.data(), T);
+  write_section(out, fixed.a_rewards.data(), T);
+  write_section(out, fixed.a_penalties.data(), T);
+  write_section(out, fixed.area_offsets.data(), fixed.area_offsets.size());
+  write_section(out, fixed.area_targets.data(), fixed.area_targets.size());
+  write_section(out, fixed.activities.data(), fixed.activities.size());
+}
+
+// Index of the activity with patrol's number in data.activities.
+static uint32_t activity_index(const ProtectData &data, const Patrol &patrol) {
+  const auto act = std::find_if(
+      data.activities.begin(), data.activities.end(),
+      [&patrol](const Activity &a) {
+        return a.number == patrol.activity.number;
+      });
+  if (act == data.activities.end())
+    throw std::runtime_error("schedule uses an unknown activity");
+  return static_cast<uint32_t>(act - data.activities.begin());
+}
+
+void write_instance(const std::string &path, const ProtectData &data,
+                    const vector<PatrolSchedule> *schedules,
+                    bool with_matrix) {
+  if (!data.teams.empty())
+    throw std::runtime_error("instance files do not store resource teams");
+  const FixedSections fixed(data);
+  vector<uint64_t> schedule_offsets, column_offsets;
+  vector<PatrolRecord> patrols;
+  vector<int32_t> row_index;
+  vector<double> values;
+  if (schedules != nullptr) {
+    schedule_offsets.push_back(0);
+    for (const auto &schedule : *schedules) {
+      for (const auto &patrol : schedule)
+        patrols.push_back({static_cast<uint32_t>(patrol.area_num),
+                           activity_index(data, patrol)});
+      schedule_offsets.push_back(patrols.size());
+    }
+  }
+  if (schedules != nullptr && with_matrix) {
+    // Coverage runs are in row order already.
+    column_offsets.push_back(0);
+    for (const auto &schedule : *schedules) {
+      for (const auto &run : schedule_coverage(schedule, data.PatrolAreas)) {
+        for (int target = run.first; target <= run.last; target++) {
+          row_index.push_back(target);
+          values.push_back(run.effectiveness);
+        }
+      }
+      column_offsets.push_back(row_index.size());
+    }
+  }
+
+  std::ofstream out;
+  write_instance_head(out, path, fixed, schedules != nullptr,
+                      !column_offsets.empty(),
+                      schedules != nullptr ? schedules->size() : 0,
+                      patrols.size(), row_index.size());
+  write_section(out, schedule_offsets.data(), schedule_offsets.size());
+  write_section(out, patrols.data(), patrols.size());
+  write_section(out, column_offsets.data(), column_offsets.size());
+  write_section(out, row_index.data(), row_index.size());
+  write_section(out, values.data(), values.size());
+  if (!out)
+    throw std::runtime_error("failed writing instance " + path);
+}
+
+/*
+ * A section of unknown length, streamed to a scratch file and copied into
+ * the instance afterwards.
+ */
+template <typename T> class SpilledSection {
+private:
+  std::string path;
+  std::ofstream out;
+  uint64_t n;
+
+public:
+  explicit SpilledSection(const std::string &path)
+      : path(path), out(path, std::ios::binary | std::ios::trunc), n(0) {
+    if (!out)
+      throw std::runtime_error("cannot write " + path);
+  }
+  ~SpilledSection() { std::remove(path.c_str()); }
+  void push_back(const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    n++;
+  }
+  uint64_t size() const { return n; }
+
+  // Append the section to dest, padded like write_section.
+  void copy_to(std::ofstream &dest) {
+    out.close();
+    if (!out)
+      throw std::runtime_error("failed writing " + path);
+    std::ifstream in(path, std::ios::binary);
+    vector<char> buffer(1 << 16);
+    while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+      dest.write(buffer.data(), in.gcount());
+    static const char zeros[8] = {0};
+    const uint64_t bytes = n * sizeof(T);
+    dest.write(zeros, align8(bytes) - bytes);
+  }
+};
+
+void write_instance(const std::string &path, const ProtectData &data,
+                    const SchedulePool &pool, bool with_matrix) {
+  ScopedTimer timer("write_instance");
+  if (!data.teams.empty())
+    throw std::runtime_error("instance files do not store resource teams");
+  const FixedSections fixed(data);
+  const std::string scratch = pool.scratch_path("section");
+  SpilledSection<uint64_t> schedule_offsets(scratch + ".schedules");
+  SpilledSection<PatrolRecord> patrols(scratch + ".patrols");
+  SpilledSection<uint64_t> column_offsets(scratch + ".columns");
+  SpilledSection<int32_t> row_index(scratch + ".rows");
+  SpilledSection<double> values(scratch + ".values");
+
+  // One pass over the merged pool fills every schedule section.
+  schedule_offsets.push_back(0);
+  if (with_matrix)
+    column_offsets.push_back(0);
+  pool.for_each([&](const PatrolSchedule &schedule) {
+    for (const auto &patrol : schedule)
+      patrols.push_back({static_cast<uint32_t>(patrol.area_num),
+                         activity_index(data, patrol)});
+    schedule_offsets.push_back(patrols.size());
+    if (!with_matrix)
+      return;
+    for (const auto &run : schedule_coverage(schedule, data.PatrolAreas)) {
+      for (int target = run.first; target <= run.last; target++) {
+        row_index.push_back(target);
+        values.push_back(run.effectiveness);
+      }
+    }
+    column_offsets.push_back(row_index.size());
+  });
+
+  std::ofstream out;
+  write_instance_head(out, path, fixed, true, with_matrix, pool.size(),
+                      patrols.size(), row_index.size());
+  schedule_offsets.copy_to(out);
+  patrols.copy_to(out);
+  column_offsets.copy_to(out);
+  row_index.copy_to(out);
+  values.copy_to(out);
+  if (!out)
+    throw std::runtime_error("failed writing instance " + path);
+}
+
+void read_instance_text(std::istream &in, ProtectData &data,
+                        vector<PatrolSchedule> &schedules) {
+  string line;
+  int line_no = 0;
+  auto fail = [&line_no](const string &msg) {
+    throw std::runtime_error("line " + std::to_string(line_no) + ": " + msg);
+  };
+  auto find_activity = [&data, &fail](int number) {
+    for (const auto &a : data.activities)
+      if (a.number == number)
+        return a;
+    fail("unknown activity " + std::to_string(number));
+    return Activity();
+  };
+
+  while (std::getline(in, line)) {
+    line_no++;
+    const auto comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+    std::istringstream fields(line);
+    string keyword;
+    if (!(fields >> keyword))
+      continue;
+
+    if (keyword == "targets") {
+      size_t n;
+      if (!(fields >> n))
+        fail("expected a target count");
+      data.d_rewards.assign(n, 0);
+      data.d_penalties.assign(n, 0);
+      data.a_rewards.assign(n, 0);
+      data.a_penalties.assign(n, 0);
+    } else if (keyword == "target") {
+      size_t i;
+      int rd, pd, ra, pa;
+      if (!(fields >> i >> rd >> pd >> ra >> pa))
+        fail("expected: target i R_d P_d R_a P_a");
+      if (i >= data.d_rewards.size())
+        fail("target " + std::to_string(i) + " is past 'targets'");
+      data.d_rewards[i] = rd;
+      data.d_penalties[i] = pd;
+      data.a_rewards[i] = ra;
+      data.a_penalties[i] = pa;
+    } else if (keyword == "activity") {
+      Activity a;
+      if (!(fields >> a.number >> a.time >> a.effectiveness))
+        fail("expected: activity number time effectiveness");
+      data.activities.push_back(a);
+    } else if (keyword == "area") {
+      PatrolArea area;
+      int t;
+      while (fields >> t) {
+        if (t < 0 || static_cast<size_t>(t) >= data.d_rewards.size())
+          fail("target " + std::to_string(t) + " is past 'targets'");
+        area.push_back(t);
+      }
+      data.PatrolAreas.push_back(area);
+    } else if (keyword == "areas") {
+      string range;
+      while (fields >> range) {
+        int first, last;
+        char dash;
+        std::istringstream r(range);
+        if (!(r >> first >> dash >> last) || dash != '-' || first > last)
+          fail("expected a range like 1-5, got " + range);
+        if (first < 0 || static_cast<size_t>(last) >= data.d_rewards.size())
+          fail("range " + range + " is past 'targets'");
+        PatrolArea area;
+        area.insert(first, last);
+        data.PatrolAreas.push_back(area);
+      }
+    } else if (keyword == "team") {
+      ResourceTeam team;
+      if (!(fields >> team.resources) || team.resources < 0)
+        fail("expected: team resources [activities n ...] [areas a ...]");
+      string list, word;
+      while (fields >> word) {
+        if (word == "activities" || word == "areas") {
+          list = word;
+        } else if (list == "activities") {
+          team.activities.push_back(find_activity(std::atoi(word.c_str())));
+        } else if (list == "areas") {
+          const int area = std::atoi(word.c_str());
+          if (area < 0 || static_cast<size_t>(area) >= data.PatrolAreas.size())
+            fail("unknown area " + word);
+          team.areas.push_back(area);
+        } else {
+          fail("expected 'activities' or 'areas', got " + word);
+        }
+      }
+      data.teams.push_back(team);
+    } else if (keyword == "schedule") {
+      PatrolSchedule schedule;
+      string patrol;
+      while (fields >> patrol) {
+        size_t area;
+        int number;
+        char colon;
+        std::istringstream p(patrol);
+        if (!(p >> area >> colon >> number) || colon != ':')
+          fail("expected area:activity, got " + patrol);
+        if (area >= data.PatrolAreas.size())
+          fail("unknown area " + std::to_string(area));
+        schedule.emplace_back(area, find_activity(number));
+      }
+      schedules.push_back(schedule);
+    } else {
+      fail("unknown keyword " + keyword);
+    }
+  }
+}
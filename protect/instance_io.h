@@ -0,0 +1,212 @@
+#ifndef INSTANCE_IO_H
+#define INSTANCE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "protect.h"
+#include "schedule_pool.h"
+
+/*
+ * Binary instance format. A file holds one ProtectData and, optionally, a
+ * schedule pool and the sparse effectiveness matrix of that pool. Every
+ * section is a flat array at an 8 byte aligned offset, so a mapped file is
+ * read in place without parsing.
+ *
+ *   InstanceHeader
+ *   d_rewards, d_penalties, a_rewards, a_penalties   int32[num_targets]
+ *   area_offsets                                     uint64[num_areas + 1]
+ *   area_targets                                     int32[num_area_targets]
+ *   activities                                       ActivityRecord[]
+ *   schedule_offsets                                 uint64[num_schedules + 1]
+ *   patrols                                          PatrolRecord[]
+ *   column_offsets                                   uint64[num_schedules + 1]
+ *   row_index                                        int32[matrix_nnz]
+ *   values                                           double[matrix_nnz]
+ *
+ * The matrix is stored by column (one column per schedule), matching the a_j
+ * variables of constraint (16), with the rows of a column ascending.
+ */
+
+const uint32_t INSTANCE_VERSION = 1;
+const uint32_t INSTANCE_HAS_SCHEDULES = 1 << 0;
+const uint32_t INSTANCE_HAS_MATRIX = 1 << 1;
+
+enum InstanceSection {
+  SEC_D_REWARDS,
+  SEC_D_PENALTIES,
+  SEC_A_REWARDS,
+  SEC_A_PENALTIES,
+  SEC_AREA_OFFSETS,
+  SEC_AREA_TARGETS,
+  SEC_ACTIVITIES,
+  SEC_SCHEDULE_OFFSETS,
+  SEC_PATROLS,
+  SEC_COLUMN_OFFSETS,
+  SEC_ROW_INDEX,
+  SEC_VALUES,
+  NUM_SECTIONS
+};
+
+struct InstanceHeader {
+  char magic[8];      // "PROTECT\0"
+  uint32_t version;   // INSTANCE_VERSION
+  uint32_t byte_order; // 0x01020304 as written by the producer
+  uint32_t flags;     // INSTANCE_HAS_* bits
+  uint32_t reserved;
+  uint64_t num_targets; // Payoff slots, including the unused slot 0.
+  uint64_t num_areas;
+  uint64_t num_area_targets;
+  uint64_t num_activities;
+  uint64_t num_schedules;
+  uint64_t num_patrols;
+  uint64_t matrix_nnz;
+  uint64_t offsets[NUM_SECTIONS]; // Byte offset of each section.
+};
+
+struct ActivityRecord {
+  int32_t number;
+  int32_t time;
+  double effectiveness;
+};
+
+struct PatrolRecord {
+  uint32_t area;     // Index into the patrol areas.
+  uint32_t activity; // Index into the activities.
+};
+
+// Read only view of a contiguous array, the C++14 stand in for std::span.
+template <typename T> class array_view {
+private:
+  const T *ptr;
+  size_t len;
+
+public:
+  array_view() : ptr(nullptr), len(0) {}
+  array_view(const T *ptr, size_t len) : ptr(ptr), len(len) {}
+  const T *begin() const { return ptr; }
+  const T *end() const { return ptr + len; }
+  const T *data() const { return ptr; }
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+  const T &operator[](size_t i) const { return ptr[i]; }
+};
+
+/*
+ * A memory mapped instance file. Accessors return views into the mapping and
+ * stay valid for the lifetime of the InstanceFile.
+ */
+class InstanceFile {
+private:
+  const char *base;
+  size_t length;
+  const InstanceHeader *header;
+
+  template <typename T>
+  array_view<T> section(InstanceSection sec, uint64_t count) const;
+
+  void validate() const;
+
+public:
+  /**
+   * Map and validate an instance file.
+   *
+   * @param path file to map
+   *
+   * @throws std::runtime_error if the file cannot be mapped or is malformed
+   */
+  explicit InstanceFile(const std::string &path);
+  ~InstanceFile();
+  InstanceFile(const InstanceFile &) = delete;
+  InstanceFile &operator=(const InstanceFile &) = delete;
+
+  size_t num_targets() const { return header->num_targets; }
+  size_t num_areas() const { return header->num_areas; }
+  size_t num_schedules() const { return header->num_schedules; }
+  bool has_schedules() const;
+  bool has_matrix() const;
+
+  array_view<int32_t> d_rewards() const;
+  array_view<int32_t> d_penalties() const;
+  array_view<int32_t> a_rewards() const;
+  array_view<int32_t> a_penalties() const;
+  array_view<ActivityRecord> activities() const;
+
+  // Targets of patrol area i.
+  array_view<int32_t> area(size_t i) const;
+
+  // Patrols of schedule j.
+  array_view<PatrolRecord> schedule(size_t j) const;
+
+  // Non zero rows of column j of the effectiveness matrix, and their values.
+  array_view<int32_t> column_rows(size_t j) const;
+  array_view<double> column_values(size_t j) const;
+
+  // Copy the mapped instance into the structures the solver takes.
+  ProtectData to_protect_data() const;
+  vector<PatrolSchedule> schedules() const;
+
+  /*
+   * The effectiveness matrix as the sparse columns the solver, solve cache
+   * and checkpoints take. This is a copy of the non zeros, built on every
+   * call; column_rows and column_values read the mapping in place.
+   */
+  SparseColumns effectiveness_columns() const;
+};
+
+/**
+ * Write an instance file. The effectiveness matrix is built from the
+ * schedules when with_matrix is set.
+ *
+ * @param path output file
+ * @param data instance
+ * @param schedules schedule pool to store, or nullptr
+ * @param with_matrix store the sparse effectiveness matrix of the schedules
+ *
+ * @throws std::runtime_error on I/O failure, or if data has resource teams,
+ * which the format does not store
+ */
+void write_instance(const std::string &path, const ProtectData &data,
+                    const vector<PatrolSchedule> *schedules,
+                    bool with_matrix);
+
+/**
+ * Write an instance file with a finished external schedule pool, building
+ * the effectiveness matrix in the same sequential pass over the pool. The
+ * schedule sections go to the pool's scratch directory first, so memory use
+ * does not grow with the pool.
+ *
+ * @throws std::runtime_error on I/O failure, or if data has resource teams,
+ * which the format does not store
+ */
+void write_instance(const std::string &path, const ProtectData &data,
+                    const SchedulePool &pool, bool with_matrix);
+
+/**
+ * Parse the readable instance description. Lines are
+ *
+ *   targets N                      number of payoff slots, including slot 0
+ *   target i R_d P_d R_a P_a       payoffs of target i
+ *   activity number time effect    a defender activity
+ *   area t1 t2 ...                 a patrol area, in order
+ *   areas a-b a-b ...              patrol areas given as target ranges
+ *   schedule area:activity ...     a schedule, activity by number
+ *   team R [activities n ...] [areas a ...]
+ *                                  a resource team of R officers, limited to
+ *                                  the listed activities and areas, if any
+ *
+ * '#' starts a comment. Unlisted targets have zero payoffs.
+ *
+ * @param in input stream
+ * @param data parsed instance
+ * @param schedules parsed schedules, if any
+ *
+ * @throws std::runtime_error with the line number on malformed input
+ */
+void read_instance_text(std::istream &in, ProtectData &data,
+                        vector<PatrolSchedule> &schedules);
+
+#endif /* INSTANCE_IO_H */
@@ -0,0 +1,237 @@
+#include "json.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+const JsonValue *JsonValue::get(const std::string &key) const {
+  if (type != OBJECT)
+    return nullptr;
+  for (const auto &member : object)
+    if (member.first == key)
+      return &member.second;
+  return nullptr;
+}
+
+double JsonValue::get_number(const std::string &key, double fallback) const {
+  const JsonValue *v = get(key);
+  return v != nullptr && v->type == NUMBER ? v->number : fallback;
+}
+
+std::string JsonValue::get_string(const std::string &key,
+                                  const std::string &fallback) const {
+  const JsonValue *v = get(key);
+  return v != nullptr && v->type == STRING ? v->str : fallback;
+}
+
+class JsonParser {
+private:
+  const std::string &text;
+  size_t pos;
+
+  void fail(const std::string &msg) const {
+    throw std::runtime_error("json: " + msg + " at offset " +
+                             std::to_string(pos));
+  }
+
+  void skip_space() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                                 text[pos] == '\n' || text[pos] == '\r'))
+      pos++;
+  }
+
+  void expect(char c) {
+    skip_space();
+    if (pos >= text.size() || text[pos] != c)
+      fail(std::string("expected '") + c + "'");
+    pos++;
+  }
+
+  bool consume(const char *word) {
+    const std::string w(word);
+    if (text.compare(pos, w.size(), w) != 0)
+      return false;
+    pos += w.size();
+    return true;
+  }
+
+  std::string parse_string() {
+    expect('"');
+    std::string result;
+    while (pos < text.size() && text[pos] != '"') {
+      char c = text[pos++];
+      if (c != '\\') {
+        result += c;
+        continue;
+      }
+      if (pos >= text.size())
+        fail("unterminated escape");
+      c = text[pos++];
+      switch (c) {
+      case 'n': result += '\n'; break;
+      case 't': result += '\t'; break;
+      case 'r': result += '\r'; break;
+      case 'b': result += '\b'; break;
+      case 'f': result += '\f'; break;
+      case 'u': {
+        if (pos + 4 > text.size())
+          fail("short \\u escape");
+        const unsigned code =
+            std::strtoul(text.substr(pos, 4).c_str(), nullptr, 16);
+        pos += 4;
+        // Only the ASCII range matters to the protocol.
+        result += code < 0x80 ? static_cast<char>(code) : '?';
+        break;
+      }
+      default: result += c; break;
+      }
+    }
+    if (pos >= text.size())
+      fail("unterminated string");
+    pos++;
+    return result;
+  }
+
+public:
+  explicit JsonParser(const std::string &text) : text(text), pos(0) {}
+
+  JsonValue parse_value() {
+    skip_space();
+    if (pos >= text.size())
+      fail("unexpected end of input");
+    JsonValue v;
+    const char c = text[pos];
+    if (c == '{') {
+      v.type = JsonValue::OBJECT;
+      pos++;
+      skip_space();
+      if (pos < text.size() && text[pos] == '}') {
+        pos++;
+        return v;
+      }
+      do {
+        skip_space();
+        std::string key = parse_string();
+        expect(':');
+        v.object.emplace_back(key, parse_value());
+        skip_space();
+      } while (pos < text.size() && text[pos] == ',' && ++pos);
+      expect('}');
+    } else if (c == '[') {
+      v.type = JsonValue::ARRAY;
+      pos++;
+      skip_space();
+      if (pos < text.size() && text[pos] == ']') {
+        pos++;
+        return v;
+      }
+      do {
+        v.array.push_back(parse_value());
+        skip_space();
+      } while (pos < text.size() && text[pos] == ',' && ++pos);
+      expect(']');
+    } else if (c == '"') {
+      v.type = JsonValue::STRING;
+      v.str = parse_string();
+    } else if (consume("true")) {
+      v.type = JsonValue::BOOL;
+      v.boolean = true;
+    } else if (consume("false")) {
+      v.type = JsonValue::BOOL;
+    } else if (consume("null")) {
+      v.type = JsonValue::NUL;
+    } else {
+      const char *start = text.c_str() + pos;
+      char *end;
+      v.type = JsonValue::NUMBER;
+      v.number = std::strtod(start, &end);
+      if (end == start)
+        fail("unexpected character");
+      pos += end - start;
+    }
+    return v;
+  }
+
+  void finish() {
+    skip_space();
+    if (pos != text.size())
+      fail("trailing characters");
+  }
+};
+
+JsonValue parse_json(const std::string &text) {
+  JsonParser parser(text);
+  JsonValue v = parser.parse_value();
+  parser.finish();
+  return v;
+}
+
+std::string json_quote(const std::string &s) {
+  std::string result = "\"";
+  for (const char c : s) {
+    switch (c) {
+    case '"': result += "\\\""; break;
+    case '\\': result += "\\\\"; break;
+    case '\n': result += "\\n"; break;
+    case '\t': result += "\\t"; break;
+    case '\r': result += "\\r"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+        result += buf;
+      } else {
+        result += c;
+      }
+    }
+  }
+  return result + "\"";
+}
+
+static const char BASE64_DIGITS[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const std::string &bytes) {
+  std::string result;
+  result.reserve((bytes.size() + 2) / 3 * 4);
+  for (size_t i = 0; i < bytes.size(); i += 3) {
+    const size_t n = std::min<size_t>(3, bytes.size() - i);
+    uint32_t group = 0;
+    for (size_t k = 0; k < 3; k++)
+      group = group << 8 |
+              (k < n ? static_cast<unsigned char>(bytes[i + k]) : 0);
+    for (size_t k = 0; k < 4; k++)
+      result += k <= n ? BASE64_DIGITS[group >> (18 - 6 * k) & 63] : '=';
+  }
+  return result;
+}
+
+std::string base64_decode(const std::string &text) {
+  if (text.size() % 4 != 0)
+    throw std::runtime_error("base64: length is not a multiple of 4");
+  std::string result;
+  result.reserve(text.size() / 4 * 3);
+  for (size_t i = 0; i < text.size(); i += 4) {
+    uint32_t group = 0;
+    size_t pad = 0;
+    for (size_t k = 0; k < 4; k++) {
+      const char c = text[i + k];
+      const char *digit = std::strchr(BASE64_DIGITS, c);
+      if (c == '=' && i + 4 == text.size() && k >= 2) {
+        pad++;
+        group <<= 6;
+      } else if (c != '\0' && digit != nullptr && pad == 0) {
+        group = group << 6 | static_cast<uint32_t>(digit - BASE64_DIGITS);
+      } else {
+        throw std::runtime_error("base64: bad digit at offset " +
+                                 std::to_string(i + k));
+      }
+    }
+    for (size_t k = 0; k < 3 - pad; k++)
+      result += static_cast<char>(group >> (16 - 8 * k) & 0xff);
+  }
+  return result;
+}
@@ -0,0 +1,64 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Minimal JSON reader for the service protocol. Numbers are doubles, objects
+ * keep their keys in order.
+ */
+class JsonValue {
+public:
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  JsonValue() : type(NUL), boolean(false), number(0) {}
+
+  Type type;
+  bool boolean;
+  double number;
+  std::string str;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+
+  bool is_null() const { return type == NUL; }
+
+  /**
+   * Member of an object.
+   *
+   * @param key member name
+   *
+   * @return the member, or nullptr if this is not an object or has no key
+   */
+  const JsonValue *get(const std::string &key) const;
+
+  // Typed member access with a fallback for missing members.
+  double get_number(const std::string &key, double fallback) const;
+  std::string get_string(const std::string &key,
+                         const std::string &fallback) const;
+};
+
+/**
+ * Parse a JSON document.
+ *
+ * @param text document
+ *
+ * @throws std::runtime_error on malformed input
+ */
+JsonValue parse_json(const std::string &text);
+
+// Quote and escape a string for JSON output.
+std::string json_quote(const std::string &s);
+
+// Base64 (RFC 4648, padded) for binary payloads in JSON strings.
+std::string base64_encode(const std::string &bytes);
+
+/**
+ * Decode base64.
+ *
+ * @throws std::runtime_error on malformed input
+ */
+std::string base64_decode(const std::string &text);
+
+#endif /* JSON_H */
@@ -1,14 +1,48 @@
 #include "lin_prog.h"
+#include "stats.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <deque>
 #include <stdexcept>
 #include <exception>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 using std::to_string;
 using std::cout;
 using std::endl;
 
+/*
+ * Best integer solution of a parallel run, shared by its workers. obj is
+ * also read without the lock, to skip solutions that are no better.
+ */
+struct SharedIncumbent {
+  std::mutex mutex;
+  int dir;       // GLP_MIN or GLP_MAX.
+  double target; // Stop at a solution at least this good.
+  std::atomic<double> obj;
+  std::vector<double> x; // Columns from 1; empty until one is found.
+  std::atomic<size_t> version;
+  std::atomic<bool> stop;
+
+  SharedIncumbent(int dir, double target)
+      : dir(dir), target(target),
+        obj(dir == GLP_MIN ? DBL_MAX : -DBL_MAX), version(0), stop(false) {}
+
+  bool better(double value) const {
+    return dir == GLP_MIN ? value < obj : value > obj;
+  }
+  bool reached(double value) const {
+    return dir == GLP_MIN ? value <= target : value >= target;
+  }
+};
+
 lin_prog::lin_prog(string name) {
   this->num_vars = 1;
   this->name = name;
@@ -16,12 +50,44 @@ lin_prog::lin_prog(string name) {
   this->cols.push_back(0);
   this->vals.push_back(0);
   this->has_run = false;
+  this->loaded = false;
   this->cur_row = 0;
+  this->node_count = 0;
+  this->mip_gap = 0;
+  this->best_bound = -DBL_MAX;
+  this->user_cb = nullptr;
+  this->user_info = nullptr;
+  this->start_offered = false;
+  this->presolve = true;
+  this->presolved = false;
+  this->root_infeasible = false;
+  this->shared = nullptr;
+  this->shared_seen = 0;
+  this->parallel_result = false;
+  this->parallel_status = GLP_UNDEF;
+  this->parallel_obj = 0;
   this->lp = glp_create_prob();
   glp_set_prob_name(lp, name.c_str());
   glp_set_obj_dir(lp, GLP_MIN); // default to minimize
 }
 
+lin_prog::lin_prog(const lin_prog &other, string name)
+    : num_vars(other.num_vars), cur_row(other.cur_row), rows(other.rows),
+      cols(other.cols), vals(other.vals), variables(other.variables),
+      offsets(other.offsets), name(name), has_run(false),
+      loaded(other.loaded), node_count(0), mip_gap(0), best_bound(-DBL_MAX),
+      user_cb(nullptr),
+      user_info(nullptr), mip_start(other.mip_start), start_offered(false),
+      presolve(other.presolve), presolved(false), root_infeasible(false),
+      shared(nullptr),
+      shared_seen(0), parallel_result(false), parallel_status(GLP_UNDEF),
+      parallel_obj(0) {
+  this->lp = glp_create_prob();
+  // Copies columns, rows, bounds, kinds, objective and any loaded matrix.
+  glp_copy_prob(lp, other.lp, GLP_ON);
+  glp_set_prob_name(lp, name.c_str());
+}
+
 lin_prog::~lin_prog() {
   glp_delete_prob(lp);  
 }
@@ -56,8 +122,8 @@ void lin_prog::declare_variables(string name, size_t num) {
   if (this->has(name))
     throw std::bad_alloc();
 // #ifdef DEBUG
-  std::cout << "declaring variable " + name << " with " << num << " indices"
-            << endl;
+  solver_log() << "declaring variable " + name << " with " << num
+               << " indices" << endl;
 // #endif
   glp_add_cols(lp, num);
   variables.push_back(name);
@@ -80,12 +146,71 @@ void lin_prog::add_constraint(string var, size_t index, double value) {
   rows.push_back(cur_row);
   cols.push_back(bounds.first + (index - 1));
   vals.push_back(value);
+  loaded = false;
+}
+
+void lin_prog::add_variables(string var, size_t num) {
+  if (variables.empty() || variables.back() != var)
+    throw std::invalid_argument("[add_variables] " + var +
+                                " is not the last declared variable");
+  glp_add_cols(lp, num);
+  const size_t declared = num_vars - offsets.back();
+  for (size_t i = 0; i < num; i++)
+    glp_set_col_name(lp, num_vars + i,
+                     (var + std::to_string(declared + i)).c_str());
+  num_vars += num;
+}
+
+void lin_prog::set_column(string var, size_t index,
+                          const std::vector<std::pair<size_t, double>> &entries) {
+  const auto bounds = get_bounds(var);
+  if (index < 1 || (index - 1) + bounds.first > bounds.second) {
+    throw std::invalid_argument("[set_column] " + std::to_string(index) +
+                                " is out of bounds for " + var);
+  }
+  const int col = bounds.first + (index - 1);
+  // Keep the triplets in step, in case the matrix is loaded again.
+  size_t kept = 1;
+  for (size_t n = 1; n < cols.size(); n++) {
+    if (cols[n] == col)
+      continue;
+    rows[kept] = rows[n];
+    cols[kept] = cols[n];
+    vals[kept] = vals[n];
+    kept++;
+  }
+  rows.resize(kept);
+  cols.resize(kept);
+  vals.resize(kept);
+  std::vector<int> ind(1, 0);
+  std::vector<double> val(1, 0);
+  for (const auto &entry : entries) {
+    if (entry.first < 1 || entry.first > cur_row)
+      throw std::invalid_argument("[set_column] row " +
+                                  std::to_string(entry.first) +
+                                  " does not exist");
+    rows.push_back(entry.first);
+    cols.push_back(col);
+    vals.push_back(entry.second);
+    ind.push_back(entry.first);
+    val.push_back(entry.second);
+  }
+  if (loaded)
+    glp_set_mat_col(lp, col, entries.size(), &ind[0], &val[0]);
 }
 
 void lin_prog::set_row_bnd(int type, double lvalue, double rvalue) {
   glp_set_row_bnds(lp, cur_row, type, lvalue, rvalue);
 }
 
+void lin_prog::set_row_bnd(size_t row, int type, double lvalue,
+                           double rvalue) {
+  if (row < 1 || row > cur_row)
+    throw std::invalid_argument("[set_row_bnd] row " + std::to_string(row) +
+                                " does not exist");
+  glp_set_row_bnds(lp, row, type, lvalue, rvalue);
+}
+
 void lin_prog::set_var_bnd(string var, size_t index, int type, double lvalue,
                            double rvalue) {
   const auto bounds = get_bounds(var);
@@ -114,6 +239,10 @@ void lin_prog::set_objective_var(string var, size_t index, double value) {
   glp_set_obj_coef(lp, bounds.first + (index - 1), value);
 }
 
+void lin_prog::set_objective_const(double value) {
+  glp_set_obj_coef(lp, 0, value);
+}
+
 void lin_prog::set_max() { glp_set_obj_dir(lp, GLP_MAX); }
 void lin_prog::set_min() { glp_set_obj_dir(lp, GLP_MIN); }
 
@@ -131,16 +260,360 @@ void lin_prog::apply_constraints() {
   glp_load_matrix(lp, (this->rows.size() - 1), &rows[0], &cols[0], &vals[0]);
 }
 
+void lin_prog::callback(glp_tree *tree, void *info) {
+  lin_prog *LP = static_cast<lin_prog *>(info);
+  int a_cnt, n_cnt, t_cnt;
+  glp_ios_tree_size(tree, &a_cnt, &n_cnt, &t_cnt);
+  LP->node_count = std::max(LP->node_count, static_cast<size_t>(t_cnt));
+  LP->mip_gap = glp_ios_mip_gap(tree);
+  const int best = glp_ios_best_node(tree);
+  if (best != 0)
+    LP->best_bound = glp_ios_node_bound(tree, best);
+  if (LP->shared != nullptr) {
+    LP->share_incumbent(tree);
+    if (LP->shared->stop)
+      return;
+  }
+  if (glp_ios_reason(tree) == GLP_IHEUR && !LP->start_offered) {
+    glp_ios_heur_sol(tree, &LP->mip_start[0]);
+    LP->start_offered = true;
+  }
+  if (LP->user_cb != nullptr)
+    LP->user_cb(tree, LP->user_info);
+}
+
 int lin_prog::run(glp_iocp* parm) {
-  if (parm != nullptr) {
-    parm->presolve = GLP_ON;    
-    glp_init_iocp(parm);
+  ScopedTimer timer("lin_prog_run");
+  glp_iocp defaults;
+  if (parm == nullptr) {
+    glp_init_iocp(&defaults);
+    parm = &defaults;
+  }
+  parm->presolve = GLP_ON;
+  // Heuristic solutions are given in terms of the original columns, which the
+  // presolver would remove, so a start needs an optimal relaxation instead.
+  // Without one (or after columns were added) the start is not offered.
+  start_offered = true;
+  root_infeasible = false;
+  const bool has_start = !mip_start.empty() && mip_start.size() == num_vars;
+  if (has_start || !presolve) {
+    glp_smcp smcp;
+    glp_init_smcp(&smcp);
+    smcp.msg_lev = std::min(parm->msg_lev, GLP_MSG_ERR);
+    if (!loaded) {
+      apply_constraints();
+      loaded = true;
+    }
+    const int simplex = glp_simplex(lp, &smcp);
+    if (simplex == 0 && glp_get_status(lp) == GLP_OPT) {
+      parm->presolve = GLP_OFF;
+      start_offered = !has_start;
+    } else if (!presolve) {
+      // Callbacks rely on the columns of this LP, so there is no falling
+      // back to the presolver. An infeasible relaxation settles the run.
+      parm->presolve = GLP_OFF;
+      root_infeasible = simplex == 0 && glp_get_status(lp) == GLP_NOFEAS;
+    }
+  }
+  presolved = parm->presolve == GLP_ON;
+  user_cb = parm->cb_func;
+  user_info = parm->cb_info;
+  parm->cb_func = &lin_prog::callback;
+  parm->cb_info = this;
+
+  // Rerunning with a new objective or bounds reuses the loaded matrix.
+  if (!loaded) {
+    apply_constraints();
+    loaded = true;
   }
-  apply_constraints();
   has_run = true;
-  return glp_intopt(lp, parm);
+  parallel_result = false;
+  node_count = 0;
+  mip_gap = 0;
+  best_bound = -DBL_MAX;
+#if GLP_MAJOR_VERSION > 4 || (GLP_MAJOR_VERSION == 4 && GLP_MINOR_VERSION >= 65)
+  const int iterations_before = glp_get_it_cnt(lp);
+#endif
+  const int ret = root_infeasible ? GLP_ENOPFS : glp_intopt(lp, parm);
+
+  // Hand the caller back its own callback.
+  parm->cb_func = user_cb;
+  parm->cb_info = user_info;
+
+  SolveStats &stats = current_stats();
+  stats.mip_solves++;
+  stats.bnb_nodes += node_count;
+  stats.last_mip_gap = mip_gap;
+  stats.max_mip_gap = std::max(stats.max_mip_gap, mip_gap);
+#if GLP_MAJOR_VERSION > 4 || (GLP_MAJOR_VERSION == 4 && GLP_MINOR_VERSION >= 65)
+  stats.simplex_iterations += glp_get_it_cnt(lp) - iterations_before;
+#endif
+  return ret;
 }
 
+void lin_prog::share_incumbent(glp_tree *tree) {
+  SharedIncumbent &best = *shared;
+  if (best.stop) {
+    glp_ios_terminate(tree);
+    return;
+  }
+  glp_prob *prob = glp_ios_get_prob(tree);
+  const int reason = glp_ios_reason(tree);
+  // On GLP_IBINGO the node's LP solution is integer feasible; GLPK only
+  // records it after the callback. Heuristic solutions are recorded at once.
+  const bool bingo = reason == GLP_IBINGO;
+  if (bingo || glp_mip_status(prob) == GLP_FEAS) {
+    const double value = bingo ? glp_get_obj_val(prob) : glp_mip_obj_val(prob);
+    if (best.better(value)) {
+      std::lock_guard<std::mutex> lock(best.mutex);
+      if (best.better(value)) {
+        best.x.resize(num_vars);
+        for (size_t j = 1; j < num_vars; j++)
+          best.x[j] = bingo ? glp_get_col_prim(prob, j)
+                            : glp_mip_col_val(prob, j);
+        best.obj = value;
+        shared_seen = ++best.version;
+        if (best.reached(value))
+          best.stop = true;
+      }
+    }
+  }
+  if (reason == GLP_IHEUR && best.version != shared_seen) {
+    std::vector<double> x;
+    {
+      std::lock_guard<std::mutex> lock(best.mutex);
+      x = best.x;
+      shared_seen = best.version;
+    }
+    // GLPK ignores it unless it beats this tree's incumbent.
+    glp_ios_heur_sol(tree, &x[0]);
+  }
+  if (best.stop)
+    glp_ios_terminate(tree);
+}
+
+int lin_prog::run_parallel(glp_iocp *parm,
+                           const std::vector<Subproblem> &parts,
+                           size_t threads, double target) {
+  ScopedTimer timer("lin_prog_run");
+  typedef std::chrono::steady_clock clock;
+  const auto start = clock::now();
+  glp_iocp defaults;
+  if (parm == nullptr) {
+    glp_init_iocp(&defaults);
+    parm = &defaults;
+  }
+  // Workers copy the loaded matrix.
+  if (!loaded) {
+    apply_constraints();
+    loaded = true;
+  }
+  has_run = true;
+  presolved = false;
+  SharedIncumbent best(glp_get_obj_dir(lp), target);
+
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  threads = std::max<size_t>(1, std::min(threads, parts.size()));
+  // Subproblems are dealt out in turn; a worker takes the front of its own
+  // queue and steals from the back of the others.
+  std::vector<std::deque<size_t>> queues(threads);
+  std::vector<std::mutex> locks(threads);
+  for (size_t p = 0; p < parts.size(); p++)
+    queues[p % threads].push_back(p);
+  auto take = [&](size_t w, size_t &part) {
+    for (size_t n = 0; n < threads; n++) {
+      const size_t q = (w + n) % threads;
+      std::lock_guard<std::mutex> lock(locks[q]);
+      if (queues[q].empty())
+        continue;
+      if (n == 0) {
+        part = queues[q].front();
+        queues[q].pop_front();
+      } else {
+        part = queues[q].back();
+        queues[q].pop_back();
+      }
+      return true;
+    }
+    return false;
+  };
+
+  struct Outcome {
+    bool started;
+    int ret;
+    int status;
+    double obj;
+    double bound;
+  };
+  std::vector<Outcome> outcomes(parts.size(),
+                                Outcome{false, 0, GLP_UNDEF, 0, -DBL_MAX});
+  std::vector<SolveStats> worker_stats(threads);
+  std::vector<std::exception_ptr> errors(threads);
+  std::atomic<bool> timed_out(false);
+  std::atomic<size_t> nodes(0);
+  // glp_term_out is per thread; workers follow the caller.
+  const int term_out = glp_term_out(GLP_ON);
+  glp_term_out(term_out);
+
+  auto work = [&](size_t w) {
+    glp_term_out(term_out);
+    try {
+      lin_prog worker(*this, name + "-" + std::to_string(w));
+      // Never presolved, so callbacks may go by this LP's is_presolved().
+      worker.presolve = false;
+      worker.shared = &best;
+      size_t part;
+      while (!best.stop && take(w, part)) {
+        glp_iocp local = *parm;
+        if (parm->tm_lim > 0 && parm->tm_lim < INT_MAX) {
+          const double left =
+              parm->tm_lim -
+              std::chrono::duration<double, std::milli>(clock::now() - start)
+                  .count();
+          if (left < 1) {
+            timed_out = true;
+            best.stop = true;
+            break;
+          }
+          local.tm_lim = static_cast<int>(left);
+        }
+        std::vector<ColumnBound> saved;
+        for (const auto &bound : parts[part]) {
+          saved.push_back({bound.column,
+                           glp_get_col_type(worker.lp, bound.column),
+                           glp_get_col_lb(worker.lp, bound.column),
+                           glp_get_col_ub(worker.lp, bound.column)});
+          glp_set_col_bnds(worker.lp, bound.column, bound.type, bound.lower,
+                           bound.upper);
+        }
+        Outcome &outcome = outcomes[part];
+        outcome.started = true;
+        outcome.ret = worker.run(&local);
+        outcome.status = worker.get_status();
+        if (outcome.status == GLP_OPT || outcome.status == GLP_FEAS) {
+          outcome.obj = glp_mip_obj_val(worker.lp);
+          // In case the tree ended before a callback could publish it.
+          std::lock_guard<std::mutex> lock(best.mutex);
+          if (best.better(outcome.obj)) {
+            best.x = worker.get_solution();
+            best.obj = outcome.obj;
+            best.version++;
+            if (best.reached(outcome.obj))
+              best.stop = true;
+          }
+        }
+        outcome.bound = worker.best_bound;
+        nodes += worker.node_count;
+        for (auto bound = saved.rbegin(); bound != saved.rend(); ++bound)
+          glp_set_col_bnds(worker.lp, bound->column, bound->type,
+                           bound->lower, bound->upper);
+      }
+    } catch (...) {
+      errors[w] = std::current_exception();
+      best.stop = true;
+    }
+    worker_stats[w] = current_stats();
+    // Release the GLPK environment of this worker thread.
+    glp_free_env();
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t w = 0; w < threads; w++)
+    pool.emplace_back(work, w);
+  for (auto &thread : pool)
+    thread.join();
+  for (const auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+  node_count = nodes;
+
+  // Solved subproblems bound the optimum by their own, stopped ones by their
+  // best node, and ones never started not at all. A subproblem without a
+  // feasible solution (the level fixings of a part can contradict the
+  // resources) is solved, and bounds nothing.
+  auto rank = [](int code) {
+    // Failures outrank running out of time, the gap, and plain stops.
+    return code == GLP_ESTOP ? 1 : code == GLP_EMIPGAP ? 2
+                                 : code == GLP_ETMLIM ? 3 : 4;
+  };
+  bool finished = true;
+  int ret = 0;
+  best_bound = DBL_MAX;
+  for (const auto &outcome : outcomes) {
+    if (!outcome.started) {
+      finished = false;
+      best_bound = -DBL_MAX;
+      continue;
+    }
+    if (outcome.ret == 0 || outcome.ret == GLP_ENOPFS ||
+        outcome.status == GLP_NOFEAS) {
+      if (outcome.status == GLP_OPT || outcome.status == GLP_FEAS)
+        best_bound = std::min(best_bound, outcome.obj);
+      continue;
+    }
+    finished = false;
+    best_bound = std::min(best_bound, outcome.bound);
+    if (ret == 0 || rank(outcome.ret) > rank(ret))
+      ret = outcome.ret;
+  }
+  if (!finished && ret == 0)
+    ret = timed_out ? GLP_ETMLIM : GLP_ESTOP;
+
+  const bool found = !best.x.empty();
+  parallel_result = true;
+  parallel_obj = best.obj;
+  parallel_x = found ? best.x : std::vector<double>(num_vars, 0);
+  if (found)
+    parallel_status = finished ? GLP_OPT : GLP_FEAS;
+  else
+    parallel_status = finished ? GLP_NOFEAS : GLP_UNDEF;
+  if (finished && found)
+    best_bound = parallel_obj;
+  mip_gap = found ? std::fabs(parallel_obj - best_bound) /
+                        (std::fabs(parallel_obj) + DBL_EPSILON)
+                  : DBL_MAX;
+
+  SolveStats &stats = current_stats();
+  for (const auto &worker : worker_stats)
+    stats.add_counters(worker);
+  stats.last_mip_gap = mip_gap;
+  stats.max_mip_gap = std::max(stats.max_mip_gap, mip_gap);
+  return ret;
+}
+
+int lin_prog::column(string var, size_t index) const {
+  const auto bounds = get_bounds(var);
+  if (index < 1 || (index - 1) + bounds.first > bounds.second)
+    throw std::invalid_argument("[column] " + std::to_string(index) +
+                                " is out of bounds for " + var);
+  return bounds.first + (index - 1);
+}
+
+size_t lin_prog::get_node_count() const { return node_count; }
+
+void lin_prog::set_mip_start(const std::vector<double> &x) {
+  if (!x.empty() && x.size() != num_vars)
+    throw std::invalid_argument("[set_mip_start] expected " +
+                                std::to_string(num_vars - 1) + " columns");
+  mip_start = x;
+}
+
+std::vector<double> lin_prog::get_solution() const {
+  if (!this->has_run)
+    throw std::logic_error("LP has to be run before getting the solution");
+  if (parallel_result)
+    return parallel_x;
+  std::vector<double> x(num_vars, 0);
+  for (size_t j = 1; j < num_vars; j++)
+    x[j] = glp_mip_col_val(lp, j);
+  return x;
+}
+
+double lin_prog::get_mip_gap() const { return mip_gap; }
+
+double lin_prog::get_best_bound() const { return best_bound; }
+
 // return a string representation of this LP
 void lin_prog::to_string() const {
   size_t row = 1;
@@ -164,10 +637,22 @@ void lin_prog::to_string() const {
   }
 }
 
+int lin_prog::get_status() const {
+  if (!this->has_run)
+    throw std::logic_error("LP has to be run before getting status");
+  if (parallel_result)
+    return parallel_status;
+  if (root_infeasible)
+    return GLP_NOFEAS;
+  return glp_mip_status(lp);
+}
+
 double lin_prog::get_obj_val() const {
   if (!this->has_run)
     throw std::logic_error("LP has to be run before getting objective");
-  return glp_get_obj_val(lp);
+  if (parallel_result)
+    return parallel_obj;
+  return glp_mip_obj_val(lp);
 }
 
 
@@ -178,5 +663,7 @@ double lin_prog::get_var_val(string var, size_t index) const {
   if (index < 1 || index - 1 + bounds.first > bounds.second)
     throw std::invalid_argument("[get_var_val] " + std::to_string(index) +
                                 " is out of bounds for " + var);
-  glp_get_col_prim(lp, bounds.first + (index - 1));
+  if (parallel_result)
+    return parallel_x[bounds.first + (index - 1)];
+  return glp_mip_col_val(lp, bounds.first + (index - 1));
 }
@@ -1,3 +1,7 @@
+#ifndef LIN_PROG_H
+#define LIN_PROG_H
+
+#include <limits>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -7,6 +11,17 @@
 
 using std::string;
 
+// Bounds of one column in a subproblem of lin_prog::run_parallel.
+struct ColumnBound {
+  int column; // GLPK column, see lin_prog::column.
+  int type;   // GLP_FX, GLP_DB, ...
+  double lower;
+  double upper;
+};
+typedef std::vector<ColumnBound> Subproblem;
+
+struct SharedIncumbent;
+
 class lin_prog {
 private:
   size_t num_vars;
@@ -18,7 +33,43 @@ private:
   std::vector<size_t> offsets;
   std::string name;
   bool has_run;
+  bool loaded; // constraints have been loaded into lp
   glp_prob *lp;
+  size_t node_count;
+  double mip_gap;
+  double best_bound; // Best bound of the open nodes, -DBL_MAX if unknown.
+  void (*user_cb)(glp_tree *tree, void *info);
+  void *user_info;
+  std::vector<double> mip_start; // Column values, indexed from 1.
+  bool start_offered;
+  bool presolve;  // Presolve runs that have no MIP start.
+  bool presolved; // The current or last run went through the presolver.
+  bool root_infeasible; // The last run's LP relaxation has no solution.
+  SharedIncumbent *shared; // Of the parallel run this is a worker of.
+  size_t shared_seen;      // Version of shared last offered to the tree.
+  // Outcome of the last run, if it was run_parallel.
+  bool parallel_result;
+  int parallel_status;
+  double parallel_obj;
+  std::vector<double> parallel_x;
+
+  /** 
+   * Trade incumbents with the other workers of a parallel run: publish this
+   * tree's integer solutions, offer better ones found elsewhere, and stop
+   * once the run is over.
+   *
+   * @param tree branch and bound tree of this worker
+   */
+  void share_incumbent(glp_tree *tree);
+
+  /** 
+   * GLPK branch and bound callback. Records tree statistics and forwards to
+   * the callback the caller set in its glp_iocp, if any.
+   *
+   * @param tree branch and bound tree
+   * @param info the lin_prog being solved
+   */
+  static void callback(glp_tree *tree, void *info);
 
   /** 
    * Apply constraints to linear program
@@ -71,6 +122,19 @@ public:
    */
   ~lin_prog();
 
+  // The GLPK problem is owned, so a lin_prog cannot be copied.
+  lin_prog(const lin_prog &) = delete;
+  lin_prog &operator=(const lin_prog &) = delete;
+
+  /** 
+   * Copy another LP into a new GLPK problem, so that the two can be changed
+   * and solved independently (for example on different threads).
+   *
+   * @param other LP to copy
+   * @param name name of the copy
+   */
+  lin_prog(const lin_prog &other, string name);
+
   /** 
    * declare a variable to be used in the LP
    *
@@ -98,6 +162,38 @@ public:
    */
   void set_row_bnd(int type, double lvalue, double rvalue);
 
+  /** 
+   * Add more indices to the variable declared last, after the model has been
+   * built. The new columns are continuous, unbounded and not in any row.
+   *
+   * @param var name of the variable, which must be the last one declared
+   * @param num number of indices to add
+   */
+  void add_variables(string var, size_t num);
+
+  /** 
+   * Replace the constraint coefficients of one column.
+   *
+   * @param var name of the variable
+   * @param index index of the sub variable
+   * @param entries (row, coefficient) pairs, rows starting at 1
+   */
+  void set_column(string var, size_t index,
+                  const std::vector<std::pair<size_t, double>> &entries);
+
+  // Number of rows added so far.
+  size_t num_rows() const { return cur_row; }
+
+  /** 
+   * Set the bounds for an existing row
+   *
+   * @param row index of the row, starting at 1
+   * @param type  type of the bound (upper, lower fixed)
+   * @param lvalue lower bound
+   * @param rvalue upper bound
+   */
+  void set_row_bnd(size_t row, int type, double lvalue, double rvalue);
+
   /** 
    * Set the bounds for variable var
    *
@@ -110,6 +206,9 @@ public:
   // Sets coefficient for variable var at index to value in objective function
   void set_objective_var(string var, size_t index, double value);
 
+  // Sets the constant term of the objective function.
+  void set_objective_const(double value);
+
   /** 
    * Set the kind of a variable (for when variable needs to be something other
    * then a continuous real variable)
@@ -121,9 +220,100 @@ public:
   void set_var_kind(string var, size_t index, int type);
   
 
-  // run mixed integer optimization on the linear program.
+  /** 
+   * run mixed integer optimization on the linear program. parm should be
+   * initialized with glp_init_iocp by the caller; nullptr uses GLPK defaults.
+   * Presolve is turned on, unless a MIP start is set or presolve is turned
+   * off: then the LP relaxation is solved first (warm from the previous
+   * basis) and the start is offered to branch and bound as a heuristic
+   * solution. With presolve off the presolver is never used; a relaxation
+   * without a feasible solution ends the run with GLP_ENOPFS and status
+   * GLP_NOFEAS, as the presolver would have.
+   *
+   * @param parm control parameters for glp_intopt
+   *
+   * @return glp_intopt return code
+   */
   int run(glp_iocp* parm);
 
+  /** 
+   * Allow or forbid the MIP presolver. Callbacks that branch on, or build
+   * solutions from, columns of this LP need it off, as the presolver hands
+   * branch and bound a transformed problem.
+   *
+   * @param on whether runs without a MIP start may presolve (the default)
+   */
+  void set_presolve(bool on) { presolve = on; }
+
+  /** 
+   * Whether the problem branch and bound works on is a presolved copy, so
+   * that its columns are not this LP's. Valid inside callbacks of a run.
+   */
+  bool is_presolved() const { return presolved; }
+
+  /** 
+   * GLPK column of a sub variable, for callbacks that work on the problem
+   * of the branch and bound tree.
+   *
+   * @param var name of the variable
+   * @param index index of the sub variable, starting at 1
+   */
+  int column(string var, size_t index) const;
+
+  /** 
+   * Branch and bound over a partition of the problem, on several threads.
+   * Each worker solves subproblems (the problem with some column bounds
+   * replaced) on its own copy of the GLPK problem, taking them from its own
+   * queue first and stealing from the others once that is empty. Integer
+   * solutions found by any worker are offered to all the others, so every
+   * tree prunes against the best one, and all stop as soon as one is at
+   * least as good as target. The results are read back with the usual
+   * getters; the best bound is the weakest over the subproblems.
+   *
+   * parm is as for run, with tm_lim covering the whole run; its callback is
+   * called from all workers at once, with this LP's column layout. The
+   * presolver is not used.
+   *
+   * @param parm control parameters for glp_intopt
+   * @param parts subproblems, which together must cover the problem
+   * @param threads workers, 0 for the hardware concurrency
+   * @param target objective at which to stop (at or below it when
+   * minimizing), NaN for none
+   *
+   * @return 0 if every subproblem was searched to the end, or found to have
+   * no feasible solution; GLP_ETMLIM if time ran out, GLP_ESTOP if a
+   * callback or target stopped the search; otherwise the error of a
+   * subproblem that failed
+   */
+  int run_parallel(glp_iocp *parm, const std::vector<Subproblem> &parts,
+                   size_t threads,
+                   double target = std::numeric_limits<double>::quiet_NaN());
+
+  // Branch and bound nodes created by the last run.
+  size_t get_node_count() const;
+
+  // Relative MIP gap at the end of the last run.
+  double get_mip_gap() const;
+
+  /** 
+   * Bound on the objective from the last run's branch and bound tree: the
+   * optimum is at least this (when minimizing). Only meaningful when the run
+   * stopped early; -DBL_MAX if no node was solved.
+   */
+  double get_best_bound() const;
+
+  /** 
+   * Offer a known integer feasible solution to the following runs. GLPK
+   * rejects it if it violates a bound, so a stale start is harmless.
+   *
+   * @param x values of all columns, indexed from 1 (x[0] is unused); empty
+   * clears the start
+   */
+  void set_mip_start(const std::vector<double> &x);
+
+  // Values of all columns in the MIP solution, indexed from 1.
+  std::vector<double> get_solution() const;
+
  /** 
   *  Add a new row of constraints
   *
@@ -146,8 +336,15 @@ public:
   // return a string representation of this LP
   void to_string() const;
 
+  // MIP status of the last run (GLP_OPT, GLP_FEAS, GLP_NOFEAS or GLP_UNDEF).
+  int get_status() const;
+
+  // Objective value of the MIP solution.
   double get_obj_val() const;
 
+  // Value of sub variable index of var in the MIP solution.
   double get_var_val(string var, size_t index) const;
 
 };
+
+#endif /* LIN_PROG_H */
@@ -1,9 +1,82 @@
 #include <stdio.h>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
 
+#include <glpk.h>
+
+#include "checkpoint.h"
+#include "coordinator.h"
+#include "instance_io.h"
 #include "protect.h"
+#include "sampler.h"
+#include "service.h"
+#include "solve_cache.h"
+#include "stats.h"
+#include "sweep.h"
 
-int main(int argc, char *argv[]) {
+// Solve an instance file, using its schedule pool and matrix when present.
+// schedules receives the pool the mixture indexes, if the file has one, or
+// the reduced pool enumerated for it, as the service and text files do.
+PasaqSolution solve_instance_file(const string &path,
+                                  const SolverParams &params,
+                                  SolveCache *cache,
+                                  vector<PatrolSchedule> &schedules) {
+  InstanceFile instance(path);
+  const ProtectData data = instance.to_protect_data();
+  if (instance.has_schedules())
+    schedules = instance.schedules();
+  if (instance.has_matrix())
+    return solve_strategy(instance.effectiveness_columns(), data, params,
+                          cache);
+  if (schedules.empty()) {
+    schedules = generate_compact_strategies(10, data);
+    reduce_schedules(schedules);
+  }
+  return solve_strategy(schedules, data, params, cache);
+}
+
+void print_roster(const ScheduleSampler &sampler, const Roster &roster) {
+  for (size_t d = 0; d < roster.size(); d++) {
+    cout << "day " << d + 1 << ":";
+    for (const size_t j : roster[d]) {
+      cout << " [";
+      for (const auto &patrol : sampler.schedule(j))
+        cout << "(" << patrol.area_num << ":k_" << patrol.activity.number
+             << ")";
+      cout << "]";
+    }
+    cout << endl;
+  }
+}
+
+// Solve a readable instance (see read_instance_text). With resource teams,
+// the teams' pools make one game and pools receives them; otherwise pools
+// receives the single pool the mixture indexes.
+PasaqSolution solve_text_instance(const string &path,
+                                  const SolverParams &params,
+                                  SolveCache *cache, ProtectData &data,
+                                  vector<vector<PatrolSchedule>> &pools) {
+  std::ifstream in(path);
+  if (!in)
+    throw std::runtime_error("cannot open " + path);
+  vector<PatrolSchedule> schedules;
+  read_instance_text(in, data, schedules);
+  if (!data.teams.empty()) {
+    pools = generate_team_strategies(10, data);
+    return solve_team_strategy(pools, data, params);
+  }
+  if (schedules.empty()) {
+    schedules = generate_compact_strategies(10, data);
+    reduce_schedules(schedules);
+  }
+  pools.assign(1, schedules);
+  return solve_strategy(schedules, data, params, cache);
+}
+
+ProtectData example_data() {
   vector<PatrolArea> patrol_areas = {{1, 2, 3}, {4, 5, 6},
                                      {7, 8, 9}};
   vector<Activity> activities({{1, 3, .5}, {2, 5, .75}});
@@ -18,11 +91,376 @@ int main(int argc, char *argv[]) {
   data.d_penalties = d_penalties;
   data.d_rewards = d_rewards;
   data.activities = activities;
-  const auto compact_strats = generate_compact_strategies(10, data);
-  const auto result = create_strategy(compact_strats, data);
+  return data;
+}
+
+// Effectiveness matrix of an instance file, or of the example game.
+SparseColumns load_matrix(const string &path, ProtectData &data) {
+  if (path.empty()) {
+    data = example_data();
+    return build_effectiveness_columns(generate_compact_strategies(10, data),
+                                       data);
+  }
+  InstanceFile instance(path);
+  data = instance.to_protect_data();
+  if (instance.has_matrix())
+    return instance.effectiveness_columns();
+  if (instance.has_schedules())
+    return build_effectiveness_columns(instance.schedules(), data);
+  vector<PatrolSchedule> schedules = generate_compact_strategies(10, data);
+  reduce_schedules(schedules);
+  return build_effectiveness_columns(schedules, data);
+}
+
+// Comma separated list of numbers.
+template <typename T> vector<T> parse_list(const char *arg) {
+  vector<T> result;
+  std::stringstream ss(arg);
+  string item;
+  while (std::getline(ss, item, ','))
+    result.push_back(static_cast<T>(std::atof(item.c_str())));
+  return result;
+}
+
+// Print the utility curve over a (lambda, resources) grid as CSV.
+int sweep(const string &path, const SolverParams &params,
+          vector<double> lambdas, vector<int> resources) {
+  if (lambdas.empty())
+    lambdas.push_back(params.lambda);
+  if (resources.empty())
+    resources.push_back(params.num_res);
+  std::ostream csv(std::cout.rdbuf());
+  std::streambuf *saved = std::cout.rdbuf(std::cerr.rdbuf());
+  ProtectData data;
+  vector<SweepResult> results;
+  try {
+    const auto A = load_matrix(path, data);
+    const PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                          data.d_penalties);
+    results = solve_sweep(Pm, A, sweep_grid(lambdas, resources), params);
+  } catch (const std::exception &e) {
+    std::cout.rdbuf(saved);
+    std::cerr << path << ": " << e.what() << std::endl;
+    return 1;
+  }
+  std::cout.rdbuf(saved);
+  csv << "lambda,resources,lower,upper,bisection_steps,mip_solves,bnb_nodes,"
+         "seconds"
+      << std::endl;
+  for (const auto &result : results)
+    csv << result.point.lambda << "," << result.point.num_res << ","
+        << result.solution.lower << "," << result.solution.upper << ","
+        << result.stats.bisection_steps << "," << result.stats.mip_solves
+        << "," << result.stats.bnb_nodes << ","
+        << result.stats.time_of("binary_search") +
+               result.stats.time_of("model_build")
+        << std::endl;
+  return 0;
+}
+
+// Solve on worker processes: the points of the (lambda, resources) grid as
+// scenarios, or without a grid one bisection with a check per worker.
+int fan_out(const string &path, const SolverParams &params,
+            const FanOutParams &fan, vector<double> lambdas,
+            vector<int> resources) {
+  if (path.empty()) {
+    std::cerr << "fanning out needs a binary instance file" << std::endl;
+    return 1;
+  }
+  vector<FanOutResult> results;
+  vector<SweepPoint> grid;
+  try {
+    const ProtectData data = InstanceFile(path).to_protect_data();
+    const PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                          data.d_penalties);
+    Coordinator coordinator(path, fan);
+    if (lambdas.empty() && resources.empty()) {
+      const PasaqSolution solution =
+          coordinator.bisect(params, initial_solution(params, Pm));
+      cout << "bounds: [" << solution.lower << ", " << solution.upper << "]"
+           << endl;
+      cout << "strategy: ";
+      for (const auto &r : solution.coverage)
+        cout << r << ",";
+      cout << endl;
+      return 0;
+    }
+    if (lambdas.empty())
+      lambdas.push_back(params.lambda);
+    if (resources.empty())
+      resources.push_back(params.num_res);
+    grid = sweep_grid(lambdas, resources);
+    vector<BatchScenario> scenarios;
+    for (const auto &point : grid) {
+      SolverParams p = params;
+      p.lambda = point.lambda;
+      p.num_res = point.num_res;
+      scenarios.push_back({Pm, p});
+    }
+    results = coordinator.solve(scenarios);
+  } catch (const std::exception &e) {
+    std::cerr << path << ": " << e.what() << std::endl;
+    return 1;
+  }
+  int status = 0;
+  cout << "lambda,resources,lower,upper,bisection_steps,mip_solves,bnb_nodes,"
+          "seconds,worker"
+       << endl;
+  for (size_t n = 0; n < results.size(); n++) {
+    const FanOutResult &result = results[n];
+    if (!result.ok) {
+      std::cerr << "lambda " << grid[n].lambda << ", resources "
+                << grid[n].num_res << ": " << result.error << std::endl;
+      status = 1;
+      continue;
+    }
+    cout << grid[n].lambda << "," << grid[n].num_res << ","
+         << result.solution.lower << "," << result.solution.upper << ","
+         << result.stats.bisection_steps << "," << result.stats.mip_solves
+         << "," << result.stats.bnb_nodes << ","
+         << result.stats.time_of("binary_search") << ","
+         << fan.workers[result.worker] << endl;
+  }
+  return status;
+}
+
+// Solve with checkpoints: the instance's own pool and matrix if it has them,
+// the enumerated pool otherwise. schedules receives the pool.
+PasaqSolution solve_checkpointed(const string &path,
+                                 const SolverParams &params,
+                                 const CheckpointParams &checkpoint,
+                                 vector<PatrolSchedule> &schedules) {
+  if (path.empty())
+    return checkpointed_solve(example_data(), params, checkpoint, schedules);
+  if (path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0) {
+    std::ifstream in(path);
+    if (!in)
+      throw std::runtime_error("cannot open " + path);
+    ProtectData data;
+    read_instance_text(in, data, schedules);
+    return checkpointed_solve(data, params, checkpoint, schedules);
+  }
+  InstanceFile instance(path);
+  const ProtectData data = instance.to_protect_data();
+  if (instance.has_schedules())
+    schedules = instance.schedules();
+  if (!instance.has_matrix())
+    return checkpointed_solve(data, params, checkpoint, schedules);
+  const SparseColumns A = instance.effectiveness_columns();
+  return checkpointed_solve(data, params, checkpoint, schedules, &A);
+}
+
+void usage(const char *name) {
+  std::cerr << "usage: " << name
+            << " [instance.bin | instance.txt] [--cache DIR] [--lambda L]"
+               " [--resources N]"
+               " [--epsilon E] [--segments K]\n"
+               "       [--coarse-segments K0] [--time-limit S] [--mip-gap G]"
+               " [--check-threads N]\n"
+               "       [--generic-branching] [--no-fill-cuts]"
+               " [--no-knapsack-cuts] [--roster DAYS [--comb]]\n"
+               "       [--checkpoint DIR | --resume DIR]\n"
+            << "       " << name
+            << " [--cache DIR] (--serve | --serve-socket PATH |"
+               " --serve-tcp PORT)\n"
+               "       [--serve-address ADDR] [--serve-timeout S]\n"
+            << "       " << name
+            << " [instance.bin] --sweep-lambda L,L,... --sweep-resources N,N,..."
+            << "\n       " << name
+            << " instance.bin --workers unix:PATH,HOST:PORT,..."
+               " [--worker-attempts N] [--worker-timeout S]\n"
+               "       [--sweep-lambda L,L,...] [--sweep-resources N,N,...]"
+            << std::endl;
+}
+
+// Answer JSON requests; log chatter goes to stderr so stdout stays protocol.
+int serve(SolveCache *cache, const string &socket_path, const int tcp_port,
+          const string &tcp_address, const double tcp_timeout) {
+  glp_term_out(GLP_OFF);
+  set_stats_sink(nullptr);
+  SolverService service(cache);
+  std::ostream responses(std::cout.rdbuf());
+  std::streambuf *saved = std::cout.rdbuf(std::cerr.rdbuf());
+  int status = 0;
+  if (tcp_port > 0)
+    status = serve_tcp(service, tcp_port, tcp_address, tcp_timeout);
+  else if (!socket_path.empty())
+    status = serve_unix_socket(service, socket_path);
+  else
+    serve_stream(service, std::cin, responses);
+  std::cout.rdbuf(saved);
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  set_stats_sink(&std::cerr);
+  SolverParams params;
+  string instance_path;
+  std::unique_ptr<SolveCache> cache;
+  bool serving = false;
+  string socket_path;
+  int tcp_port = 0;
+  string tcp_address = "127.0.0.1";
+  double tcp_timeout = 60;
+  FanOutParams fan;
+  vector<double> sweep_lambdas;
+  vector<int> sweep_resources;
+  int roster_days = 0;
+  CheckpointParams checkpoint;
+  bool comb = false;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    if (arg == "--serve") {
+      serving = true;
+      continue;
+    }
+    if (arg == "--comb") {
+      comb = true;
+      continue;
+    }
+    if (arg == "--generic-branching") {
+      params.fill_branching = false;
+      continue;
+    }
+    if (arg == "--no-fill-cuts") {
+      params.fill_cuts = false;
+      continue;
+    }
+    if (arg == "--no-knapsack-cuts") {
+      params.knapsack_cuts = false;
+      continue;
+    }
+    if (arg[0] != '-') {
+      instance_path = arg;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char *value = argv[++i];
+    if (arg == "--cache") {
+      cache.reset(new SolveCache(value));
+    } else if (arg == "--serve-socket") {
+      serving = true;
+      socket_path = value;
+    } else if (arg == "--serve-tcp") {
+      serving = true;
+      tcp_port = std::atoi(value);
+    } else if (arg == "--serve-address") {
+      tcp_address = value;
+    } else if (arg == "--serve-timeout") {
+      tcp_timeout = std::atof(value);
+    } else if (arg == "--workers") {
+      std::stringstream ss(value);
+      string address;
+      while (std::getline(ss, address, ','))
+        fan.workers.push_back(address);
+    } else if (arg == "--worker-attempts") {
+      fan.attempts = std::atoi(value);
+    } else if (arg == "--worker-timeout") {
+      fan.timeout = std::atof(value);
+    } else if (arg == "--sweep-lambda") {
+      sweep_lambdas = parse_list<double>(value);
+    } else if (arg == "--sweep-resources") {
+      sweep_resources = parse_list<int>(value);
+    } else if (arg == "--checkpoint" || arg == "--resume") {
+      checkpoint.dir = value;
+      checkpoint.resume = arg == "--resume";
+    } else if (arg == "--roster") {
+      roster_days = std::atoi(value);
+    } else if (arg == "--time-limit") {
+      params.time_limit = std::atof(value);
+    } else if (arg == "--mip-gap") {
+      params.mip_gap = std::atof(value);
+    } else if (arg == "--check-threads") {
+      params.threads = std::atoi(value);
+    } else if (arg == "--lambda") {
+      params.lambda = std::atof(value);
+    } else if (arg == "--resources") {
+      params.num_res = std::atoi(value);
+    } else if (arg == "--epsilon") {
+      params.epsilon = std::atof(value);
+    } else if (arg == "--segments") {
+      params.K = std::atoi(value);
+    } else if (arg == "--coarse-segments") {
+      params.coarse_K = std::atoi(value);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (serving)
+    return serve(cache.get(), socket_path, tcp_port, tcp_address,
+                 tcp_timeout);
+  if (!fan.workers.empty())
+    return fan_out(instance_path, params, fan, sweep_lambdas, sweep_resources);
+  if (!sweep_lambdas.empty() || !sweep_resources.empty())
+    return sweep(instance_path, params, sweep_lambdas, sweep_resources);
+
+  PasaqSolution solution;
+  vector<PatrolSchedule> schedules;
+  ProtectData text_data;
+  vector<vector<PatrolSchedule>> pools;
+  const bool text = instance_path.size() > 4 &&
+                    instance_path.compare(instance_path.size() - 4, 4,
+                                          ".txt") == 0;
+  if (!checkpoint.dir.empty()) {
+    try {
+      solution =
+          solve_checkpointed(instance_path, params, checkpoint, schedules);
+    } catch (const std::exception &e) {
+      std::cerr << checkpoint.dir << ": " << e.what() << std::endl;
+      return 1;
+    }
+  } else if (!instance_path.empty()) {
+    try {
+      if (text) {
+        solution = solve_text_instance(instance_path, params, cache.get(),
+                                       text_data, pools);
+        if (text_data.teams.empty())
+          schedules = pools[0];
+      } else {
+        solution =
+            solve_instance_file(instance_path, params, cache.get(), schedules);
+      }
+    } catch (const std::exception &e) {
+      std::cerr << instance_path << ": " << e.what() << std::endl;
+      return 1;
+    }
+  } else {
+    const ProtectData data = example_data();
+    schedules = generate_compact_strategies(10, data);
+    solution = solve_strategy(schedules, data, params, cache.get());
+  }
   std::cout <<  "strategy: ";
-  for (const auto& r : result)
+  for (const auto& r : solution.coverage)
     cout << r << ",";
   cout << endl;
+
+  if (roster_days > 0 && !text_data.teams.empty()) {
+    // Each team's officers draw from the team's share of the mixture.
+    const auto mixtures = team_mixtures(solution.mixture, pools);
+    std::random_device seed;
+    for (size_t t = 0; t < pools.size(); t++) {
+      cout << "team " << t << ":" << endl;
+      if (mixtures[t].empty())
+        continue;
+      const ScheduleSampler sampler(mixtures[t], pools[t]);
+      const Roster roster = sampler.roster(
+          roster_days, text_data.teams[t].resources, comb, seed());
+      print_roster(sampler, roster);
+    }
+  } else if (roster_days > 0) {
+    if (schedules.empty() || solution.mixture.empty()) {
+      std::cerr << "no schedule mixture to draw a roster from" << std::endl;
+      return 1;
+    }
+    const ScheduleSampler sampler(solution.mixture, schedules);
+    const Roster roster =
+        sampler.roster(roster_days, params.num_res, comb, std::random_device()());
+    print_roster(sampler, roster);
+  }
   return 0;
 }
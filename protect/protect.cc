@@ -1,8 +1,13 @@
 #include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <unordered_map>
 #include <vector>
 
 #include "PASAQ.h"
 #include "protect.h"
+#include "solve_cache.h"
+#include "stats.h"
 
 void print_schedules(const std::vector<PatrolSchedule> &schedules) {
   int count = 0;
@@ -15,15 +20,17 @@ void print_schedules(const std::vector<PatrolSchedule> &schedules) {
 }
 
 /** 
- * Generate compact schedule up to Size N.
+ * Generate compact schedules, the sets of patrol areas with at most n areas.
  */
 std::vector<std::vector<int>>
 generate_compact_schedules(const int n, const ProtectData& data) {
   std::vector<std::vector<int>> result;
   result.emplace_back();
-  for (int i = 0; i < n; i++) {
+  for (size_t i = 0; i < data.PatrolAreas.size(); i++) {
     std::vector<std::vector<int>> result_extension;
     for (const auto& schedule : result) {
+      if (static_cast<int>(schedule.size()) >= n)
+        continue;
       result_extension.push_back(schedule);
       result_extension.back().push_back(i);
     }
@@ -33,19 +40,29 @@ generate_compact_schedules(const int n, const ProtectData& data) {
   return result;
 }
 
+/**
+ * Assign an activity to each area of a compact schedule, keeping the
+ * assignments whose activities fit in time.
+ */
 std::vector<PatrolSchedule>
 create_compact_strategies(const std::vector<int> compact_schedule,
-                          const ProtectData &data) {
+                          const int time, const ProtectData &data) {
   std::vector<PatrolSchedule> patrol_schedules(1);
+  std::vector<int> used_time(1, 0);
   for (const int &area : compact_schedule) {
     std::vector<PatrolSchedule> new_patrols;
-    for (const auto &patrol_schedule : patrol_schedules) {
+    std::vector<int> new_time;
+    for (size_t s = 0; s < patrol_schedules.size(); s++) {
       for (const auto &activity : data.activities) {
-        new_patrols.push_back(patrol_schedule);
+        if (used_time[s] + activity.time > time)
+          continue;
+        new_patrols.push_back(patrol_schedules[s]);
         new_patrols.back().emplace_back(area, activity);
+        new_time.push_back(used_time[s] + activity.time);
       }
     }
-    patrol_schedules = new_patrols;
+    patrol_schedules = std::move(new_patrols);
+    used_time = std::move(new_time);
   }
   return patrol_schedules;
 }
@@ -57,12 +74,12 @@ create_compact_strategies(const std::vector<int> compact_schedule,
 */
 std::vector<PatrolSchedule>
 create_compact_strategies(const std::vector<std::vector<int>> compact_schedules,
-                          const ProtectData &data) {
+                          const int time, const ProtectData &data) {
   std::vector<PatrolSchedule> strategies;
 
   for (const auto &schedule : compact_schedules) {
     const auto schedule_strategies =
-      create_compact_strategies(schedule, data);
+      create_compact_strategies(schedule, time, data);
     strategies.insert(strategies.end(), schedule_strategies.begin(),
                       schedule_strategies.end());
   }
@@ -71,102 +88,232 @@ create_compact_strategies(const std::vector<std::vector<int>> compact_schedules,
 
 std::vector<PatrolSchedule>
 generate_compact_strategies(const int time, const ProtectData &data) {
+  ScopedTimer timer("enumerate");
+  // Activities order by number, so compare durations explicitly.
   const auto &min_activity = std::min_element(
-      data.activities.begin(), data.activities.end());
+      data.activities.begin(), data.activities.end(),
+      [](const Activity &a, const Activity &b) { return a.time < b.time; });
   int n_hat = time / min_activity->time;
 
-  std::cout << "Longest possible schedule is " << n_hat << " stops long"
-            << endl;
+  solver_log() << "Longest possible schedule is " << n_hat << " stops long"
+               << endl;
 
   auto schedules = generate_compact_schedules(n_hat, data);
   if (schedules[0].size() < 1) {
     schedules.erase(schedules.begin());
   }
 
-  std::cout<< "Generated schedules, now creating strategies" << std::endl;
-  const auto strategies = create_compact_strategies(schedules, data);
+  solver_log() << "Generated schedules, now creating strategies" << std::endl;
+  const auto strategies = create_compact_strategies(schedules, time, data);
 
   return strategies;
 }
 
-// Reduce a schedule by removing repeat repeat nodes, keeping the one with the
-// bigger payoff.
-void reduce_schedule(PatrolSchedule &schedule) {
-  for (size_t i = 0; i < schedule.size(); i++) {
-    const auto &patrol = schedule[i];
-    for (size_t j = 0; j < schedule.size(); j++) {
-      if (i != j && patrol.area_num == schedule[j].area_num) {
-        // The has a greater payoff, so delete the other.
-        if (patrol.activity.effectiveness >=
-            schedule[j].activity.effectiveness) {
-          schedule.erase(schedule.begin() + j);
-        } else {
-          schedule.erase(schedule.begin() + i);
-          break;
-        }
-      }
+vector<CoverageRun> schedule_coverage(const PatrolSchedule &schedule,
+                                      const vector<PatrolArea> &areas) {
+  // Patrol p starts covering at a range's first target and stops after its
+  // last; the ranges of an area never touch, so one patrol has at most one
+  // event per target.
+  struct Event {
+    int target;
+    size_t patrol;
+    bool start;
+  };
+  vector<Event> events;
+  for (size_t p = 0; p < schedule.size(); p++) {
+    for (const auto &range : areas[schedule[p].area_num].ranges()) {
+      events.push_back({range.first, p, true});
+      events.push_back({range.last + 1, p, false});
     }
   }
+  sort(events.begin(), events.end(),
+       [](const Event &a, const Event &b) { return a.target < b.target; });
+
+  vector<CoverageRun> coverage;
+  vector<bool> active(schedule.size(), false);
+  for (size_t e = 0; e < events.size();) {
+    const int target = events[e].target;
+    for (; e < events.size() && events[e].target == target; e++)
+      active[events[e].patrol] = events[e].start;
+    if (e == events.size())
+      break;
+    // Every target up to the next event gets the same value.
+    double value = 0;
+    for (size_t p = 0; p < schedule.size(); p++)
+      if (active[p])
+        value += schedule[p].activity.effectiveness;
+    if (value == 0)
+      continue;
+    const int last = events[e].target - 1;
+    if (!coverage.empty() && coverage.back().last + 1 == target &&
+        coverage.back().effectiveness == value)
+      coverage.back().last = last;
+    else
+      coverage.push_back({target, last, value});
+  }
+  return coverage;
 }
 
-bool schedule_equals(const PatrolSchedule &s1, const PatrolSchedule &s2) {
-  // Get max area.
-  int max_area =
-      max_element(s1.begin(), s1.end(), [](const Patrol &a, const Patrol &b) {
-        return a.area_num < b.area_num;
-      })->area_num;
+// Reduce a schedule by removing repeat nodes, keeping the one with the
+// bigger payoff (the first of equal ones).
+void reduce_schedule(PatrolSchedule &schedule) {
+  PatrolSchedule reduced;
+  for (const auto &patrol : schedule) {
+    auto same = find_if(reduced.begin(), reduced.end(),
+                        [&](const Patrol &p) {
+                          return p.area_num == patrol.area_num;
+                        });
+    if (same == reduced.end())
+      reduced.push_back(patrol);
+    else if (patrol.activity.effectiveness > same->activity.effectiveness)
+      *same = patrol;
+  }
+  schedule = std::move(reduced);
+}
 
-  vector<int> activities(max_area + 1);
-  for (const auto &patrol : s1)
-    activities[patrol.area_num] = patrol.activity.number;
-  for (const auto &patrol : s2)
-    if (patrol.area_num > activities.size() ||
-        activities[patrol.area_num] != patrol.activity.number)
-      return false;
+// The (area, activity) pairs of a schedule, sorted: equal for schedules that
+// do the same things in a different order.
+static vector<pair<size_t, int>> schedule_key(const PatrolSchedule &schedule) {
+  vector<pair<size_t, int>> key;
+  key.reserve(schedule.size());
+  for (const auto &patrol : schedule)
+    key.emplace_back(patrol.area_num, patrol.activity.number);
+  sort(key.begin(), key.end());
+  return key;
+}
 
-  return true;
+bool schedule_equals(const PatrolSchedule &s1, const PatrolSchedule &s2) {
+  return s1.size() == s2.size() && schedule_key(s1) == schedule_key(s2);
 }
 
 void reduce_schedules(std::vector<PatrolSchedule> &schedules) {
+  ScopedTimer timer("reduce");
   // filter out repeat areas
   for (PatrolSchedule &schedule : schedules)
     reduce_schedule(schedule);
 
-  // Remove duplicates.
-  for (size_t i = 0; i < schedules.size(); i++)
-    for (size_t j = i; j < schedules.size(); j++)
-      if (schedule_equals(schedules[i], schedules[j]))
-        schedules.erase(schedules.begin() + j);
+  // Remove duplicates, keeping the first of each.
+  std::unordered_map<uint64_t, vector<size_t>> kept; // By key hash.
+  vector<vector<pair<size_t, int>>> keys;
+  size_t count = 0;
+  for (size_t j = 0; j < schedules.size(); j++) {
+    auto key = schedule_key(schedules[j]);
+    Fnv1a h;
+    for (const auto &entry : key) {
+      h.add(static_cast<uint64_t>(entry.first));
+      h.add(static_cast<uint64_t>(static_cast<int64_t>(entry.second)));
+    }
+    auto &bucket = kept[h.value()];
+    if (any_of(bucket.begin(), bucket.end(),
+               [&](size_t n) { return keys[n] == key; }))
+      continue;
+    bucket.push_back(count);
+    keys.push_back(std::move(key));
+    if (count != j)
+      schedules[count] = std::move(schedules[j]);
+    count++;
+  }
+  schedules.erase(schedules.begin() + count, schedules.end());
 }
 
-std::vector<double>
-create_strategy(const std::vector<PatrolSchedule> &schedules,
-                const ProtectData &data) {
-  vector<vector<double>> A(1);
+vector<vector<double>>
+build_effectiveness_matrix(const std::vector<PatrolSchedule> &schedules,
+                           const ProtectData &data) {
+  ScopedTimer timer("matrix_build");
+  const size_t num_targets = data.a_penalties.size();
+  vector<vector<double>> A(num_targets,
+                           vector<double>(schedules.size(), 0));
+  for (size_t j = 0; j < schedules.size(); j++)
+    for (const auto &run : schedule_coverage(schedules[j], data.PatrolAreas))
+      for (int target = run.first; target <= run.last; target++)
+        A[target][j] = run.effectiveness;
+  return A;
+}
 
-  const int num_targets = data.a_penalties.size();
+SparseColumns
+build_effectiveness_columns(const std::vector<PatrolSchedule> &schedules,
+                            const ProtectData &data) {
+  ScopedTimer timer("matrix_build");
+  SparseColumns columns(schedules.size());
+  for (size_t j = 0; j < schedules.size(); j++)
+    for (const auto &run : schedule_coverage(schedules[j], data.PatrolAreas))
+      for (int target = run.first; target <= run.last; target++)
+        columns[j].emplace_back(target, run.effectiveness);
+  return columns;
+}
 
-  cout << "RUNNING PASAQ ON " << schedules.size() << " compact strategies, on "
-       << num_targets << " targets" << endl;
-  print_schedules(schedules);
-  cout << "Effectiveness matrix size " << num_targets << "x" << schedules.size()
-       << endl;
+SparseColumns sparse_columns(const vector<vector<double>> &A) {
+  const size_t S = A.empty() ? 0 : A[0].size();
+  SparseColumns columns(S);
+  for (size_t i = 0; i < A.size(); i++)
+    for (size_t j = 0; j < S; j++)
+      if (A[i][j] != 0)
+        columns[j].emplace_back(i, A[i][j]);
+  return columns;
+}
 
-  // Initialize probability matrix.
-  for (int i = 0; i < num_targets; i++)
-    A.push_back(vector<double>(schedules.size(), 0));
-  // cout << "A size: " << A.size() <<"x" << A[0].size() << endl;
-  for (size_t j = 0; j < schedules.size(); j++) {
-    const auto schedule = schedules[j];
-    // cout << "schedule of size " << schedule.size() << endl;
-    for (const auto &patrol : schedule) {
-      // cout << "Targets: " << data.PatrolAreas[patrol.area_num].size() << endl;
-      for (const auto target : data.PatrolAreas[patrol.area_num]) {
-        A[target][j] += patrol.activity.effectiveness;
-      }
+MergedColumns merge_identical_columns(const vector<vector<double>> &A) {
+  return merge_identical_columns(sparse_columns(A));
+}
+
+MergedColumns merge_identical_columns(const SparseColumns &columns) {
+  ScopedTimer timer("merge_columns");
+  MergedColumns merged;
+  const size_t S = columns.size();
+  std::unordered_map<uint64_t, vector<size_t>> distinct; // By column hash.
+  merged.column_of.resize(S);
+  for (size_t j = 0; j < S; j++) {
+    Fnv1a h;
+    for (const auto &entry : columns[j]) {
+      h.add(static_cast<uint64_t>(entry.first));
+      h.add(entry.second);
+    }
+    auto &bucket = distinct[h.value()];
+    const auto same = find_if(bucket.begin(), bucket.end(), [&](size_t m) {
+      return columns[merged.members[m][0]] == columns[j];
+    });
+    if (same != bucket.end()) {
+      merged.column_of[j] = *same;
+      merged.members[*same].push_back(j);
+    } else {
+      merged.column_of[j] = merged.members.size();
+      bucket.push_back(merged.members.size());
+      merged.members.push_back({j});
     }
   }
 
+  for (const auto &members : merged.members)
+    merged.A.push_back(columns[members[0]]);
+  return merged;
+}
+
+ScheduleMixture MergedColumns::merge(const ScheduleMixture &mixture) const {
+  vector<double> weight(members.size(), 0);
+  for (const auto &entry : mixture)
+    if (entry.first < column_of.size())
+      weight[column_of[entry.first]] += entry.second;
+  ScheduleMixture result;
+  for (size_t m = 0; m < weight.size(); m++)
+    if (weight[m] != 0)
+      result.emplace_back(m, weight[m]);
+  return result;
+}
+
+ScheduleMixture MergedColumns::expand(const ScheduleMixture &mixture) const {
+  ScheduleMixture result;
+  for (const auto &entry : mixture) {
+    const auto &columns = members[entry.first];
+    for (const size_t j : columns)
+      result.emplace_back(j, entry.second / columns.size());
+  }
+  sort(result.begin(), result.end());
+  return result;
+}
+
+PasaqSolution solve_strategy(const vector<vector<double>> &A,
+                             const ProtectData &data,
+                             const SolverParams &params, SolveCache *cache) {
+#ifdef DEBUG
   // Print out probability matrix.
   cout << "Effectiveness matrix: " << endl;
   for (const auto &row : A) {
@@ -174,13 +321,158 @@ create_strategy(const std::vector<PatrolSchedule> &schedules,
       cout << elem << "\t ";
     cout << endl;
   }
-  
-  PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
-                  data.d_penalties);
+#endif
+  return solve_strategy(sparse_columns(A), data, params, cache);
+}
+
+PasaqSolution solve_strategy(const SparseColumns &A, const ProtectData &data,
+                             const SolverParams &params, SolveCache *cache) {
+  PasaqSolution solution;
+  {
+    ScopedTimer timer("create_strategy");
+    current_stats().num_targets = data.a_penalties.size();
+    current_stats().num_schedules = A.size();
+
+    PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                    data.d_penalties);
+
+    const MergedColumns merged = merge_identical_columns(A);
+    current_stats().num_columns = merged.members.size();
+    solver_log() << "A size: " << data.a_penalties.size() << "x"
+                 << current_stats().num_schedules << ", "
+                 << current_stats().num_columns << " distinct columns"
+                 << endl;
+    solution = initial_solution(params, Pm);
+    const uint64_t game = cache != nullptr ? hash_game(Pm, A) : 0;
+    if (cache != nullptr && cache->lookup(game, params, solution)) {
+      solver_log() << "Using cached solution" << endl;
+      current_stats().cache = "hit";
+    } else {
+      if (cache != nullptr)
+        current_stats().cache = cache->seed(game, params, solution) ? "seeded"
+                                                                    : "miss";
+      solver_log() << "Using Binary Search Method to Solve PASAQ" << endl;
+      // The cache and the caller see columns of A, the LP merged ones.
+      solution.mixture = merged.merge(solution.mixture);
+      solution = BinarySearchSolve(params, Pm, merged.A, solution);
+      solution.mixture = merged.expand(solution.mixture);
+      if (cache != nullptr)
+        cache->store(game, params, solution);
+    }
+  }
+  // One stats record per solve, covering enumeration and reduction as well.
+  emit_stats();
+  return solution;
+}
+
+PasaqSolution solve_strategy(const std::vector<PatrolSchedule> &schedules,
+                             const ProtectData &data,
+                             const SolverParams &params, SolveCache *cache) {
+  solver_log() << "RUNNING PASAQ ON " << schedules.size()
+               << " compact strategies, on " << data.a_penalties.size()
+               << " targets" << endl;
+#ifdef DEBUG
+  print_schedules(schedules);
+#endif
+  return solve_strategy(build_effectiveness_columns(schedules, data), data,
+                        params, cache);
+}
+
+std::vector<double>
+create_strategy(const vector<vector<double>> &A, const ProtectData &data,
+                const SolverParams &params, SolveCache *cache) {
+  return solve_strategy(A, data, params, cache).coverage;
+}
+
+std::vector<double>
+create_strategy(const std::vector<PatrolSchedule> &schedules,
+                const ProtectData &data, const SolverParams &params,
+                SolveCache *cache) {
+  return solve_strategy(schedules, data, params, cache).coverage;
+}
 
-  cout << "A size: " << A.size() <<"x" << A[0].size() << endl;
-  cout << "Using Binary Search Method to Solve PASAQ" << endl;
-  const auto result = BinarySearchMethod(0.5, 5, Pm, A, 0.5, 5);
+vector<vector<PatrolSchedule>>
+generate_team_strategies(const int time, const ProtectData &data) {
+  vector<vector<PatrolSchedule>> pools(data.teams.size());
+  auto generate = [&](size_t t) {
+    const ResourceTeam &team = data.teams[t];
+    // The team's view of the instance: its activities and reachable areas.
+    ProtectData view;
+    view.activities =
+        team.activities.empty() ? data.activities : team.activities;
+    vector<size_t> areas = team.areas;
+    if (areas.empty())
+      for (size_t n = 0; n < data.PatrolAreas.size(); n++)
+        areas.push_back(n);
+    sort(areas.begin(), areas.end());
+    areas.erase(unique(areas.begin(), areas.end()), areas.end());
+    for (const size_t area : areas) {
+      if (area >= data.PatrolAreas.size())
+        throw std::invalid_argument("team reaches unknown area " +
+                                    std::to_string(area));
+      view.PatrolAreas.push_back(data.PatrolAreas[area]);
+    }
+    if (view.PatrolAreas.empty() || view.activities.empty())
+      return;
+    pools[t] = generate_compact_strategies(time, view);
+    for (auto &schedule : pools[t])
+      for (auto &patrol : schedule)
+        patrol.area_num = areas[patrol.area_num];
+    reduce_schedules(pools[t]);
+  };
+  vector<std::future<void>> done;
+  for (size_t t = 0; t < data.teams.size(); t++)
+    done.push_back(std::async(std::launch::async, generate, t));
+  for (auto &team : done)
+    team.get();
+  return pools;
+}
 
-  return result.second;
+PasaqSolution solve_team_strategy(const vector<vector<PatrolSchedule>> &pools,
+                                  const ProtectData &data,
+                                  const SolverParams &params) {
+  if (pools.size() != data.teams.size())
+    throw std::invalid_argument("need one schedule pool per team");
+  PasaqSolution solution;
+  {
+    ScopedTimer timer("create_strategy");
+    vector<TeamBlock> blocks(pools.size());
+    size_t S = 0;
+    for (size_t t = 0; t < pools.size(); t++) {
+      blocks[t].resources = data.teams[t].resources;
+      blocks[t].columns = build_effectiveness_columns(pools[t], data);
+      S += pools[t].size();
+    }
+    current_stats().num_targets = data.a_penalties.size();
+    current_stats().num_schedules = S;
+    current_stats().num_columns = S;
+
+    const PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                          data.d_penalties);
+    PasaqModel model(Pm, blocks, params);
+    solver_log() << "Solving for " << pools.size() << " teams, " << S
+                 << " schedules, " << model.get_params().num_res
+                 << " resources" << endl;
+    solution = BinarySearchSolve(model,
+                                 initial_solution(model.get_params(), Pm));
+  }
+  emit_stats();
+  return solution;
+}
+
+vector<ScheduleMixture>
+team_mixtures(const ScheduleMixture &mixture,
+              const vector<vector<PatrolSchedule>> &pools) {
+  vector<size_t> first(1, 0);
+  for (const auto &pool : pools)
+    first.push_back(first.back() + pool.size());
+  vector<ScheduleMixture> result(pools.size());
+  for (const auto &entry : mixture) {
+    const size_t t =
+        upper_bound(first.begin(), first.end(), entry.first) - first.begin() -
+        1;
+    if (t < pools.size())
+      result[t].emplace_back(entry.first - first[t], entry.second);
+  }
+  return result;
 }
@@ -1,13 +1,21 @@
 #ifndef PROTECT_H
 #define PROTECT_H
 
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
 #include <iostream>
+#include <iterator>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "PASAQ.h"
+
 using namespace std;
 
+class SolveCache;
+
 struct Activity {
   int number; /** */
   int time;
@@ -18,8 +26,120 @@ struct Activity {
   }
 };
 
-// PatrolArea is a set of targets.
-typedef vector<int> PatrolArea;
+// Consecutive targets first..last, inclusive.
+struct TargetRange {
+  int first;
+  int last;
+  bool operator==(const TargetRange &other) const {
+    return first == other.first && last == other.last;
+  }
+};
+
+/*
+ * PatrolArea is a set of targets, stored as sorted, disjoint ranges that do
+ * not touch. Map areas are runs of neighbouring targets, so an area takes a
+ * few ranges instead of one int per target. It reads like a sorted
+ * vector<int>: iterating yields the targets in increasing order, and
+ * push_back adds a target (in constant time when targets come in order).
+ */
+class PatrolArea {
+private:
+  vector<TargetRange> runs;
+  size_t count; // Targets in all runs.
+
+public:
+  class const_iterator {
+  private:
+    const TargetRange *range;
+    const TargetRange *end;
+    int target;
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef int value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const int *pointer;
+    typedef int reference;
+
+    const_iterator(const TargetRange *range, const TargetRange *end)
+        : range(range), end(end), target(range != end ? range->first : 0) {}
+    int operator*() const { return target; }
+    const_iterator &operator++() {
+      if (target != range->last)
+        target++;
+      else if (++range != end)
+        target = range->first;
+      else
+        target = 0;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+    bool operator==(const const_iterator &other) const {
+      return range == other.range && target == other.target;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return !(*this == other);
+    }
+  };
+  typedef const_iterator iterator;
+  typedef int value_type;
+
+  PatrolArea() : count(0) {}
+  PatrolArea(std::initializer_list<int> targets) : count(0) {
+    for (const int t : targets)
+      push_back(t);
+  }
+  template <class Iterator>
+  PatrolArea(Iterator begin, Iterator end) : count(0) {
+    for (; begin != end; ++begin)
+      push_back(*begin);
+  }
+
+  // Add targets first..last; ranges they overlap or touch are merged.
+  void insert(int first, int last) {
+    if (first > last)
+      return;
+    // Ranges from lo up to hi overlap or touch first..last.
+    auto lo = std::lower_bound(
+        runs.begin(), runs.end(), first,
+        [](const TargetRange &r, int t) { return r.last + 1 < t; });
+    auto hi = lo;
+    for (; hi != runs.end() && hi->first <= last + 1; ++hi) {
+      first = std::min(first, hi->first);
+      last = std::max(last, hi->last);
+      count -= hi->last - hi->first + 1;
+    }
+    runs.insert(runs.erase(lo, hi), {first, last});
+    count += last - first + 1;
+  }
+  void push_back(int target) {
+    if (!runs.empty() && target == runs.back().last + 1) {
+      runs.back().last = target;
+      count++;
+    } else if (runs.empty() || target > runs.back().last) {
+      runs.push_back({target, target});
+      count++;
+    } else {
+      insert(target, target);
+    }
+  }
+
+  const vector<TargetRange> &ranges() const { return runs; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const_iterator begin() const {
+    return const_iterator(runs.data(), runs.data() + runs.size());
+  }
+  const_iterator end() const {
+    return const_iterator(runs.data() + runs.size(),
+                          runs.data() + runs.size());
+  }
+  bool operator==(const PatrolArea &other) const { return runs == other.runs; }
+};
 
 struct Patrol {
   size_t area_num;
@@ -30,6 +150,17 @@ struct Patrol {
 
 typedef std::vector<Patrol> PatrolSchedule;
 
+/*
+ * A team of defender resources with its own activities and reach, such as
+ * foot patrols, vehicle units or K9 teams.
+ */
+struct ResourceTeam {
+  int resources;               // Officers in the team.
+  vector<Activity> activities; // What the team does; empty for the
+                               // instance's activities.
+  vector<size_t> areas;        // Areas the team reaches; empty for all.
+};
+
 /* 
  * Structure containing necessary data to create a strategy on defending
  * targets.
@@ -48,21 +179,161 @@ struct ProtectData {
   vector<int> a_penalties; // Reward for the attacker to fail to attack each
                            // target.
   vector<Activity> activities; // Defender activities.
+  vector<ResourceTeam> teams;  // Resource teams; empty for a single team
+                               // with SolverParams::num_res resources.
+};
+
+// Targets first..last all get the same effectiveness from a schedule.
+struct CoverageRun {
+  int first;
+  int last;
+  double effectiveness;
 };
 
+/**
+ * The effectiveness a schedule gives each target, as maximal runs of targets
+ * with the same non zero value, in increasing order: the schedule's column of
+ * A in interval form. It sweeps the end points of the area ranges, so a
+ * patrol costs time in the ranges of its area rather than its targets, and
+ * sums each value in patrol order, exactly as adding target by target would.
+ *
+ * @param schedule patrols; area numbers index areas
+ * @param areas patrol areas, as in ProtectData
+ */
+vector<CoverageRun> schedule_coverage(const PatrolSchedule &schedule,
+                                      const vector<PatrolArea> &areas);
+
 /** Enumerate all possible compact strategies, creating, essentially, the game
  * matrix.
 */
 std::vector<PatrolSchedule>
 generate_compact_strategies(const int time, const ProtectData &data);
 
-/** Reduce a set of schedules to their compace representation.
+// Keep one patrol per area, the most effective (the first of equal ones).
+void reduce_schedule(PatrolSchedule &schedule);
+
+/** Reduce a set of schedules to their compact representation: each area is
+ * patrolled once, with its most effective activity, and of schedules doing
+ * the same activities in the same areas only the first is kept.
  */
 void reduce_schedules(std::vector<PatrolSchedule> &schedules);
 
+/**
+ * Build the effectiveness matrix A. A[i][j] is the summed effectiveness of the
+ * activities schedule j performs in areas containing target i; there is one
+ * row per payoff slot.
+ */
+vector<vector<double>>
+build_effectiveness_matrix(const std::vector<PatrolSchedule> &schedules,
+                           const ProtectData &data);
+
+// The same matrix by column, without the zeros.
+SparseColumns
+build_effectiveness_columns(const std::vector<PatrolSchedule> &schedules,
+                            const ProtectData &data);
+
+// The columns of a dense effectiveness matrix.
+SparseColumns sparse_columns(const vector<vector<double>> &A);
+
+/*
+ * An effectiveness matrix with its identical columns merged. Areas overlap,
+ * so schedules that differ in areas or activities can still cover every
+ * target the same, and one LP column a_j serves them all.
+ */
+struct MergedColumns {
+  SparseColumns A;                // Distinct columns, in order of first use.
+  vector<vector<size_t>> members; // Original columns of each, ascending.
+  vector<size_t> column_of;       // Merged column of each original column.
+
+  // A mixture over original columns as one over merged columns.
+  ScheduleMixture merge(const ScheduleMixture &mixture) const;
+
+  // A mixture over merged columns as one over original columns, each weight
+  // split evenly over the members, so coverage is unchanged and a sampler
+  // spreads officers over all equivalent schedules.
+  ScheduleMixture expand(const ScheduleMixture &mixture) const;
+};
+
+/**
+ * Merge identical columns of A. Each sparse column is hashed, and columns
+ * with equal hashes are compared exactly.
+ *
+ * @param A effectiveness matrix, as built by build_effectiveness_matrix
+ */
+MergedColumns merge_identical_columns(const vector<vector<double>> &A);
+MergedColumns merge_identical_columns(const SparseColumns &A);
+
 std::vector<double>
 create_strategy(const std::vector<PatrolSchedule> &schedules,
-                const ProtectData &data);
+                const ProtectData &data,
+                const SolverParams &params = SolverParams(),
+                SolveCache *cache = nullptr);
+
+/**
+ * Solve for a strategy from an effectiveness matrix that was built (or
+ * loaded) ahead of time. With a cache, a cached solution is returned when
+ * there is one, otherwise the search starts from the bounds of related
+ * cached solves and its result is stored.
+ */
+std::vector<double>
+create_strategy(const vector<vector<double>> &A, const ProtectData &data,
+                const SolverParams &params = SolverParams(),
+                SolveCache *cache = nullptr);
+
+/**
+ * Solve for the full mixed strategy: the bounds on the defender's utility,
+ * the coverage of every target and the sparse schedule mixture, whose
+ * indices are columns of A (or positions in schedules). create_strategy
+ * returns the coverage part only.
+ */
+PasaqSolution solve_strategy(const vector<vector<double>> &A,
+                             const ProtectData &data,
+                             const SolverParams &params = SolverParams(),
+                             SolveCache *cache = nullptr);
+
+// The same from the columns of A, such as an instance file's.
+PasaqSolution solve_strategy(const SparseColumns &A, const ProtectData &data,
+                             const SolverParams &params = SolverParams(),
+                             SolveCache *cache = nullptr);
+
+PasaqSolution solve_strategy(const std::vector<PatrolSchedule> &schedules,
+                             const ProtectData &data,
+                             const SolverParams &params = SolverParams(),
+                             SolveCache *cache = nullptr);
+
+/**
+ * Enumerate and reduce the schedule pool of every team of data, one team per
+ * thread: the compact strategies over the areas the team reaches, with the
+ * team's activities. Area numbers are the instance's.
+ *
+ * @param time time horizon
+ * @param data instance with teams
+ *
+ * @return one pool per team, in team order
+ */
+vector<vector<PatrolSchedule>>
+generate_team_strategies(const int time, const ProtectData &data);
+
+/**
+ * Solve for one mixed strategy over all teams of data, whose schedule weights
+ * are coupled only through the coverage of constraint (16). The teams'
+ * effectiveness matrices are stacked block sparse, so the mixture indexes
+ * the pools back to back in team order; team_mixtures splits it again.
+ *
+ * @param pools schedule pool of each team, as from generate_team_strategies
+ * @param data instance with teams
+ * @param params solver parameters; num_res is ignored in favour of the
+ * teams' resources
+ */
+PasaqSolution solve_team_strategy(const vector<vector<PatrolSchedule>> &pools,
+                                  const ProtectData &data,
+                                  const SolverParams &params = SolverParams());
+
+// The part of a solve_team_strategy mixture that belongs to each team, as
+// indices into the team's own pool.
+vector<ScheduleMixture>
+team_mixtures(const ScheduleMixture &mixture,
+              const vector<vector<PatrolSchedule>> &pools);
 
 void print_schedules(const std::vector<PatrolSchedule> &schedules);
 
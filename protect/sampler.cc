@@ -0,0 +1,96 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+ScheduleSampler::ScheduleSampler(const ScheduleMixture &mixture,
+                                 const vector<PatrolSchedule> &schedules)
+    : schedules(&schedules) {
+  double total = 0;
+  vector<double> weights;
+  for (const auto &entry : mixture) {
+    if (entry.first >= schedules.size())
+      throw std::invalid_argument("mixture uses schedule " +
+                                  std::to_string(entry.first) + " of " +
+                                  std::to_string(schedules.size()));
+    if (entry.second <= 0)
+      continue;
+    columns.push_back(entry.first);
+    weights.push_back(entry.second);
+    total += entry.second;
+  }
+  if (columns.empty())
+    throw std::invalid_argument("mixture has no positive weight");
+
+  const size_t n = columns.size();
+  cumulative.resize(n);
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += weights[i] / total;
+    cumulative[i] = sum;
+  }
+  cumulative.back() = 1;
+
+  // Vose's alias method: pair each underfull entry with an overfull one.
+  probability.assign(n, 1);
+  alias.resize(n);
+  vector<double> scaled(n);
+  vector<size_t> small, large;
+  for (size_t i = 0; i < n; i++) {
+    alias[i] = i;
+    scaled[i] = weights[i] / total * n;
+    (scaled[i] < 1 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    const size_t s = small.back();
+    const size_t l = large.back();
+    small.pop_back();
+    probability[s] = scaled[s];
+    alias[s] = l;
+    scaled[l] -= 1 - scaled[s];
+    if (scaled[l] < 1) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // Whatever is left is 1 up to rounding.
+}
+
+size_t ScheduleSampler::draw(std::mt19937_64 &rng) const {
+  std::uniform_int_distribution<size_t> pick(0, columns.size() - 1);
+  std::uniform_real_distribution<double> coin(0, 1);
+  const size_t n = pick(rng);
+  return columns[coin(rng) < probability[n] ? n : alias[n]];
+}
+
+void ScheduleSampler::draw(size_t n, bool comb, std::mt19937_64 &rng,
+                           vector<size_t> &out) const {
+  out.resize(n);
+  if (!comb) {
+    for (auto &schedule : out)
+      schedule = draw(rng);
+    return;
+  }
+  // Teeth at (u + m) / n; both they and the cumulative sums increase, so one
+  // merge pass finds every entry.
+  std::uniform_real_distribution<double> offset(0, 1);
+  const double u = offset(rng);
+  size_t entry = 0;
+  for (size_t m = 0; m < n; m++) {
+    const double tooth = (u + m) / n;
+    while (entry + 1 < cumulative.size() && cumulative[entry] <= tooth)
+      entry++;
+    out[m] = columns[entry];
+  }
+  // Officer m would otherwise always get the m-th tooth's schedule.
+  std::shuffle(out.begin(), out.end(), rng);
+}
+
+Roster ScheduleSampler::roster(size_t days, size_t officers, bool comb,
+                               uint64_t seed) const {
+  std::mt19937_64 rng(seed);
+  Roster result(days);
+  for (auto &day : result)
+    draw(officers, comb, rng, day);
+  return result;
+}
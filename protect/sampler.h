@@ -0,0 +1,75 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "PASAQ.h"
+#include "protect.h"
+
+// Schedule of every officer on every day: roster[day][officer] is an index
+// into the schedule pool.
+typedef vector<vector<size_t>> Roster;
+
+/*
+ * Draws concrete schedules from a solved schedule mixture without solving
+ * again. Independent draws use an alias table and take O(1) time each. Comb
+ * (systematic) sampling draws all officers of a day with one random offset
+ * spread evenly over the cumulative distribution, so each schedule is used by
+ * floor or ceil of its expected number of officers, instead of anywhere from
+ * none to all of them.
+ */
+class ScheduleSampler {
+private:
+  const vector<PatrolSchedule> *schedules;
+  vector<size_t> columns;     // Schedule index of each mixture entry.
+  vector<double> probability; // Alias table: chance of keeping entry n,
+  vector<size_t> alias;       // otherwise take entry alias[n].
+  vector<double> cumulative;  // Prefix sums, for comb sampling.
+
+public:
+  /**
+   * Build the tables. Weights are normalized, so the mixture may be off by
+   * the solver's tolerance.
+   *
+   * @param mixture schedule weights, as in PasaqSolution
+   * @param schedules schedule pool the mixture indexes; must outlive the
+   * sampler
+   *
+   * @throws std::invalid_argument if the mixture is empty, has no positive
+   * weight, or indexes past the pool
+   */
+  ScheduleSampler(const ScheduleMixture &mixture,
+                  const vector<PatrolSchedule> &schedules);
+
+  // Index of one independently drawn schedule.
+  size_t draw(std::mt19937_64 &rng) const;
+
+  /**
+   * Draw the schedules of n officers for one day.
+   *
+   * @param n number of officers
+   * @param comb use comb sampling instead of independent draws
+   * @param out receives n schedule indices
+   */
+  void draw(size_t n, bool comb, std::mt19937_64 &rng,
+            vector<size_t> &out) const;
+
+  /**
+   * Draw a roster.
+   *
+   * @param days number of days
+   * @param officers officers on duty each day
+   * @param comb use comb sampling within each day
+   * @param seed random seed; the same seed gives the same roster
+   */
+  Roster roster(size_t days, size_t officers, bool comb,
+                uint64_t seed) const;
+
+  const PatrolSchedule &schedule(size_t index) const {
+    return (*schedules)[index];
+  }
+};
+
+#endif /* SAMPLER_H */
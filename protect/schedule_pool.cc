@@ -0,0 +1,306 @@
+#include "schedule_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+void put_varint(std::string &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+uint64_t get_varint(const std::string &in, size_t &pos) {
+  uint64_t v = 0;
+  for (int shift = 0; pos < in.size(); shift += 7) {
+    const unsigned char byte = in[pos++];
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80)
+      return v;
+  }
+  throw std::runtime_error("truncated varint");
+}
+
+// Returns false at the end of the stream.
+static bool read_varint(std::istream &in, uint64_t &v) {
+  v = 0;
+  for (int shift = 0;; shift += 7) {
+    const int byte = in.get();
+    if (byte == EOF) {
+      if (shift == 0)
+        return false;
+      throw std::runtime_error("truncated schedule run");
+    }
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80)
+      return true;
+  }
+}
+
+/*
+ * A sorted run of records. Each record is stored as the length of the prefix
+ * it shares with the record before it, then the rest of it.
+ */
+class RunWriter {
+private:
+  std::ofstream out;
+  std::string last;
+  size_t n;
+
+public:
+  explicit RunWriter(const std::string &path)
+      : out(path, std::ios::binary | std::ios::trunc), n(0) {
+    if (!out)
+      throw std::runtime_error("cannot write schedule run " + path);
+  }
+  void write(const std::string &record) {
+    size_t shared = 0;
+    while (shared < last.size() && shared < record.size() &&
+           last[shared] == record[shared])
+      shared++;
+    std::string head;
+    put_varint(head, shared);
+    put_varint(head, record.size() - shared);
+    out.write(head.data(), head.size());
+    out.write(record.data() + shared, record.size() - shared);
+    last = record;
+    n++;
+  }
+  size_t count() const { return n; }
+  void close() {
+    out.close();
+    if (!out)
+      throw std::runtime_error("failed writing schedule run");
+  }
+};
+
+class RunReader {
+private:
+  std::ifstream in;
+  std::string record;
+
+public:
+  explicit RunReader(const std::string &path) : in(path, std::ios::binary) {
+    if (!in)
+      throw std::runtime_error("cannot read schedule run " + path);
+  }
+  // Advance to the next record; false at the end of the run.
+  bool next() {
+    uint64_t shared, rest;
+    if (!read_varint(in, shared))
+      return false;
+    if (!read_varint(in, rest) || shared > record.size())
+      throw std::runtime_error("corrupt schedule run");
+    record.resize(shared + rest);
+    if (!in.read(&record[shared], rest))
+      throw std::runtime_error("truncated schedule run");
+    return true;
+  }
+  const std::string &current() const { return record; }
+};
+
+SchedulePool::SchedulePool(const ProtectData &data, const PoolParams &params)
+    : data(&data), params(params), buffered(0), runs_written(0), count(0),
+      finished(false) {
+  if (this->params.fan_in < 2)
+    this->params.fan_in = 2;
+  std::string pattern = params.scratch_dir + "/protect-pool-XXXXXX";
+  if (mkdtemp(&pattern[0]) == nullptr)
+    throw std::runtime_error("cannot create a scratch directory in " +
+                             params.scratch_dir);
+  dir = pattern;
+}
+
+SchedulePool::~SchedulePool() {
+  DIR *d = opendir(dir.c_str());
+  if (d != nullptr) {
+    while (const dirent *entry = readdir(d)) {
+      const std::string name = entry->d_name;
+      if (name != "." && name != "..")
+        std::remove(scratch_path(name).c_str());
+    }
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
+
+std::string SchedulePool::encode(const PatrolSchedule &schedule) const {
+  PatrolSchedule canonical = schedule;
+  reduce_schedule(canonical);
+  std::sort(canonical.begin(), canonical.end(),
+            [](const Patrol &a, const Patrol &b) {
+              return a.area_num < b.area_num;
+            });
+  std::string record;
+  put_varint(record, canonical.size());
+  size_t area = 0;
+  for (const auto &patrol : canonical) {
+    const auto act = std::find_if(
+        data->activities.begin(), data->activities.end(),
+        [&patrol](const Activity &a) {
+          return a.number == patrol.activity.number;
+        });
+    if (act == data->activities.end())
+      throw std::runtime_error("schedule uses an unknown activity");
+    put_varint(record, patrol.area_num - area);
+    put_varint(record, act - data->activities.begin());
+    area = patrol.area_num;
+  }
+  return record;
+}
+
+PatrolSchedule SchedulePool::decode(const std::string &record) const {
+  size_t pos = 0;
+  const uint64_t n = get_varint(record, pos);
+  PatrolSchedule schedule;
+  size_t area = 0;
+  for (uint64_t k = 0; k < n; k++) {
+    area += get_varint(record, pos);
+    const uint64_t act = get_varint(record, pos);
+    if (act >= data->activities.size())
+      throw std::runtime_error("schedule record has an unknown activity");
+    schedule.emplace_back(area, data->activities[act]);
+  }
+  return schedule;
+}
+
+std::string SchedulePool::next_run_path() {
+  return scratch_path("run" + std::to_string(runs_written++));
+}
+
+void SchedulePool::add(const PatrolSchedule &schedule) {
+  if (finished)
+    throw std::logic_error("schedule pool is finished");
+  buffer.push_back(encode(schedule));
+  buffered += buffer.back().size() + sizeof(std::string);
+  if (buffered >= params.memory_budget)
+    spill();
+}
+
+void SchedulePool::spill() {
+  ScopedTimer timer("spill");
+  std::sort(buffer.begin(), buffer.end());
+  buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+  const std::string path = next_run_path();
+  RunWriter out(path);
+  for (const auto &record : buffer)
+    out.write(record);
+  out.close();
+  runs.push_back({path, out.count()});
+  vector<std::string>().swap(buffer);
+  buffered = 0;
+}
+
+SchedulePool::Run SchedulePool::merge(const vector<Run> &inputs) {
+  // Smallest current record first; ties go to the lower input.
+  typedef pair<const std::string *, size_t> Head;
+  auto later = [](const Head &a, const Head &b) {
+    return *b.first < *a.first ||
+           (*b.first == *a.first && b.second < a.second);
+  };
+  std::priority_queue<Head, vector<Head>, decltype(later)> heads(later);
+  vector<std::unique_ptr<RunReader>> readers;
+  for (const auto &run : inputs) {
+    readers.emplace_back(new RunReader(run.path));
+    if (readers.back()->next())
+      heads.push({&readers.back()->current(), readers.size() - 1});
+  }
+
+  const std::string path = next_run_path();
+  RunWriter out(path);
+  std::string last;
+  bool any = false;
+  while (!heads.empty()) {
+    const size_t n = heads.top().second;
+    heads.pop();
+    if (!any || readers[n]->current() != last) {
+      last = readers[n]->current();
+      out.write(last);
+      any = true;
+    }
+    if (readers[n]->next())
+      heads.push({&readers[n]->current(), n});
+  }
+  out.close();
+  for (const auto &run : inputs)
+    std::remove(run.path.c_str());
+  return {path, out.count()};
+}
+
+void SchedulePool::finish() {
+  if (finished)
+    return;
+  finished = true;
+  if (runs.empty()) {
+    std::sort(buffer.begin(), buffer.end());
+    buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+    count = buffer.size();
+    return;
+  }
+  if (!buffer.empty())
+    spill();
+  ScopedTimer timer("merge");
+  while (runs.size() > 1) {
+    vector<Run> merged;
+    for (size_t first = 0; first < runs.size(); first += params.fan_in) {
+      const size_t last = std::min(runs.size(), first + params.fan_in);
+      if (last - first == 1)
+        merged.push_back(runs[first]);
+      else
+        merged.push_back(merge(vector<Run>(runs.begin() + first,
+                                           runs.begin() + last)));
+    }
+    runs = std::move(merged);
+  }
+  count = runs[0].count;
+}
+
+void SchedulePool::for_each(
+    const std::function<void(const PatrolSchedule &)> &visit) const {
+  if (!finished)
+    throw std::logic_error("schedule pool is not finished");
+  if (runs.empty()) {
+    for (const auto &record : buffer)
+      visit(decode(record));
+    return;
+  }
+  RunReader in(runs[0].path);
+  while (in.next())
+    visit(decode(in.current()));
+}
+
+void generate_compact_strategies(const int time, const ProtectData &data,
+                                 SchedulePool &pool) {
+  ScopedTimer timer("enumerate");
+  for (const auto &activity : data.activities)
+    if (activity.time <= 0)
+      throw std::invalid_argument("activity times must be positive");
+  // Depth first over areas in increasing order, so the schedule on the stack
+  // is compact; the time left bounds the depth.
+  PatrolSchedule schedule;
+  std::function<void(size_t, int)> extend = [&](size_t first, int left) {
+    for (size_t area = first; area < data.PatrolAreas.size(); area++) {
+      for (const auto &activity : data.activities) {
+        if (activity.time > left)
+          continue;
+        schedule.emplace_back(area, activity);
+        pool.add(schedule);
+        extend(area + 1, left - activity.time);
+        schedule.pop_back();
+      }
+    }
+  };
+  extend(0, time);
+  pool.finish();
+}
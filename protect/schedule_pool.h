@@ -0,0 +1,120 @@
+#ifndef SCHEDULE_POOL_H
+#define SCHEDULE_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "protect.h"
+
+// LEB128 varints, in which schedule records are encoded.
+void put_varint(std::string &out, uint64_t v);
+
+// Read the varint at pos and advance pos past it.
+// @throws std::runtime_error if in ends inside it
+uint64_t get_varint(const std::string &in, size_t &pos);
+
+struct PoolParams {
+  std::string scratch_dir; // Directory the pool's runs are written under.
+  size_t memory_budget;    // Bytes of schedules held before a run is written.
+  size_t fan_in;           // Runs merged at once.
+  PoolParams()
+      : scratch_dir("/tmp"), memory_budget(size_t(256) << 20), fan_in(64) {}
+};
+
+/*
+ * A deduplicated schedule pool that may be bigger than memory. Schedules are
+ * canonicalized (reduce_schedule, then patrols in area order) and encoded as
+ * varint area deltas and activity indices. Whenever the encoded schedules
+ * reach the memory budget they are sorted, deduplicated and written to the
+ * scratch directory as a run, each record front coded against the one
+ * before it. finish() merges the runs fan_in at a time, dropping duplicates,
+ * until one run is left, which for_each streams. A pool that stays within
+ * the budget never writes a run.
+ */
+class SchedulePool {
+private:
+  struct Run {
+    std::string path;
+    size_t count;
+  };
+
+  const ProtectData *data;
+  PoolParams params;
+  std::string dir;            // This pool's directory under scratch_dir.
+  vector<std::string> buffer; // Encoded schedules not in a run yet.
+  size_t buffered;            // Bytes buffer holds, roughly.
+  vector<Run> runs;
+  size_t runs_written;
+  size_t count; // Distinct schedules, once finished.
+  bool finished;
+
+  std::string encode(const PatrolSchedule &schedule) const;
+  PatrolSchedule decode(const std::string &record) const;
+  void spill();
+  Run merge(const vector<Run> &inputs);
+  std::string next_run_path();
+
+public:
+  /**
+   * Create the pool's scratch directory.
+   *
+   * @param data instance the schedules belong to; must outlive the pool
+   * @param params scratch directory and memory budget
+   *
+   * @throws std::runtime_error if the scratch directory cannot be created
+   */
+  SchedulePool(const ProtectData &data, const PoolParams &params = PoolParams());
+
+  // Removes the scratch directory and everything in it.
+  ~SchedulePool();
+  SchedulePool(const SchedulePool &) = delete;
+  SchedulePool &operator=(const SchedulePool &) = delete;
+
+  /**
+   * Add a schedule. Its activities must be among the instance's.
+   *
+   * @throws std::logic_error after finish()
+   * @throws std::runtime_error if a run cannot be written
+   */
+  void add(const PatrolSchedule &schedule);
+
+  // Merge everything added into one sorted, deduplicated sequence.
+  void finish();
+
+  // Distinct schedules; valid after finish().
+  size_t size() const { return count; }
+
+  // Runs written to disk so far, merges included.
+  size_t spilled_runs() const { return runs_written; }
+
+  /**
+   * Visit every distinct schedule in canonical form, in the pool's sorted
+   * order, reading at most one record at a time from disk.
+   *
+   * @throws std::logic_error before finish()
+   */
+  void for_each(
+      const std::function<void(const PatrolSchedule &)> &visit) const;
+
+  // A path in the scratch directory for other files of one pool pass.
+  std::string scratch_path(const std::string &name) const {
+    return dir + "/" + name;
+  }
+};
+
+/**
+ * Enumerate a reduced, deduplicated schedule pool for time horizon time
+ * within the pool's memory budget: generate_compact_strategies followed by
+ * reduce_schedules, streamed.
+ *
+ * @param time time horizon
+ * @param data instance
+ * @param pool receives the schedules and is finished
+ */
+void generate_compact_strategies(const int time, const ProtectData &data,
+                                 SchedulePool &pool);
+
+#endif /* SCHEDULE_POOL_H */
@@ -0,0 +1,446 @@
+#include "service.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "instance_io.h"
+#include "solve_cache.h"
+#include "stats.h"
+
+static bool write_all(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    const ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    sent += n;
+  }
+  return true;
+}
+
+SolverService::SolverService(SolveCache *cache)
+    : cache(cache), stopping(false), local_files(true) {}
+
+SolverService::Game &SolverService::find_game(const JsonValue &request) {
+  const std::string name = request.get_string("name", "default");
+  const auto it = games.find(name);
+  if (it == games.end())
+    throw std::runtime_error("no game named " + name + " is loaded");
+  return it->second;
+}
+
+std::string SolverService::load(const JsonValue &request) {
+  const std::string name = request.get_string("name", "default");
+  const int time = static_cast<int>(request.get_number("time", 10));
+  Game game;
+  vector<PatrolSchedule> schedules;
+  bool has_matrix = false;
+  std::string instance = request.get_string("instance", "");
+  const std::string text = request.get_string("text", "");
+  const JsonValue *inline_data = request.get("instance_data");
+  if (!local_files && (!instance.empty() || !text.empty()))
+    throw std::runtime_error("this server only loads \"instance_data\"");
+  // A shipped instance file is mapped from a scratch copy, like any other.
+  std::string scratch;
+  if (inline_data != nullptr && inline_data->type == JsonValue::STRING) {
+    const std::string bytes = base64_decode(inline_data->str);
+    char pattern[] = "/tmp/protect-load-XXXXXX";
+    const int fd = mkstemp(pattern);
+    if (fd < 0)
+      throw std::runtime_error("cannot create a scratch instance file");
+    scratch = instance = pattern;
+    const bool written = write_all(fd, bytes);
+    close(fd);
+    if (!written) {
+      unlink(scratch.c_str());
+      throw std::runtime_error("cannot write a scratch instance file");
+    }
+  }
+  if (!instance.empty()) {
+    try {
+      InstanceFile file(instance);
+      game.data = file.to_protect_data();
+      has_matrix = file.has_matrix();
+      if (has_matrix)
+        game.A = file.effectiveness_columns();
+      else
+        schedules = file.schedules();
+    } catch (...) {
+      if (!scratch.empty())
+        unlink(scratch.c_str());
+      throw;
+    }
+    if (!scratch.empty())
+      unlink(scratch.c_str());
+  } else if (!text.empty()) {
+    std::ifstream in(text);
+    if (!in)
+      throw std::runtime_error("cannot open " + text);
+    read_instance_text(in, game.data, schedules);
+  } else {
+    throw std::runtime_error(
+        "load needs \"instance\", \"instance_data\" or \"text\"");
+  }
+  if (!has_matrix) {
+    if (schedules.empty()) {
+      schedules = generate_compact_strategies(time, game.data);
+      reduce_schedules(schedules);
+    }
+    game.A = build_effectiveness_columns(schedules, game.data);
+  }
+  game.columns = merge_identical_columns(game.A);
+  const size_t S = game.A.size();
+  games[name] = std::move(game);
+
+  std::ostringstream out;
+  out << "\"name\":" << json_quote(name)
+      << ",\"targets\":" << games[name].data.a_penalties.size()
+      << ",\"schedules\":" << S;
+  return out.str();
+}
+
+/*
+ * Apply the payoff changes of a request ("targets", or a single change in the
+ * request itself) to Pm, returning how many there were. Pm is left partly
+ * changed if one is invalid, so callers pass a copy.
+ */
+static size_t apply_payoff_changes(const JsonValue &request, PayoffMatrix &Pm) {
+  vector<const JsonValue *> changes;
+  const JsonValue *targets = request.get("targets");
+  if (targets != nullptr && targets->type == JsonValue::ARRAY) {
+    for (const auto &t : targets->array)
+      changes.push_back(&t);
+  } else {
+    changes.push_back(&request);
+  }
+
+  for (const JsonValue *change : changes) {
+    const double target = change->get_number("target", -1);
+    if (target < 1 || target >= Pm.P_a.size())
+      throw std::runtime_error("update needs a valid \"target\"");
+    const size_t i = static_cast<size_t>(target);
+    Pm.R_d[i] = static_cast<int>(change->get_number("d_reward", Pm.R_d[i]));
+    Pm.P_d[i] = static_cast<int>(change->get_number("d_penalty", Pm.P_d[i]));
+    Pm.R_a[i] = static_cast<int>(change->get_number("a_reward", Pm.R_a[i]));
+    Pm.P_a[i] = static_cast<int>(change->get_number("a_penalty", Pm.P_a[i]));
+  }
+  return changes.size();
+}
+
+// A model's payoffs for one request, restored to the game's on destruction.
+class ScenarioPayoffs {
+private:
+  PasaqModel &model;
+  const PayoffMatrix &game;
+  bool changed;
+
+public:
+  ScenarioPayoffs(PasaqModel &model, const PayoffMatrix &game,
+                  const PayoffMatrix &scenario, bool changed)
+      : model(model), game(game), changed(changed) {
+    if (changed)
+      model.set_payoffs(scenario);
+  }
+  ~ScenarioPayoffs() {
+    if (changed)
+      model.set_payoffs(game);
+  }
+};
+
+// Solver parameters of a solve or check request.
+static SolverParams request_params(const JsonValue &request) {
+  SolverParams params;
+  params.lambda = request.get_number("lambda", params.lambda);
+  params.num_res =
+      static_cast<int>(request.get_number("resources", params.num_res));
+  params.epsilon = request.get_number("epsilon", params.epsilon);
+  params.K = static_cast<int>(request.get_number("segments", params.K));
+  params.time_limit = request.get_number("time_limit", params.time_limit);
+  params.mip_gap = request.get_number("mip_gap", params.mip_gap);
+  params.threads =
+      static_cast<int>(request.get_number("check_threads", params.threads));
+  if (params.K < 1 || params.epsilon <= 0)
+    throw std::runtime_error("segments must be >= 1 and epsilon > 0");
+  return params;
+}
+
+PasaqModel &SolverService::model_for(Game &game, const SolverParams &params) {
+  const PayoffMatrix Pm(game.data.a_rewards, game.data.a_penalties,
+                        game.data.d_rewards, game.data.d_penalties);
+  auto &model = game.models[params.K];
+  if (!model)
+    model.reset(new PasaqModel(Pm, game.columns.A, params));
+  model->set_lambda(params.lambda);
+  model->set_resources(params.num_res);
+  model->set_epsilon(params.epsilon);
+  model->set_limits(params.time_limit, params.mip_gap);
+  model->set_threads(params.threads);
+  return *model;
+}
+
+// The "coverage" and "mixture" members of a response.
+static void write_strategy(std::ostream &out, const strategy &coverage,
+                           const ScheduleMixture &mixture) {
+  out << "\"coverage\":[";
+  for (size_t i = 0; i < coverage.size(); i++)
+    out << (i > 0 ? "," : "") << coverage[i];
+  out << "],\"mixture\":[";
+  for (size_t n = 0; n < mixture.size(); n++)
+    out << (n > 0 ? "," : "") << "[" << mixture[n].first << ","
+        << mixture[n].second << "]";
+  out << "]";
+}
+
+std::string SolverService::solve(const JsonValue &request) {
+  Game &game = find_game(request);
+  const SolverParams params = request_params(request);
+  const PayoffMatrix game_Pm(game.data.a_rewards, game.data.a_penalties,
+                             game.data.d_rewards, game.data.d_penalties);
+  PayoffMatrix Pm = game_Pm;
+  const bool scenario = request.get("targets") != nullptr;
+  if (scenario)
+    apply_payoff_changes(request, Pm);
+
+  reset_stats();
+  current_stats().num_targets = Pm.P_a.size();
+  current_stats().num_schedules = game.A.size();
+  current_stats().num_columns = game.columns.members.size();
+
+  PasaqSolution solution = initial_solution(params, Pm);
+  const uint64_t hash = cache != nullptr ? hash_game(Pm, game.A) : 0;
+  if (cache != nullptr && cache->lookup(hash, params, solution)) {
+    current_stats().cache = "hit";
+  } else {
+    if (cache != nullptr)
+      current_stats().cache =
+          cache->seed(hash, params, solution) ? "seeded" : "miss";
+    PasaqModel &model = model_for(game, params);
+    ScenarioPayoffs payoffs(model, game_Pm, Pm, scenario);
+    solution.mixture = game.columns.merge(solution.mixture);
+    solution = BinarySearchSolve(model, solution);
+    solution.mixture = game.columns.expand(solution.mixture);
+    if (cache != nullptr)
+      cache->store(hash, params, solution);
+  }
+
+  std::ostringstream out;
+  out << std::setprecision(10);
+  out << "\"lower\":" << solution.lower << ",\"upper\":" << solution.upper
+      << ",";
+  write_strategy(out, solution.coverage, solution.mixture);
+  out << ",\"stats\":" << stats_to_json(current_stats());
+  reset_stats();
+  return out.str();
+}
+
+std::string SolverService::check(const JsonValue &request) {
+  Game &game = find_game(request);
+  const SolverParams params = request_params(request);
+  const JsonValue *r = request.get("r");
+  if (r == nullptr || r->type != JsonValue::NUMBER)
+    throw std::runtime_error("check needs a number \"r\"");
+  const PayoffMatrix game_Pm(game.data.a_rewards, game.data.a_penalties,
+                             game.data.d_rewards, game.data.d_penalties);
+  PayoffMatrix Pm = game_Pm;
+  const bool scenario = request.get("targets") != nullptr;
+  if (scenario)
+    apply_payoff_changes(request, Pm);
+
+  reset_stats();
+  PasaqModel &model = model_for(game, params);
+  ScenarioPayoffs payoffs(model, game_Pm, Pm, scenario);
+  FeasibilityResult result = model.check(r->number, params.time_limit);
+  result.mixture = game.columns.expand(result.mixture);
+  std::ostringstream out;
+  out << std::setprecision(17);
+  out << "\"feasible\":" << (result.feasible ? "true" : "false")
+      << ",\"decided\":" << (result.decided ? "true" : "false") << ",";
+  write_strategy(out, result.coverage, result.mixture);
+  out << ",\"stats\":" << stats_to_json(current_stats());
+  reset_stats();
+  return out.str();
+}
+
+std::string SolverService::update(const JsonValue &request) {
+  Game &game = find_game(request);
+  ProtectData &data = game.data;
+  PayoffMatrix Pm(data.a_rewards, data.a_penalties, data.d_rewards,
+                  data.d_penalties);
+  // Nothing changes unless every change is valid.
+  const size_t updated = apply_payoff_changes(request, Pm);
+  data.d_rewards = Pm.R_d;
+  data.d_penalties = Pm.P_d;
+  data.a_rewards = Pm.R_a;
+  data.a_penalties = Pm.P_a;
+
+  // The constraints do not involve payoffs, so the warm models stay valid.
+  for (auto &model : game.models)
+    model.second->set_payoffs(Pm);
+  return "\"updated\":" + std::to_string(updated);
+}
+
+std::string SolverService::handle(const std::string &line) {
+  std::string id;
+  std::string body;
+  try {
+    const JsonValue request = parse_json(line);
+    const JsonValue *id_value = request.get("id");
+    if (id_value != nullptr && id_value->type == JsonValue::STRING) {
+      id = json_quote(id_value->str);
+    } else if (id_value != nullptr && id_value->type == JsonValue::NUMBER) {
+      std::ostringstream n;
+      n << id_value->number;
+      id = n.str();
+    }
+    const std::string op = request.get_string("op", "");
+    if (op == "load") {
+      body = load(request);
+    } else if (op == "solve") {
+      body = solve(request);
+    } else if (op == "check") {
+      body = check(request);
+    } else if (op == "update") {
+      body = update(request);
+    } else if (op == "unload") {
+      games.erase(request.get_string("name", "default"));
+    } else if (op == "shutdown") {
+      stopping = true;
+    } else {
+      throw std::runtime_error("unknown op \"" + op + "\"");
+    }
+  } catch (const std::exception &e) {
+    return "{" + (id.empty() ? "" : "\"id\":" + id + ",") +
+           "\"ok\":false,\"error\":" + json_quote(e.what()) + "}";
+  }
+  return "{" + (id.empty() ? "" : "\"id\":" + id + ",") + "\"ok\":true" +
+         (body.empty() ? "" : "," + body) + "}";
+}
+
+void serve_stream(SolverService &service, std::istream &in,
+                  std::ostream &out) {
+  std::string line;
+  while (!service.done() && std::getline(in, line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+    out << service.handle(line) << std::endl;
+  }
+}
+
+
+/*
+ * Serve connections on a listening socket, one at a time, until shutdown. A
+ * connection is dropped once a read or write waits idle_timeout seconds, if
+ * that is positive.
+ */
+static void serve_connections(SolverService &service, const int listener,
+                              const double idle_timeout) {
+  // A client that goes away mid response must not take the server with it.
+  signal(SIGPIPE, SIG_IGN);
+  while (!service.done()) {
+    const int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (idle_timeout > 0) {
+      timeval tv;
+      tv.tv_sec = static_cast<time_t>(idle_timeout);
+      tv.tv_usec = static_cast<suseconds_t>(
+          (idle_timeout - static_cast<double>(tv.tv_sec)) * 1e6);
+      setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    std::string pending;
+    char buf[4096];
+    bool open = true;
+    while (open && !service.done()) {
+      const ssize_t n = read(client, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      pending.append(buf, n);
+      size_t newline;
+      while (open && (newline = pending.find('\n')) != std::string::npos) {
+        const std::string line = pending.substr(0, newline);
+        pending.erase(0, newline + 1);
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+          continue;
+        open = write_all(client, service.handle(line) + "\n");
+        if (service.done())
+          break;
+      }
+    }
+    close(client);
+  }
+}
+
+int serve_unix_socket(SolverService &service, const std::string &path) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "socket path too long: " << path << std::endl;
+    return 1;
+  }
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path.c_str());
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listener, 8) != 0) {
+    std::cerr << "cannot listen on " << path << ": " << std::strerror(errno)
+              << std::endl;
+    if (listener >= 0)
+      close(listener);
+    return 1;
+  }
+  serve_connections(service, listener, 0);
+  close(listener);
+  unlink(path.c_str());
+  return 0;
+}
+
+int serve_tcp(SolverService &service, const int port,
+              const std::string &address, const double idle_timeout) {
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+    std::cerr << "not an IPv4 address: " << address << std::endl;
+    return 1;
+  }
+
+  const int listener = socket(AF_INET, SOCK_STREAM, 0);
+  const int yes = 1;
+  if (listener < 0 ||
+      setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) != 0 ||
+      bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listener, 8) != 0) {
+    std::cerr << "cannot listen on " << address << ":" << port << ": "
+              << std::strerror(errno) << std::endl;
+    if (listener >= 0)
+      close(listener);
+    return 1;
+  }
+  service.set_local_files(false);
+  serve_connections(service, listener, idle_timeout);
+  close(listener);
+  return 0;
+}
@@ -0,0 +1,119 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "PASAQ.h"
+#include "json.h"
+#include "protect.h"
+
+class SolveCache;
+
+/*
+ * Long running solver. Requests and responses are single line JSON objects:
+ *
+ *   {"op":"load","name":"city","instance":"city.bin"}
+ *   {"op":"load","name":"city","text":"city.txt","time":10}
+ *   {"op":"load","name":"city","instance_data":"<base64 instance file>"}
+ *   {"op":"solve","name":"city","lambda":0.5,"resources":5,"epsilon":0.5,
+ *    "segments":5,"time_limit":2,"mip_gap":0}
+ *   {"op":"check","name":"city","r":-3.5,"lambda":0.5,"resources":5}
+ *   {"op":"update","name":"city","targets":[{"target":3,"d_reward":40}]}
+ *   {"op":"unload","name":"city"}
+ *   {"op":"shutdown"}
+ *
+ * "instance_data" ships the bytes of a binary instance file, for a client on
+ * another host. A check answers whether utility r is achievable with one
+ * CF-OPT solve, for clients that run the bisection themselves. Solve and
+ * check take the "targets" of an update, which hold for that request only,
+ * so a scenario with its own payoffs is one request; only update changes the
+ * game's payoffs.
+ *
+ * "name" defaults to "default" and every solve parameter is optional. A
+ * request's "id" is echoed in its response, which has "ok" and either the
+ * result or an "error". Loaded games keep their schedules, effectiveness
+ * matrix and one CF-OPT model per K, so a solve after a payoff update only
+ * recomputes the objective tables.
+ */
+class SolverService {
+private:
+  struct Game {
+    ProtectData data;
+    SparseColumns A;
+    MergedColumns columns; // A without repeated columns, as the models see it.
+    std::map<int, std::unique_ptr<PasaqModel>> models; // By K.
+  };
+
+  std::map<std::string, Game> games;
+  SolveCache *cache;
+  bool stopping;
+  bool local_files; // Whether load may open files named in a request.
+
+  Game &find_game(const JsonValue &request);
+  std::string load(const JsonValue &request);
+  PasaqModel &model_for(Game &game, const SolverParams &params);
+  std::string solve(const JsonValue &request);
+  std::string check(const JsonValue &request);
+  std::string update(const JsonValue &request);
+
+public:
+  /**
+   * @param cache solve cache to consult and fill, or nullptr
+   */
+  explicit SolverService(SolveCache *cache = nullptr);
+
+  /**
+   * Handle one request line.
+   *
+   * @param line JSON request
+   *
+   * @return JSON response, without a trailing newline
+   */
+  std::string handle(const std::string &line);
+
+  // True once a shutdown request was handled.
+  bool done() const { return stopping; }
+
+  // Allow or refuse loads of "instance" and "text" paths on this host.
+  void set_local_files(bool allow) { local_files = allow; }
+};
+
+// Serve requests read line by line from in until EOF or shutdown.
+void serve_stream(SolverService &service, std::istream &in, std::ostream &out);
+
+/**
+ * Serve requests on a Unix domain socket, one connection at a time, until a
+ * shutdown request.
+ *
+ * @param service the service
+ * @param path socket path, replaced if it exists
+ *
+ * @return 0 on a clean shutdown, 1 if the socket could not be set up
+ */
+int serve_unix_socket(SolverService &service, const std::string &path);
+
+/**
+ * Serve requests on a TCP port, one connection at a time, until a shutdown
+ * request. There is no authentication, so only loopback is served unless
+ * another address is given, and games can only be loaded from
+ * "instance_data": the service stops opening files named by requests. A
+ * connection that sends nothing for idle_timeout seconds is closed, so an
+ * idle client cannot hold the server.
+ *
+ * @param service the service
+ * @param port port to listen on
+ * @param address IPv4 address to bind, "0.0.0.0" for every interface
+ * @param idle_timeout seconds a connection may stay silent, 0 for no limit
+ *
+ * @return 0 on a clean shutdown, 1 if the socket could not be set up
+ */
+int serve_tcp(SolverService &service, const int port,
+              const std::string &address = "127.0.0.1",
+              const double idle_timeout = 60);
+
+#endif /* SERVICE_H */
@@ -0,0 +1,195 @@
+#include "solve_cache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char CACHE_MAGIC[] = "protect-solve-cache";
+static const int CACHE_VERSION = 1;
+
+void hash_columns(Fnv1a &h, const size_t rows, const SparseColumns &A) {
+  h.add(static_cast<uint64_t>(rows));
+  h.add(static_cast<uint64_t>(A.size()));
+  // Row i as (j, A_ij), j ascending.
+  vector<vector<pair<size_t, double>>> by_row(rows);
+  for (size_t j = 0; j < A.size(); j++)
+    for (const auto &entry : A[j])
+      if (entry.first < rows && entry.second != 0)
+        by_row[entry.first].emplace_back(j, entry.second);
+  for (size_t i = 0; i < rows; i++) {
+    for (const auto &entry : by_row[i]) {
+      h.add(static_cast<uint64_t>(i));
+      h.add(static_cast<uint64_t>(entry.first));
+      h.add(entry.second);
+    }
+  }
+}
+
+uint64_t hash_game(const PayoffMatrix &Pm, const SparseColumns &A) {
+  Fnv1a h;
+  for (const Payoff *payoff : {&Pm.R_d, &Pm.P_d, &Pm.R_a, &Pm.P_a}) {
+    h.add(static_cast<uint64_t>(payoff->size()));
+    for (const int v : *payoff)
+      h.add(static_cast<uint64_t>(static_cast<int64_t>(v)));
+  }
+  hash_columns(h, Pm.P_a.size(), A);
+  return h.value();
+}
+
+uint64_t hash_params(const SolverParams &params) {
+  Fnv1a h;
+  h.add(params.lambda);
+  h.add(static_cast<uint64_t>(params.K));
+  h.add(static_cast<uint64_t>(params.num_res));
+  h.add(params.epsilon);
+  return h.value();
+}
+
+static std::string hex(uint64_t v) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+  return buf;
+}
+
+struct CacheEntry {
+  SolverParams params;
+  PasaqSolution solution;
+};
+
+static bool read_entry(const std::string &path, CacheEntry &entry) {
+  std::ifstream in(path);
+  std::string magic, keyword;
+  int version;
+  size_t n;
+  if (!(in >> magic >> version) || magic != CACHE_MAGIC ||
+      version != CACHE_VERSION)
+    return false;
+  SolverParams &p = entry.params;
+  PasaqSolution &s = entry.solution;
+  if (!(in >> keyword >> p.lambda >> p.K >> p.num_res >> p.epsilon) ||
+      keyword != "params")
+    return false;
+  if (!(in >> keyword >> s.lower >> s.upper) || keyword != "bounds")
+    return false;
+  if (!(in >> keyword >> n) || keyword != "coverage")
+    return false;
+  s.coverage.assign(n, 0);
+  for (auto &x : s.coverage)
+    if (!(in >> x))
+      return false;
+  if (!(in >> keyword >> n) || keyword != "mixture")
+    return false;
+  s.mixture.assign(n, {0, 0});
+  for (auto &a : s.mixture)
+    if (!(in >> a.first >> a.second))
+      return false;
+  return true;
+}
+
+// Every readable entry of a game.
+static vector<CacheEntry> read_game(const std::string &game_dir) {
+  vector<CacheEntry> entries;
+  DIR *d = opendir(game_dir.c_str());
+  if (d == nullptr)
+    return entries;
+  while (const dirent *e = readdir(d)) {
+    const std::string name = e->d_name;
+    if (name.size() < 4 || name.compare(name.size() - 4, 4, ".sol") != 0)
+      continue;
+    CacheEntry entry;
+    if (read_entry(game_dir + "/" + name, entry))
+      entries.push_back(entry);
+  }
+  closedir(d);
+  return entries;
+}
+
+SolveCache::SolveCache(const std::string &dir) : dir(dir) {
+  mkdir(dir.c_str(), 0755);
+}
+
+std::string SolveCache::game_dir(uint64_t game) const {
+  return dir + "/" + hex(game);
+}
+
+std::string SolveCache::entry_path(uint64_t game,
+                                   const SolverParams &params) const {
+  return game_dir(game) + "/" + hex(hash_params(params)) + ".sol";
+}
+
+bool SolveCache::lookup(uint64_t game, const SolverParams &params,
+                        PasaqSolution &solution) const {
+  // Entries of searches cut short by a deadline only serve as seeds.
+  CacheEntry entry;
+  if (read_entry(entry_path(game, params), entry) &&
+      entry.solution.upper - entry.solution.lower <= params.epsilon) {
+    solution = entry.solution;
+    return true;
+  }
+  for (const auto &e : read_game(game_dir(game))) {
+    if (e.params.lambda == params.lambda && e.params.K == params.K &&
+        e.params.num_res == params.num_res &&
+        e.solution.upper - e.solution.lower <= params.epsilon) {
+      solution = e.solution;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SolveCache::seed(uint64_t game, const SolverParams &params,
+                      PasaqSolution &start) const {
+  bool seeded = false;
+  for (const auto &e : read_game(game_dir(game))) {
+    if (e.params.lambda != params.lambda || e.params.K != params.K)
+      continue;
+    if (e.params.num_res <= params.num_res && e.solution.lower > start.lower) {
+      start.lower = e.solution.lower;
+      start.coverage = e.solution.coverage;
+      start.mixture = e.solution.mixture;
+      seeded = true;
+    }
+    if (e.params.num_res >= params.num_res && e.solution.upper < start.upper) {
+      start.upper = e.solution.upper;
+      seeded = true;
+    }
+  }
+  return seeded;
+}
+
+void SolveCache::store(uint64_t game, const SolverParams &params,
+                       const PasaqSolution &solution) const {
+  mkdir(game_dir(game).c_str(), 0755);
+  const std::string path = entry_path(game, params);
+  static std::atomic<unsigned> writes(0);
+  const std::string tmp = path + ".tmp." + std::to_string(getpid()) + "." +
+                          std::to_string(writes++);
+  {
+    std::ofstream out(tmp);
+    out << std::setprecision(17);
+    out << CACHE_MAGIC << " " << CACHE_VERSION << "\n";
+    out << "params " << params.lambda << " " << params.K << " "
+        << params.num_res << " " << params.epsilon << "\n";
+    out << "bounds " << solution.lower << " " << solution.upper << "\n";
+    out << "coverage " << solution.coverage.size();
+    for (const auto x : solution.coverage)
+      out << " " << x;
+    out << "\nmixture " << solution.mixture.size();
+    for (const auto &a : solution.mixture)
+      out << " " << a.first << " " << a.second;
+    out << "\n";
+    if (!out) {
+      std::remove(tmp.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    std::remove(tmp.c_str());
+}
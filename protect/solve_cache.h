@@ -0,0 +1,109 @@
+#ifndef SOLVE_CACHE_H
+#define SOLVE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "PASAQ.h"
+
+/*
+ * On disk cache of solved games. A game is identified by a hash of its
+ * payoffs and effectiveness matrix (which is what areas, activities and the
+ * schedule set reduce to), and a solve by that hash plus the solver
+ * parameters. Entries live in <dir>/<game hash>/<params hash>.sol and are
+ * written to a temporary file and renamed into place, so concurrent solvers
+ * never see a partial entry.
+ */
+
+// 64 bit FNV-1a, fed one value at a time.
+class Fnv1a {
+private:
+  uint64_t h;
+
+public:
+  Fnv1a() : h(14695981039346656037ULL) {}
+  void bytes(const void *data, size_t len) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; i++) {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+    }
+  }
+  void add(uint64_t v) { bytes(&v, sizeof(v)); }
+  void add(double v) {
+    // -0.0 and 0.0 are the same coefficient.
+    if (v == 0)
+      v = 0;
+    bytes(&v, sizeof(v));
+  }
+  uint64_t value() const { return h; }
+};
+
+// Add A, as rows x A.size(), to h by row: its non zero (i, j, A_ij) in row
+// major order, so the same matrix hashes the same however it is stored.
+void hash_columns(Fnv1a &h, const size_t rows, const SparseColumns &A);
+
+// Stable 64 bit hash of the game being solved; A has one row per payoff slot.
+uint64_t hash_game(const PayoffMatrix &Pm, const SparseColumns &A);
+
+// Stable 64 bit hash of the parameters that change the solve.
+uint64_t hash_params(const SolverParams &params);
+
+class SolveCache {
+private:
+  std::string dir;
+
+  std::string game_dir(uint64_t game) const;
+  std::string entry_path(uint64_t game, const SolverParams &params) const;
+
+public:
+  /**
+   * Open (and create if needed) a cache directory.
+   *
+   * @param dir cache directory
+   */
+  explicit SolveCache(const std::string &dir);
+
+  /**
+   * Find a cached solution that answers this solve: the same parameters, or
+   * the same game, lambda, K and resources solved to at least the requested
+   * tolerance.
+   *
+   * @param game hash_game of the game
+   * @param params requested solver parameters
+   * @param solution set to the cached solution on a hit
+   *
+   * @return true on a hit
+   */
+  bool lookup(uint64_t game, const SolverParams &params,
+              PasaqSolution &solution) const;
+
+  /**
+   * Narrow start using cached solves of the same game, lambda and K. The
+   * optimum does not decrease with more resources, so an entry with fewer
+   * resources raises the lower bound (and supplies its strategy as the
+   * incumbent) and an entry with more resources lowers the upper bound.
+   *
+   * @param game hash_game of the game
+   * @param params requested solver parameters
+   * @param start interval to narrow, usually from initial_solution
+   *
+   * @return true if any bound was narrowed
+   */
+  bool seed(uint64_t game, const SolverParams &params,
+            PasaqSolution &start) const;
+
+  /**
+   * Store a solution. Failures to write are ignored, the cache is only an
+   * optimization.
+   *
+   * @param game hash_game of the game
+   * @param params parameters the solution was computed with
+   * @param solution the solution
+   */
+  void store(uint64_t game, const SolverParams &params,
+             const PasaqSolution &solution) const;
+};
+
+#endif /* SOLVE_CACHE_H */
@@ -0,0 +1,139 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+static thread_local SolveStats stats_record;
+static thread_local SolveStats last_record;
+static std::ostream *stats_sink = nullptr;
+static std::mutex stats_sink_mutex; // Solves may finish on several threads.
+
+SolveStats::SolveStats()
+    : num_targets(0), num_schedules(0), num_columns(0), bisection_steps(0),
+      mip_solves(0), simplex_iterations(0), bnb_nodes(0), last_mip_gap(0),
+      max_mip_gap(0), undecided_checks(0), heuristic_solutions(0),
+      fill_cuts(0), knapsack_cuts(0), cut_bound_gain(0) {}
+
+void SolveStats::add_time(const std::string &phase, double seconds) {
+  for (auto &p : phases) {
+    if (p.name == phase) {
+      p.seconds += seconds;
+      p.calls++;
+      return;
+    }
+  }
+  phases.push_back({phase, seconds, 1});
+}
+
+void SolveStats::add_counters(const SolveStats &other) {
+  bisection_steps += other.bisection_steps;
+  mip_solves += other.mip_solves;
+  simplex_iterations += other.simplex_iterations;
+  bnb_nodes += other.bnb_nodes;
+  max_mip_gap = std::max(max_mip_gap, other.max_mip_gap);
+  undecided_checks += other.undecided_checks;
+  heuristic_solutions += other.heuristic_solutions;
+  fill_cuts += other.fill_cuts;
+  knapsack_cuts += other.knapsack_cuts;
+  cut_bound_gain += other.cut_bound_gain;
+}
+
+double SolveStats::time_of(const std::string &phase) const {
+  for (const auto &p : phases)
+    if (p.name == phase)
+      return p.seconds;
+  return 0;
+}
+
+// Discards everything written to it.
+class NullLogBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+};
+
+static thread_local std::ostream *log_stream = nullptr;
+
+std::ostream &solver_log() {
+  return log_stream != nullptr ? *log_stream : std::cout;
+}
+
+void set_solver_log(std::ostream *log) {
+  static thread_local NullLogBuffer null_buffer;
+  static thread_local std::ostream null_stream(&null_buffer);
+  log_stream = log != nullptr ? log : &null_stream;
+}
+
+SolveStats &current_stats() { return stats_record; }
+
+void reset_stats() { stats_record = SolveStats(); }
+
+void set_stats_sink(std::ostream *sink) { stats_sink = sink; }
+
+// GLPK reports DBL_MAX as the gap when there is no incumbent yet, which JSON
+// cannot represent.
+static void write_number(std::ostream &out, double value) {
+  if (std::isfinite(value) && value < DBL_MAX)
+    out << value;
+  else
+    out << "null";
+}
+
+std::string stats_to_json(const SolveStats &stats) {
+  std::ostringstream out;
+  out << "{\"num_targets\":" << stats.num_targets
+      << ",\"num_schedules\":" << stats.num_schedules
+      << ",\"num_columns\":" << stats.num_columns
+      << ",\"bisection_steps\":" << stats.bisection_steps
+      << ",\"mip_solves\":" << stats.mip_solves
+      << ",\"simplex_iterations\":" << stats.simplex_iterations
+      << ",\"bnb_nodes\":" << stats.bnb_nodes << ",\"last_mip_gap\":";
+  write_number(out, stats.last_mip_gap);
+  out << ",\"max_mip_gap\":";
+  write_number(out, stats.max_mip_gap);
+  out << ",\"undecided_checks\":" << stats.undecided_checks
+      << ",\"heuristic_solutions\":" << stats.heuristic_solutions
+      << ",\"fill_cuts\":" << stats.fill_cuts
+      << ",\"knapsack_cuts\":" << stats.knapsack_cuts
+      << ",\"cut_bound_gain\":" << stats.cut_bound_gain;
+  if (!stats.cache.empty())
+    out << ",\"cache\":\"" << stats.cache << "\"";
+
+  // Time BinarySearchMethod spends outside of its feasibility checks.
+  out << ",\"bisection_overhead_seconds\":"
+      << std::max(0.0, stats.time_of("binary_search") -
+                           stats.time_of("check_feasibility"));
+
+  out << ",\"phases\":{";
+  for (size_t i = 0; i < stats.phases.size(); i++) {
+    const auto &p = stats.phases[i];
+    out << (i > 0 ? "," : "") << "\"" << p.name << "\":{\"seconds\":"
+        << p.seconds << ",\"calls\":" << p.calls << "}";
+  }
+  out << "}}";
+  return out.str();
+}
+
+void emit_stats() {
+  if (stats_sink != nullptr) {
+    const std::string line = stats_to_json(stats_record);
+    std::lock_guard<std::mutex> lock(stats_sink_mutex);
+    *stats_sink << line << std::endl;
+  }
+  last_record = stats_record;
+  reset_stats();
+}
+
+const SolveStats &last_stats() { return last_record; }
+
+ScopedTimer::ScopedTimer(const char *phase)
+    : phase(phase), start(std::chrono::steady_clock::now()) {}
+
+ScopedTimer::~ScopedTimer() {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  stats_record.add_time(phase, elapsed.count());
+}
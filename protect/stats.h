@@ -0,0 +1,113 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Per-solve instrumentation. Phase timers and solver counters accumulate into a
+ * thread local SolveStats record, which is written out as a single line of
+ * JSON once a solve finishes. Recording is a handful of adds per phase, so it
+ * is always on; output only happens when a sink has been set.
+ */
+
+// Accumulated wall clock time of one named phase.
+struct PhaseTime {
+  std::string name;
+  double seconds;
+  size_t calls;
+};
+
+struct SolveStats {
+  std::vector<PhaseTime> phases;
+  size_t num_targets;        // Targets in the game.
+  size_t num_schedules;      // Columns of the effectiveness matrix.
+  size_t num_columns;        // Of those, distinct ones: the LP's a_j.
+  size_t bisection_steps;    // Iterations of BinarySearchMethod.
+  size_t mip_solves;         // Calls to glp_intopt.
+  size_t simplex_iterations; // Simplex iterations over all MIP solves.
+  size_t bnb_nodes;          // Branch and bound nodes over all MIP solves.
+  double last_mip_gap;       // Relative gap reported by the last MIP solve.
+  double max_mip_gap;        // Largest final gap over all MIP solves.
+  size_t undecided_checks;   // Checks a time or gap limit left unsettled.
+  size_t heuristic_solutions; // Incumbents found by rounding relaxations.
+  size_t fill_cuts;          // Cuts added to branch and bound, by family.
+  size_t knapsack_cuts;
+  double cut_bound_gain;     // Root bound raised by cuts, over all checks.
+  std::string cache;         // Solve cache outcome: hit, seeded or miss.
+
+  SolveStats();
+
+  /**
+   * Add elapsed time to a phase, creating it on first use.
+   *
+   * @param phase name of the phase
+   * @param seconds time to add
+   */
+  void add_time(const std::string &phase, double seconds);
+
+  /**
+   * Add the solver counters of other, such as a worker thread's record, to
+   * this one. Phase times are left alone, as they overlap.
+   *
+   * @param other record to add
+   */
+  void add_counters(const SolveStats &other);
+
+  /**
+   * Total time spent in phase, or 0 if it never ran.
+   *
+   * @param phase name of the phase
+   */
+  double time_of(const std::string &phase) const;
+};
+
+// Stats record of the calling thread.
+SolveStats &current_stats();
+
+// Clear the stats record of the calling thread.
+void reset_stats();
+
+/**
+ * Set the stream that emit_stats writes to. nullptr (the default) disables
+ * output, while counters keep being collected.
+ *
+ * @param sink output stream, not owned
+ */
+void set_stats_sink(std::ostream *sink);
+
+// Serialize a stats record as a single line JSON object.
+std::string stats_to_json(const SolveStats &stats);
+
+// Write the current record to the sink (if any) and reset it.
+void emit_stats();
+
+// The record most recently passed to emit_stats on this thread.
+const SolveStats &last_stats();
+
+// Stream for the solver's progress messages on the calling thread;
+// std::cout unless changed with set_solver_log.
+std::ostream &solver_log();
+
+// Redirect the calling thread's progress messages; nullptr discards them.
+void set_solver_log(std::ostream *log);
+
+/*
+ * Adds the time between construction and destruction to a phase of the
+ * current stats record.
+ */
+class ScopedTimer {
+private:
+  const char *phase;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit ScopedTimer(const char *phase);
+  ~ScopedTimer();
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+#endif /* STATS_H */
@@ -0,0 +1,87 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <numeric>
+
+vector<SweepPoint> sweep_grid(const vector<double> &lambdas,
+                              const vector<int> &resources) {
+  vector<SweepPoint> points;
+  for (size_t l = 0; l < lambdas.size(); l++) {
+    for (size_t n = 0; n < resources.size(); n++) {
+      const size_t r = l % 2 == 0 ? n : resources.size() - 1 - n;
+      points.push_back({lambdas[l], resources[r]});
+    }
+  }
+  return points;
+}
+
+PasaqSolution continue_solution(const SweepPoint &prev,
+                                const PasaqSolution &prev_solution,
+                                const SweepPoint &next,
+                                const SolverParams &params,
+                                const PayoffMatrix &Pm) {
+  PasaqSolution start = initial_solution(params, Pm);
+  if (prev.lambda == next.lambda) {
+    if (next.num_res >= prev.num_res && prev_solution.lower > start.lower) {
+      start.lower = prev_solution.lower;
+      start.coverage = prev_solution.coverage;
+      start.mixture = prev_solution.mixture;
+    }
+    if (next.num_res <= prev.num_res)
+      start.upper = std::min(start.upper, prev_solution.upper);
+    return start;
+  }
+
+  // A different lambda only changes how the attacker responds.
+  const double used = std::accumulate(prev_solution.coverage.begin(),
+                                      prev_solution.coverage.end(), 0.0);
+  if (used <= next.num_res) {
+    const double utility = UD(prev_solution.coverage, Pm, next.lambda);
+    if (utility > start.lower && utility <= start.upper) {
+      start.lower = utility;
+      start.coverage = prev_solution.coverage;
+      start.mixture = prev_solution.mixture;
+    }
+  }
+  return start;
+}
+
+vector<SweepResult> solve_sweep(const PayoffMatrix &Pm,
+                                const SparseColumns &A,
+                                const vector<SweepPoint> &points,
+                                const SolverParams &params) {
+  vector<SweepResult> results;
+  if (points.empty())
+    return results;
+  reset_stats();
+  SolverParams point_params = params;
+  point_params.lambda = points[0].lambda;
+  point_params.num_res = points[0].num_res;
+  PasaqModel model(Pm, A, point_params);
+  model.set_warm_start(true);
+
+  for (size_t n = 0; n < points.size(); n++) {
+    const SweepPoint &point = points[n];
+    // The model build counts towards the first point.
+    if (n > 0)
+      reset_stats();
+    current_stats().num_targets = Pm.P_a.size();
+    current_stats().num_schedules = A.size();
+    point_params.lambda = point.lambda;
+    point_params.num_res = point.num_res;
+    model.set_lambda(point.lambda);
+    model.set_resources(point.num_res);
+
+    const PasaqSolution start =
+        n == 0 ? initial_solution(point_params, Pm)
+               : continue_solution(points[n - 1], results.back().solution,
+                                   point, point_params, Pm);
+    SweepResult result;
+    result.point = point;
+    result.solution = BinarySearchSolve(model, start);
+    result.stats = current_stats();
+    emit_stats();
+    results.push_back(std::move(result));
+  }
+  return results;
+}
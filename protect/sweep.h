@@ -0,0 +1,69 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <vector>
+
+#include "PASAQ.h"
+#include "stats.h"
+
+// One point of a sensitivity sweep.
+struct SweepPoint {
+  double lambda;
+  int num_res;
+};
+
+struct SweepResult {
+  SweepPoint point;
+  PasaqSolution solution;
+  SolveStats stats; // Stats of this point's solve alone.
+};
+
+/**
+ * Grid of every (lambda, resources) pair, in serpentine order: resources go
+ * up for the first lambda, down for the next, and so on, so that consecutive
+ * points differ in one parameter only.
+ *
+ * @param lambdas attacker rationality values, in sweep order
+ * @param resources resource counts, in sweep order
+ */
+vector<SweepPoint> sweep_grid(const vector<double> &lambdas,
+                              const vector<int> &resources);
+
+/**
+ * Starting interval and strategy for the next point of a sweep, tightened by
+ * the solution of the previous point: with the same lambda, more resources
+ * can still reach the previous lower bound and fewer resources cannot beat
+ * the previous upper bound; after a lambda change the previous strategy is
+ * still playable, so its exact utility under the new lambda is achievable.
+ *
+ * @param prev previous point
+ * @param prev_solution its solution
+ * @param next next point
+ * @param params solver parameters of the next point
+ * @param Pm payoffs
+ */
+PasaqSolution continue_solution(const SweepPoint &prev,
+                                const PasaqSolution &prev_solution,
+                                const SweepPoint &next,
+                                const SolverParams &params,
+                                const PayoffMatrix &Pm);
+
+/**
+ * Solve a sequence of (lambda, resources) points on one CF-OPT model. The
+ * model's constraints are built once; each point only rewrites the objective
+ * tables and the resource bound, starts its bisection from
+ * continue_solution, and seeds GLPK with the previous MILP solution.
+ *
+ * @param Pm payoffs
+ * @param A effectiveness matrix, by column
+ * @param points points, ideally ordered so neighbours are close
+ * @param params epsilon and K of every point
+ *
+ * @return one result per point, in order
+ */
+vector<SweepResult> solve_sweep(const PayoffMatrix &Pm,
+                                const SparseColumns &A,
+                                const vector<SweepPoint> &points,
+                                const SolverParams &params = SolverParams());
+
+#endif /* SWEEP_H */
@@ -0,0 +1,65 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed size pool of worker threads running queued tasks in FIFO order. The
+ * destructor finishes every queued task before joining the workers.
+ */
+class ThreadPool {
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool stopping;
+
+  void work();
+
+public:
+  /**
+   * Start the workers.
+   *
+   * @param threads number of workers; 0 uses the hardware concurrency
+   */
+  explicit ThreadPool(size_t threads = 0);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers.size(); }
+
+  /**
+   * Queue a task.
+   *
+   * @param task callable taking no arguments
+   *
+   * @return future for the task's result; exceptions thrown by the task are
+   * rethrown by get()
+   */
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> submit(F task) {
+    typedef typename std::result_of<F()>::type result_type;
+    auto job =
+        std::make_shared<std::packaged_task<result_type()>>(std::move(task));
+    std::future<result_type> result = job->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace([job]() { (*job)(); });
+    }
+    ready.notify_one();
+    return result;
+  }
+};
+
+#endif /* THREAD_POOL_H */